@@ -14,7 +14,7 @@ usage() {
   fprintf(stderr, 
       "USAGE: swiftclient -u username -p password -h hostname\n"
       "                   [-c container] [-o object] [-A action]\n"
-      "                   [-N path]\n"
+      "                   [-N path] [-T tokenfile]\n"
       "\n"
       "Action can be any of:\n"
       "   createcont -- create a container, named with -c container\n"
@@ -30,6 +30,8 @@ usage() {
       "   -N path -- list all objects or containers at given path, eg:\n"
       "      -N /mycontainer\n"
       "      -N /\n"
+      "\n"
+      "   -T tokenfile -- reuse tokens across runs through tokenfile\n"
       );
 }
 
@@ -68,7 +70,7 @@ parse_action(const char *action) {
 int
 read_options(struct client_options *cl_opts, int argc, char **argv) {
 
-  const char *options = "u:p:h:c:o:A:N:f:s:";
+  const char *options = "u:p:h:c:o:A:N:f:s:T:";
   char *action = NULL;
   char cur_option;
   memset(cl_opts, 0, sizeof(struct client_options));
@@ -106,6 +108,9 @@ read_options(struct client_options *cl_opts, int argc, char **argv) {
       case 'f':
         cl_opts->filename = optarg;
         break;
+      case 'T':
+        cl_opts->tokenfile = optarg;
+        break;
       case '?':
       default:
         usage();
@@ -153,11 +158,6 @@ validate_options(struct client_options *opts) {
       }
       break;
     case ACTION_OBJ_WRITE:
-      if (!opts->str_filesize && !opts->filename) {
-        fprintf(stderr, "Must specify a file size when uploading from stdin!\n\n");
-        usage();
-        return 0;
-      }
       /* If filesize is provided, use it */
       if (opts->str_filesize) {
         opts->filesize = strtol(opts->str_filesize, &endptr, 10);
@@ -194,12 +194,6 @@ setupio(struct client_options *opts) {
         fprintf(stderr, "Unable to open file for input: %s\n", opts->filename);
         return NULL;
       }
-      if (!opts->str_filesize) {
-        /* Set filesize based on size of input file */
-        fseek(fio, 0, SEEK_END);
-        opts->filesize = ftell(fio);
-        rewind(fio);
-      }
       break;
     case ACTION_OBJ_READ:
       fio = fopen(opts->filename, "w");
@@ -238,44 +232,27 @@ execute_nodelist(struct client_options *opts, struct swift_context *c) {
 swift_error
 execute_objread(struct client_options *opts, struct swift_context *c) {
 
-  struct swift_transfer_handle *h;
-  swift_error e;
-  size_t n_bytes;
-  char tempbuf[128];
-
-  e = swift_object_readhandle(c, opts->container, opts->object, &h);
-  if (e == SWIFT_SUCCESS) {
-    while ( n_bytes = swift_read(h, tempbuf, 128)) {
-      fwrite(tempbuf, 1, n_bytes, opts->datahandle);
-    }
-    swift_free_transfer_handle(&h);
-  }
-  return e;
+  /* Let the library write the body straight into our output */
+  fflush(opts->datahandle);
+  return swift_object_get_fd(c, opts->container, opts->object,
+      fileno(opts->datahandle));
 }
 
 
 swift_error
 execute_objwrite(struct client_options *opts, struct swift_context *c) {
 
-  struct swift_transfer_handle *h;
-  swift_error e;
-  size_t n_bytes_read;
-  size_t n_bytes_written;
-  char tempbuf[128];
+  size_t length;
 
-  e = swift_object_writehandle(c, opts->container, opts->object, &h, opts->filesize);
-  if (e == SWIFT_SUCCESS) {
-    while (n_bytes_read = fread(tempbuf, 1, 128, opts->datahandle)) {
-      n_bytes_written = swift_write(h, tempbuf, n_bytes_read);
-      if (n_bytes_written != n_bytes_read) {
-        e = SWIFT_ERROR_UNKNOWN;
-        break;
-      }
-    }
-    e = swift_sync(h);
-    swift_free_transfer_handle(&h);
+  /* Refuse to overwrite, like swift_object_writehandle() does */
+  if (swift_object_exists(c, opts->container, opts->object, &length) ==
+      SWIFT_SUCCESS) {
+    return SWIFT_ERROR_EXISTS;
   }
-  return e;
+
+  /* Files are mapped, stdin is streamed, neither is staged in memory */
+  return swift_object_put_fd(c, opts->container, opts->object,
+      fileno(opts->datahandle));
 }
 
 
@@ -358,6 +335,14 @@ main(int argc, char ** argv) {
     exit(EXIT_FAILURE);
   }
 
+  if (opts.tokenfile) {
+    e = swift_context_set_token_cache(c, opts.tokenfile);
+    if (e) {
+      fprintf(stderr, "Error: %s, line %d\n", swift_errormsg(e), __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
   e = execute_action(&opts, c);
   if (e) {
     fprintf(stderr, "Error: %s, line %d\n", swift_errormsg(e), __LINE__);
@@ -20,6 +20,7 @@ struct client_options {
   char *container;
   char *object;
   char *path;
+  char *tokenfile;
 
   char *filename;
   FILE *datahandle;
@@ -9,6 +9,17 @@
 struct test_curl_params params;
 
 CURLcode test_curl_easy_perform(CURL *handle) {
+  const char *line = params.response_headers;
+  const char *end;
+
+  /* Hand the canned headers, one a line, to the header callback */
+  while (line && *line && params.headerfunc) {
+    end = strchr(line, '\n');
+    end = end ? end + 1 : line + strlen(line);
+    params.headerfunc((char *)line, 1, end - line, params.headerdata);
+    line = end;
+  }
+
   return CURLE_OK;
 }
 
@@ -21,6 +32,7 @@ void test_curl_easy_reset(CURL *handle) {
   params.nobody = 0;
   params.upload = 0;
   params.infilesize = 0;
+  params.http_version = 0;
   params.readdata = NULL;
   params.writedata = NULL;
   params.headerdata = NULL;
@@ -115,11 +127,17 @@ CURLcode test_curl_easy_setopt(CURL *handle, CURLoption option, ...) {
       params.nobody = va_arg(args, int);
       break;
     case CURLOPT_INFILESIZE:
-      params.infilesize = va_arg(args, int);
+      params.infilesize = va_arg(args, long);
+      break;
+    case CURLOPT_INFILESIZE_LARGE:
+      params.infilesize = va_arg(args, curl_off_t);
       break;
     case CURLOPT_UPLOAD:
       params.upload = va_arg(args, int);
       break;
+    case CURLOPT_HTTP_VERSION:
+      params.http_version = va_arg(args, long);
+      break;
     default:
       printf("Unhandled options!\n");
       exit(EXIT_FAILURE);
@@ -6,7 +6,8 @@ struct test_curl_params {
   char *request;
   int nobody;
   int upload;
-  int infilesize;
+  curl_off_t infilesize;
+  long http_version;
 
   void *readdata;
   void *writedata;
@@ -18,6 +19,7 @@ struct test_curl_params {
   struct curl_slist *headers;
 
   int response_code;
+  const char *response_headers;
 };
 
 extern struct test_curl_params params;
@@ -1,9 +1,16 @@
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include <curl/curl.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "swift.h"
 #include "swift_private.h"
@@ -28,6 +35,16 @@ swift_errormsg(swift_error e) {
       return "Could not allocate memory";
     case SWIFT_ERROR_EXISTS:
       return "Object/Container exists";
+    case SWIFT_ERROR_NOT_MODIFIED:
+      return "Object not modified";
+    case SWIFT_ERROR_CHECKSUM:
+      return "Checksum mismatch";
+    case SWIFT_ERROR_TIMEOUT:
+      return "Deadline passed";
+    case SWIFT_ERROR_STALLED:
+      return "Transfer stalled";
+    case SWIFT_ERROR_COMPRESSED:
+      return "Object is stored compressed";
     default:
       return "Undefined error";
     }
@@ -36,20 +53,227 @@ swift_errormsg(swift_error e) {
 STATIC void
 swift_chomp(char *str) {
 
+  size_t len;
+
   if (!str) {
     return;
   }
 
-  if (str[strlen(str) - 1] == '\n') {
-    str[strlen(str) - 1] = '\0';
+  len = strlen(str);
+  if (len && str[len - 1] == '\n') {
+    str[--len] = '\0';
   }
 
-  if (str[strlen(str) - 1] == '\r') {
-    str[strlen(str) - 1] = '\0';
+  if (len && str[len - 1] == '\r') {
+    str[--len] = '\0';
   }
 
 }
  
+STATIC int
+swift_copy_etag(char *dest, const char *value) {
+
+  char *quote;
+  int quoted = 0;
+
+  /* Large object manifests hand the ETag back in quotes */
+  if (*value == '"') {
+    ++value;
+    quoted = 1;
+  }
+  strncpy(dest, value, 63);
+  dest[63] = '\0';
+  if ((quote = strchr(dest, '"'))) {
+    *quote = '\0';
+  }
+
+  return quoted;
+}
+
+/* MD5 as described in RFC 1321 */
+#define SWIFT_MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define SWIFT_MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define SWIFT_MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define SWIFT_MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define SWIFT_MD5_STEP(f, a, b, c, d, x, t, s) \
+  (a) += f((b), (c), (d)) + (x) + (t); \
+  (a) = (((a) << (s)) | (((a) & 0xffffffff) >> (32 - (s)))) & 0xffffffff; \
+  (a) += (b);
+
+STATIC void
+swift_md5_init(struct swift_md5 *md5) {
+
+  md5->state[0] = 0x67452301;
+  md5->state[1] = 0xefcdab89;
+  md5->state[2] = 0x98badcfe;
+  md5->state[3] = 0x10325476;
+  md5->count = 0;
+  md5->skip = 0;
+}
+
+STATIC void
+swift_md5_block(struct swift_md5 *md5, const unsigned char *p) {
+
+  unsigned int x[16];
+  unsigned int a, b, c, d;
+  int i;
+
+  for (i = 0; i < 16; ++i) {
+    x[i] = (unsigned int)p[i * 4] | ((unsigned int)p[i * 4 + 1] << 8) |
+      ((unsigned int)p[i * 4 + 2] << 16) | ((unsigned int)p[i * 4 + 3] << 24);
+  }
+
+  a = md5->state[0];
+  b = md5->state[1];
+  c = md5->state[2];
+  d = md5->state[3];
+
+  SWIFT_MD5_STEP(SWIFT_MD5_F, a, b, c, d, x[0], 0xd76aa478, 7)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, d, a, b, c, x[1], 0xe8c7b756, 12)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, c, d, a, b, x[2], 0x242070db, 17)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, b, c, d, a, x[3], 0xc1bdceee, 22)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, a, b, c, d, x[4], 0xf57c0faf, 7)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, d, a, b, c, x[5], 0x4787c62a, 12)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, c, d, a, b, x[6], 0xa8304613, 17)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, b, c, d, a, x[7], 0xfd469501, 22)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, a, b, c, d, x[8], 0x698098d8, 7)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, d, a, b, c, x[9], 0x8b44f7af, 12)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, c, d, a, b, x[10], 0xffff5bb1, 17)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, b, c, d, a, x[11], 0x895cd7be, 22)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, a, b, c, d, x[12], 0x6b901122, 7)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, d, a, b, c, x[13], 0xfd987193, 12)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, c, d, a, b, x[14], 0xa679438e, 17)
+  SWIFT_MD5_STEP(SWIFT_MD5_F, b, c, d, a, x[15], 0x49b40821, 22)
+
+  SWIFT_MD5_STEP(SWIFT_MD5_G, a, b, c, d, x[1], 0xf61e2562, 5)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, d, a, b, c, x[6], 0xc040b340, 9)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, c, d, a, b, x[11], 0x265e5a51, 14)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, b, c, d, a, x[0], 0xe9b6c7aa, 20)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, a, b, c, d, x[5], 0xd62f105d, 5)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, d, a, b, c, x[10], 0x02441453, 9)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, c, d, a, b, x[15], 0xd8a1e681, 14)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, b, c, d, a, x[4], 0xe7d3fbc8, 20)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, a, b, c, d, x[9], 0x21e1cde6, 5)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, d, a, b, c, x[14], 0xc33707d6, 9)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, c, d, a, b, x[3], 0xf4d50d87, 14)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, b, c, d, a, x[8], 0x455a14ed, 20)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, a, b, c, d, x[13], 0xa9e3e905, 5)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, d, a, b, c, x[2], 0xfcefa3f8, 9)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, c, d, a, b, x[7], 0x676f02d9, 14)
+  SWIFT_MD5_STEP(SWIFT_MD5_G, b, c, d, a, x[12], 0x8d2a4c8a, 20)
+
+  SWIFT_MD5_STEP(SWIFT_MD5_H, a, b, c, d, x[5], 0xfffa3942, 4)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, d, a, b, c, x[8], 0x8771f681, 11)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, c, d, a, b, x[11], 0x6d9d6122, 16)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, b, c, d, a, x[14], 0xfde5380c, 23)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, a, b, c, d, x[1], 0xa4beea44, 4)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, d, a, b, c, x[4], 0x4bdecfa9, 11)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, c, d, a, b, x[7], 0xf6bb4b60, 16)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, b, c, d, a, x[10], 0xbebfbc70, 23)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, a, b, c, d, x[13], 0x289b7ec6, 4)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, d, a, b, c, x[0], 0xeaa127fa, 11)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, c, d, a, b, x[3], 0xd4ef3085, 16)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, b, c, d, a, x[6], 0x04881d05, 23)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, a, b, c, d, x[9], 0xd9d4d039, 4)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, d, a, b, c, x[12], 0xe6db99e5, 11)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, c, d, a, b, x[15], 0x1fa27cf8, 16)
+  SWIFT_MD5_STEP(SWIFT_MD5_H, b, c, d, a, x[2], 0xc4ac5665, 23)
+
+  SWIFT_MD5_STEP(SWIFT_MD5_I, a, b, c, d, x[0], 0xf4292244, 6)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, d, a, b, c, x[7], 0x432aff97, 10)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, c, d, a, b, x[14], 0xab9423a7, 15)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, b, c, d, a, x[5], 0xfc93a039, 21)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, a, b, c, d, x[12], 0x655b59c3, 6)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, d, a, b, c, x[3], 0x8f0ccc92, 10)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, c, d, a, b, x[10], 0xffeff47d, 15)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, b, c, d, a, x[1], 0x85845dd1, 21)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, a, b, c, d, x[8], 0x6fa87e4f, 6)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, d, a, b, c, x[15], 0xfe2ce6e0, 10)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, c, d, a, b, x[6], 0xa3014314, 15)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, b, c, d, a, x[13], 0x4e0811a1, 21)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, a, b, c, d, x[4], 0xf7537e82, 6)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, d, a, b, c, x[11], 0xbd3af235, 10)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, c, d, a, b, x[2], 0x2ad7d2bb, 15)
+  SWIFT_MD5_STEP(SWIFT_MD5_I, b, c, d, a, x[9], 0xeb86d391, 21)
+
+  md5->state[0] = (md5->state[0] + a) & 0xffffffff;
+  md5->state[1] = (md5->state[1] + b) & 0xffffffff;
+  md5->state[2] = (md5->state[2] + c) & 0xffffffff;
+  md5->state[3] = (md5->state[3] + d) & 0xffffffff;
+}
+
+STATIC void
+swift_md5_update(struct swift_md5 *md5, const void *data, size_t len) {
+
+  const unsigned char *p = (const unsigned char *)data;
+  size_t used = md5->count % 64;
+  size_t fill;
+
+  md5->count += len;
+
+  if (used) {
+    fill = 64 - used;
+    if (len < fill) {
+      memcpy(md5->buffer + used, p, len);
+      return;
+    }
+    memcpy(md5->buffer + used, p, fill);
+    swift_md5_block(md5, md5->buffer);
+    p += fill;
+    len -= fill;
+  }
+
+  /* Whole blocks straight from the caller's data, no copy */
+  while (len >= 64) {
+    swift_md5_block(md5, p);
+    p += 64;
+    len -= 64;
+  }
+
+  memcpy(md5->buffer, p, len);
+}
+
+/* Finishes the digest into 33 bytes of lower case hex */
+STATIC void
+swift_md5_final(struct swift_md5 *md5, char *hex) {
+
+  unsigned char pad[72];
+  unsigned long long bits = md5->count * 8;
+  size_t padlen;
+  int i;
+
+  padlen = (md5->count % 64 < 56) ? 56 - md5->count % 64 :
+    120 - md5->count % 64;
+  memset(pad, 0, sizeof(pad));
+  pad[0] = 0x80;
+  for (i = 0; i < 8; ++i) {
+    pad[padlen + i] = (unsigned char)(bits >> (i * 8));
+  }
+  swift_md5_update(md5, pad, padlen + 8);
+
+  for (i = 0; i < 16; ++i) {
+    sprintf(hex + i * 2, "%02x",
+        (md5->state[i / 4] >> ((i % 4) * 8)) & 0xff);
+  }
+}
+
+STATIC swift_error
+swift_md5_verify(struct swift_md5 *md5, const char *etag) {
+
+  char hex[33];
+
+  if (md5->skip || !etag[0]) {
+    return SWIFT_SUCCESS;
+  }
+
+  swift_md5_final(md5, hex);
+  if (strcasecmp(hex, etag) != 0) {
+    return SWIFT_ERROR_CHECKSUM;
+  }
+
+  return SWIFT_SUCCESS;
+}
+
 STATIC swift_error
 swift_response(int response) {
   swift_error s_err;
@@ -66,8 +290,12 @@ swift_response(int response) {
     case 200:
     case 201: /*Fallthrough */
     case 204: /*Fallthrough */
+    case 206: /*Fallthrough */
       s_err = SWIFT_SUCCESS;
       break;
+    case 304:
+      s_err = SWIFT_ERROR_NOT_MODIFIED;
+      break;
     default:
       s_err = SWIFT_ERROR_UNKNOWN;
       break;
@@ -121,7 +349,7 @@ swift_string_to_list(char *string, int n_entries, char ***_list) {
 STATIC size_t
 swift_header_callback(void *ptr, size_t size, size_t nmemb, void *user) {
 
-  struct swift_context *context = (struct swift_context *)user;
+  struct swift_request *request = (struct swift_request *)user;
   char *temp = NULL;
 
   /*In order to make the string handling easier, lets copy over the string and
@@ -134,35 +362,77 @@ swift_header_callback(void *ptr, size_t size, size_t nmemb, void *user) {
   temp[size * nmemb] = '\0';
   swift_chomp(temp);
 
-  switch (context->state) {  
+  if (strncmp("HTTP/", temp, 5) == 0) {
+    /* Of a hedged read and its copy the first to answer is kept, the other
+     * gives up here */
+    if (request->hedge && request->hedge->first_byte) {
+      free(temp);
+      return 0;
+    }
+    if (!request->first_byte) {
+      request->first_byte = swift_now_ms();
+    }
+    sscanf(temp, "HTTP/%*s %ld", &request->response);
+  }
+
+  switch (request->state) {  
     case SWIFT_STATE_AUTH:
 
-      if (strncmp("X-Auth-Token: ", temp,14) == 0) {
-        if (context->authtoken) {
-          free(context->authtoken);
+      if (strncasecmp("X-Auth-Token: ", temp,14) == 0) {
+        if (request->authtoken) {
+          free(request->authtoken);
         }
-        context->authtoken = (char *)malloc(size * nmemb + 1);
-        strcpy(context->authtoken, temp);
-        context->valid_auth = 1;
-      } else if (strncmp("X-Storage-Url: ", temp, 15) == 0) {
-        if (context->authurl) {
-          free(context->authurl);
+        request->authtoken = (char *)malloc(size * nmemb + 1);
+        strcpy(request->authtoken, temp);
+      } else if (strncasecmp("X-Storage-Url: ", temp, 15) == 0) {
+        if (request->authurl) {
+          free(request->authurl);
         }
-        context->authurl = (char *)malloc(size * nmemb );
-        strcpy(context->authurl, temp + 15);
+        request->authurl = (char *)malloc(size * nmemb );
+        strcpy(request->authurl, temp + 15);
+      } else if (strncasecmp("X-Auth-Token-Expires: ", temp, 22) == 0) {
+        sscanf(temp + 22, "%lu", &request->token_expires);
       }
       break;
     case SWIFT_STATE_CONTAINERLIST:
     case SWIFT_STATE_OBJECTLIST: /*Fallthrough */
     case SWIFT_STATE_OBJECT_EXISTS: /*Fallthrough */
-      if (strncmp("X-Account-Container-Count: ", temp, 26) == 0) {
-        sscanf(temp, "X-Account-Container-Count: %d", &context->num_containers);
+      /* HTTP/2 sends header names in lower case */
+      if (strncasecmp("X-Account-Container-Count:", temp, 26) == 0) {
+        sscanf(temp + 26, "%d", &request->num_containers);
+      }
+      if (strncasecmp("X-Container-Object-Count:", temp, 25) == 0) {
+        sscanf(temp + 25, "%d", &request->num_objects);
+      }
+      if (strncasecmp("Content-Length: ", temp, 16) == 0) {
+        sscanf(temp + 16, "%ld", &request->obj_length);
       }
-      if (strncmp("X-Container-Object-Count: ", temp, 24) == 0) {
-        sscanf(temp, "X-Container-Object-Count: %d", &context->num_objects);
+      /*Fallthrough */
+    case SWIFT_STATE_OBJECT_READ:
+    case SWIFT_STATE_OBJECT_READ_FD: /*Fallthrough */
+    case SWIFT_STATE_OBJECT_WRITE: /*Fallthrough */
+    case SWIFT_STATE_OBJECT_WRITE_FD: /*Fallthrough */
+      if (strncasecmp("ETag: ", temp, 6) == 0) {
+        if (swift_copy_etag(request->etag, temp + 6)) {
+          request->md5.skip = 1;
+        }
+      }
+      if (strncasecmp("Last-Modified: ", temp, 15) == 0) {
+        strncpy(request->last_modified, temp + 15, 63);
+        request->last_modified[63] = '\0';
+      }
+      if (strncasecmp("X-Object-Meta-Compression: deflate", temp, 34) == 0) {
+        request->compressed = 1;
+        /* The body that follows has to be inflated on the way in */
+        if ((request->state == SWIFT_STATE_OBJECT_READ ||
+              request->state == SWIFT_STATE_OBJECT_READ_FD) &&
+            swift_compress_begin(request, SWIFT_COMPRESS_INFLATE)) {
+          free(temp);
+          return 0;
+        }
       }
-      if (strncmp("Content-Length: ", temp, 16) == 0) {
-        sscanf(temp, "Content-Length: %ld", &context->obj_length);
+      if (strncasecmp("X-Object-Meta-Uncompressed-Length: ", temp, 35) == 0) {
+        sscanf(temp + 35, "%lu", &request->uncompressed_length);
       }
       break;
     default:
@@ -176,38 +446,95 @@ swift_header_callback(void *ptr, size_t size, size_t nmemb, void *user) {
 STATIC size_t
 swift_body_callback(void *ptr, size_t size, size_t nmemb, void *user) {
 
-  struct swift_context *context = (struct swift_context *)user;
+  struct swift_request *request = (struct swift_request *)user;
   size_t real_size = size * nmemb;
+  size_t written;
+  ssize_t n_written;
+  char *grown;
+
+  /* Error bodies never reach the caller's buffer, the request may yet be
+   * sent again */
+  if (request->response >= 300) {
+    return real_size;
+  }
 
-  if (context->buffer_pos + real_size > context->obj_length) {
-    real_size = context->obj_length - context->buffer_pos;
+  /* Chunked listings come without a length to size the buffer from, it
+   * grows with each piece instead */
+  if ((request->state == SWIFT_STATE_CONTAINERLIST ||
+        request->state == SWIFT_STATE_OBJECTLIST) && !request->obj_length) {
+    grown = (char *)realloc(request->buffer,
+        request->buffer_pos + real_size + 1);
+    if (!grown) {
+      return 0;
+    }
+    request->buffer = grown;
+    memcpy(request->buffer + request->buffer_pos, ptr, real_size);
+    request->buffer_pos += real_size;
+    request->buffer[request->buffer_pos] = '\0';
+    return real_size;
+  }
+
+  /* Stored compressed, the bounds below apply to the inflated data */
+  if (request->compressed && (request->state == SWIFT_STATE_OBJECT_READ ||
+        request->state == SWIFT_STATE_OBJECT_READ_FD)) {
+    if (request->checksum) {
+      swift_md5_update(&request->md5, ptr, real_size);
+    }
+    return swift_inflate_sink(request, ptr, real_size);
+  }
+
+  if (request->buffer_pos + real_size > request->obj_length) {
+    real_size = request->obj_length - request->buffer_pos;
+    /* The rest of the body is never seen */
+    request->md5.skip = 1;
   }
   if (real_size == 0) {
     return 0;
   }
 
-  switch (context->state) {
+  if (request->checksum && (request->state == SWIFT_STATE_OBJECT_READ ||
+        request->state == SWIFT_STATE_OBJECT_READ_FD)) {
+    swift_md5_update(&request->md5, ptr, real_size);
+  }
+
+  switch (request->state) {
     case SWIFT_STATE_CONTAINERLIST:
     case SWIFT_STATE_OBJECTLIST: /*Fallthrough */
-      if (!context->buffer) {
-        context->buffer = (char *)malloc(context->obj_length + 1);
-        if (!context->buffer) {
+      if (!request->buffer) {
+        request->buffer = (char *)malloc(request->obj_length + 1);
+        if (!request->buffer) {
           return 0;
         }
-        context->buffer_pos = 0;
-        context->buffer[context->obj_length] = '\0';
+        request->buffer_pos = 0;
+        request->buffer[request->obj_length] = '\0';
       }
-      memcpy(context->buffer + context->buffer_pos, ptr, real_size);
-      context->buffer_pos += real_size;
+      memcpy(request->buffer + request->buffer_pos, ptr, real_size);
+      request->buffer_pos += real_size;
 
       break;
     case SWIFT_STATE_OBJECT_READ:
-      if (!context->buffer) {
+      if (!request->buffer) {
         return 0;
       }
 
-      memcpy(context->buffer + context->buffer_pos, ptr, real_size);
-      context->buffer_pos += real_size;
+      memcpy(request->buffer + request->buffer_pos, ptr, real_size);
+      request->buffer_pos += real_size;
+      break;
+    case SWIFT_STATE_OBJECT_READ_FD:
+      written = 0;
+      while (written < real_size) {
+        n_written = write(request->fd, (char *)ptr + written,
+            real_size - written);
+        if (n_written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          return 0;
+        }
+        written += n_written;
+      }
+      request->buffer_pos += real_size;
+      break;
     default:
       break;
 
@@ -219,876 +546,5793 @@ swift_body_callback(void *ptr, size_t size, size_t nmemb, void *user) {
 STATIC size_t
 swift_upload_callback(void *ptr, size_t size, size_t nmemb, void *user) {
 
-  struct swift_context *context = (struct swift_context *)user;
-  int newbytes;
+  struct swift_request *request = (struct swift_request *)user;
+  size_t newbytes;
+  ssize_t n_read;
+
+  if (request->zstream.mode == SWIFT_COMPRESS_DEFLATE &&
+      (request->state == SWIFT_STATE_OBJECT_WRITE ||
+       request->state == SWIFT_STATE_OBJECT_WRITE_FD)) {
+    return swift_deflate_source(request, ptr, size * nmemb);
+  }
 
-  if (context->state != SWIFT_STATE_OBJECT_WRITE) {
+  if (request->state == SWIFT_STATE_OBJECT_WRITE_FD) {
+    do {
+      n_read = read(request->fd, ptr, size * nmemb);
+    } while (n_read < 0 && errno == EINTR);
+
+    if (n_read < 0) {
+      return CURL_READFUNC_ABORT;
+    }
+    if (request->checksum) {
+      swift_md5_update(&request->md5, ptr, n_read);
+    }
+    request->buffer_pos += n_read;
+    return n_read;
+  }
+
+  if (request->state != SWIFT_STATE_OBJECT_WRITE) {
     return CURL_READFUNC_ABORT;
   }
 
-  newbytes = (context->obj_length - context->buffer_pos) < size * nmemb ?
-    (context->obj_length - context->buffer_pos) :
+  newbytes = (request->obj_length - request->buffer_pos) < size * nmemb ?
+    (request->obj_length - request->buffer_pos) :
     size * nmemb;
 
-  memcpy(ptr, context->buffer + context->buffer_pos, newbytes);
-  context->buffer_pos += newbytes;
+  memcpy(ptr, request->buffer + request->buffer_pos, newbytes);
+  if (request->checksum) {
+    swift_md5_update(&request->md5, ptr, newbytes);
+  }
+  request->buffer_pos += newbytes;
 
   return newbytes;
 }
 
   
  
-STATIC int
-swift_perform(struct swift_context *context)  {
-
-  long response;
-  struct curl_slist *headers = NULL;
-
-  headers = swift_set_headers(context->curlhandle, 1, context->authtoken);
-  curl_easy_setopt(context->curlhandle, CURLOPT_HEADERFUNCTION, swift_header_callback);
-  curl_easy_setopt(context->curlhandle, CURLOPT_WRITEHEADER, context);
-  curl_easy_setopt(context->curlhandle, CURLOPT_WRITEFUNCTION, swift_body_callback);
-  curl_easy_setopt(context->curlhandle, CURLOPT_WRITEDATA, context);
-  curl_easy_perform(context->curlhandle);
-  curl_slist_free_all(headers);
-
-  curl_easy_getinfo(context->curlhandle, CURLINFO_RESPONSE_CODE, &response);
-  return response;
-}                                   
+/* Check an easy handle out of the context's pool, creating one if it is
+ * empty.  Pooled handles keep their open connections and TLS sessions */
+STATIC CURL *
+swift_handle_get(struct swift_context *context) {
 
-STATIC swift_error
-swift_authenticate(struct swift_context *context) {
-  
+  CURL *handle = NULL;
 
-  struct curl_slist *headerlist = NULL;
-  long response;
-  const char *usertag = "X-Storage-User: ";
-  const char *passtag = "X-Storage-Pass: ";
-  char *username = NULL;
-  char *password = NULL;
+  pthread_mutex_lock(&context->lock);
+  if (context->pool_count) {
+    handle = context->pool[--context->pool_count];
+  }
+  pthread_mutex_unlock(&context->lock);
 
-  if (!context || !context->username || !context->password) {
-    return SWIFT_ERROR_NOTFOUND;
+  /* Options are dropped, connections are not */
+  if (handle) {
+    curl_easy_reset(handle);
+  } else {
+    handle = curl_easy_init();
   }
 
-  username = (char *)malloc(strlen(context->username) + 
-      strlen(usertag) + 1);
-  password = (char *)malloc(strlen(context->password) + 
-      strlen(passtag) + 1);
+  if (handle) {
+    swift_handle_configure(context, handle);
+  }
 
-  context->valid_auth = 0;
-  context->state = SWIFT_STATE_AUTH;
-  curl_easy_reset(context->curlhandle);
+  return handle;
+}
 
-  sprintf(username, "%s%s", usertag, context->username);
-  sprintf(password, "%s%s", passtag, context->password);
+/* Options every handle of the context starts out with */
+STATIC void
+swift_handle_configure(struct swift_context *context, CURL *handle) {
 
-  headerlist = swift_set_headers(context->curlhandle, 2, username, password);
+  if (context->share) {
+    curl_easy_setopt(handle, CURLOPT_SHARE, context->share->curlshare);
+  }
 
-  curl_easy_setopt(context->curlhandle, CURLOPT_URL, context->connecturl);
-  curl_easy_setopt(context->curlhandle, CURLOPT_HEADERFUNCTION, swift_header_callback);
-  curl_easy_setopt(context->curlhandle, CURLOPT_WRITEHEADER, context);
-  curl_easy_setopt(context->curlhandle, CURLOPT_WRITEFUNCTION, swift_body_callback);
-  curl_easy_setopt(context->curlhandle, CURLOPT_WRITEDATA, context);
+  switch (context->http2) {
+    case SWIFT_HTTP1:
+      curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+      break;
+    case SWIFT_HTTP2:
+      curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+      break;
+    case SWIFT_HTTP2_PRIOR_KNOWLEDGE:
+      curl_easy_setopt(handle, CURLOPT_HTTP_VERSION,
+          CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+      break;
+    default:
+      break;
+  }
+}
 
-  curl_easy_perform(context->curlhandle);
-  curl_slist_free_all(headerlist);
+STATIC void
+swift_handle_put(struct swift_context *context, CURL *handle) {
 
-  curl_easy_getinfo(context->curlhandle, CURLINFO_RESPONSE_CODE, &response);
+  if (!handle) {
+    return;
+  }
 
-  free(username);
-  free(password);
+  pthread_mutex_lock(&context->lock);
+  if (context->pool_count < SWIFT_HANDLE_POOL) {
+    context->pool[context->pool_count++] = handle;
+    handle = NULL;
+  }
+  pthread_mutex_unlock(&context->lock);
 
-  return swift_response(response);
+  if (handle) {
+    curl_easy_cleanup(handle);
+  }
 }
 
+STATIC swift_error
+swift_request_init(struct swift_request *request,
+    struct swift_context *context) {
+
+  memset(request, 0, sizeof(struct swift_request));
+  request->context = context;
+  request->checksum = context->checksum;
+  request->deadline_at = swift_deadline_at(context, 0);
+  if (context->compress) {
+    request->compress_level = context->compress->level;
+  }
 
-swift_error
-swift_init() {
-  
-  if (curl_global_init(CURL_GLOBAL_ALL)) {
-    return SWIFT_ERROR_INTERNAL;
+  request->curlhandle = swift_handle_get(context);
+  if (!request->curlhandle) {
+    return SWIFT_ERROR_MEMORY;
   }
 
   return SWIFT_SUCCESS;
 }
 
-
-swift_error
-swift_deinit() {
-  curl_global_cleanup();
-  return SWIFT_SUCCESS;
+STATIC void
+swift_request_free(struct swift_request *request) {
+
+  swift_compress_begin(request, SWIFT_COMPRESS_NONE);
+  free(request->zstream.staging);
+  request->zstream.staging = NULL;
+  free(request->authtoken);
+  request->authtoken = NULL;
+  free(request->authurl);
+  request->authurl = NULL;
+
+  swift_handle_put(request->context, request->curlhandle);
+  request->curlhandle = NULL;
 }
 
-swift_error
-swift_context_create(struct swift_context ** context,
-                     const char *connecturl,
-                     const char *username,
-                     const char *password) {
+/* Get a request ready to be sent again.  Returns 0 when the data already
+ * sent can not be had again */
+STATIC int
+swift_request_rewind(struct swift_request *request) {
 
-  *context = (struct swift_context *)malloc(sizeof(struct swift_context));
-  if (!*context) {
-    return SWIFT_ERROR_MEMORY;
+  if (request->state == SWIFT_STATE_AUTH) {
+    return 0;
+  }
+  /* Descriptors are read once, and what went to one stays written */
+  if ((request->state == SWIFT_STATE_OBJECT_WRITE_FD ||
+        request->state == SWIFT_STATE_OBJECT_READ_FD) && request->buffer_pos) {
+    return 0;
   }
 
-  memset(*context, 0, sizeof(struct swift_context));
+  request->buffer_pos = 0;
+  request->response = 0;
+  request->compressed = 0;
+  request->etag[0] = '\0';
+  swift_md5_init(&request->md5);
 
-  /*Start with initializing curl*/
-  (*context)->curlhandle = curl_easy_init();
-  if (!(*context)->curlhandle) {
-    return SWIFT_ERROR_INTERNAL;
+  if (request->zstream.mode == SWIFT_COMPRESS_DEFLATE) {
+    return !swift_compress_begin(request, SWIFT_COMPRESS_DEFLATE);
   }
-  
-  /* Allocate memory for strings */
-  (*context)->username = (char *)malloc(strlen(username) + 1);
-  (*context)->password = (char *)malloc(strlen(password) + 1);
-  (*context)->connecturl = (char *)malloc(strlen(connecturl) + 1);
+  swift_compress_begin(request, SWIFT_COMPRESS_NONE);
+  return 1;
+}
 
-  if ( !(*context)->username ||
-       !(*context)->password ||
-       !(*context)->connecturl ) {
-    swift_context_delete(context);
-    return SWIFT_ERROR_MEMORY;
-  }
+STATIC unsigned long long
+swift_now_ms(void) {
 
-  strcpy((*context)->username, username);
-  strcpy((*context)->password, password);
-  strcpy((*context)->connecturl, connecturl);
+  struct timespec now;
 
-  return SWIFT_SUCCESS;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
 }
 
-swift_error
-swift_context_delete(struct swift_context **context) {
-
-  /* Check each allocated object in it and free it*/
-  if ((*context)->username) {
-    free((*context)->username);
-  }
-
-  if ((*context)->password) {
-    free((*context)->password);
+/* Whether curl gave up on the connection rather than the request */
+STATIC int
+swift_transport_failure(CURLcode result) {
+
+  switch (result) {
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT: /*Fallthrough */
+    case CURLE_PARTIAL_FILE: /*Fallthrough */
+    case CURLE_OPERATION_TIMEDOUT: /*Fallthrough */
+    case CURLE_SSL_CONNECT_ERROR: /*Fallthrough */
+    case CURLE_GOT_NOTHING: /*Fallthrough */
+    case CURLE_SEND_ERROR: /*Fallthrough */
+    case CURLE_RECV_ERROR: /*Fallthrough */
+    case CURLE_HTTP2: /*Fallthrough */
+    case CURLE_HTTP2_STREAM: /*Fallthrough */
+      return 1;
+    default:
+      return 0;
   }
+}
 
-  if ((*context)->connecturl) {
-    free((*context)->connecturl);
-  }
+/* When a request given deadline milliseconds, or the context's deadline
+ * for 0, runs out if it starts now.  0 for never */
+STATIC unsigned long long
+swift_deadline_at(struct swift_context *context, unsigned long deadline) {
 
-  if ((*context)->authurl) {
-    free((*context)->authurl);
+  if (!deadline) {
+    deadline = context->deadline;
   }
 
-  if ((*context)->authtoken) {
-    free((*context)->authtoken);
-  }
+  return deadline ? swift_now_ms() + deadline : 0;
+}
 
-  if ((*context)->curlhandle) {
-    curl_easy_cleanup((*context)->curlhandle);
-  }
+/* Hand a handle the context's connect timeout and low speed floor and the
+ * time left until deadline_at.  Fails with SWIFT_ERROR_TIMEOUT when there
+ * is none left */
+STATIC swift_error
+swift_set_timeouts(CURL *handle, struct swift_context *context,
+    unsigned long long deadline_at) {
 
-  free(*context);
+  unsigned long long now;
 
+  if (context->connect_timeout) {
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS,
+        (long)context->connect_timeout);
+  }
+  if (context->low_speed_limit) {
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT,
+        (long)context->low_speed_limit);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME,
+        (long)context->low_speed_time);
+  }
+  if (deadline_at) {
+    now = swift_now_ms();
+    if (now >= deadline_at) {
+      return SWIFT_ERROR_TIMEOUT;
+    }
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, (long)(deadline_at - now));
+  }
 
   return SWIFT_SUCCESS;
 }
 
-swift_error
-swift_can_connect(struct swift_context *context) {
+/* What a transfer curl gave up on comes to: SWIFT_ERROR_TIMEOUT once its
+ * deadline has passed, SWIFT_ERROR_STALLED when it timed out having sent
+ * its request, which only the low speed floor does, and
+ * SWIFT_ERROR_CONNECT for anything else */
+STATIC swift_error
+swift_failure(CURL *handle, CURLcode result, unsigned long long deadline_at) {
+
+  long sent = 0;
 
-  return swift_authenticate(context);
+  if (result != CURLE_OPERATION_TIMEDOUT) {
+    return SWIFT_ERROR_CONNECT;
+  }
+  if (deadline_at && swift_now_ms() >= deadline_at) {
+    return SWIFT_ERROR_TIMEOUT;
+  }
 
+  curl_easy_getinfo(handle, CURLINFO_REQUEST_SIZE, &sent);
+  return sent ? SWIFT_ERROR_STALLED : SWIFT_ERROR_CONNECT;
 }
 
+/* What a request swift_perform() is done with comes to */
 STATIC swift_error
-swift_node_list_setup(struct swift_context *context, const char *path) {
+swift_request_error(struct swift_request *request, long response) {
 
-  char *url;
+  if (request->failure) {
+    return request->failure;
+  }
 
-  if (!context || !path) {
-    return SWIFT_ERROR_NOTFOUND;
+  return swift_response(response);
+}
+
+/* Milliseconds to wait before sending a request that ended with result and
+ * response again, having been retried retries times already, or -1 when
+ * the context's policy has it fail */
+STATIC long
+swift_retry_delay(struct swift_context *context, CURLcode result,
+    long response, unsigned int retries) {
+
+  unsigned long delay;
+  unsigned long jitter;
+  int failure = 0;
+
+  if (retries + 1 >= context->retry_attempts) {
+    return -1;
   }
 
-  if (strncmp("/", path, 1) != 0) {
-    return SWIFT_ERROR_NOTFOUND;
+  if (swift_transport_failure(result)) {
+    failure = SWIFT_RETRY_TRANSPORT;
+  } else if (result == CURLE_OK && response >= 500 && response < 600) {
+    failure = SWIFT_RETRY_5XX;
+  } else if (result == CURLE_OK && response == 429) {
+    failure = SWIFT_RETRY_429;
   }
 
-  url = (char *)malloc(strlen(path) + strlen(context->authurl) + 1);
-  if (!url) {
-    return SWIFT_ERROR_MEMORY;
+  if (!(failure & context->retry_on)) {
+    return -1;
   }
-  sprintf(url, "%s%s", context->authurl, path);
-  
-  /* Determine if this is an account listing, or container listing */
-  if (strcmp("/", path) == 0) {
-    context->state = SWIFT_STATE_CONTAINERLIST;
-  } else {
-    context->state = SWIFT_STATE_OBJECTLIST;
+
+  delay = context->retry_backoff;
+  while (retries-- && delay < context->retry_backoff_max) {
+    delay *= 2;
+  }
+  if (delay > context->retry_backoff_max) {
+    delay = context->retry_backoff_max;
   }
-  curl_easy_reset(context->curlhandle);
-  curl_easy_setopt(context->curlhandle, CURLOPT_URL, url);
 
-  free(url);
+  pthread_mutex_lock(&context->lock);
+  jitter = nrand48(context->retry_seed);
+  pthread_mutex_unlock(&context->lock);
 
-  return SWIFT_SUCCESS;
+  return delay / 2 + jitter % (delay / 2 + 1);
 }
 
+STATIC void
+swift_retry_count(struct swift_context *context) {
 
-swift_error
-swift_node_list(struct swift_context *context, const char *path,
-    int *n_entries, char ***contents) {
+  pthread_mutex_lock(&context->lock);
+  ++context->retries;
+  pthread_mutex_unlock(&context->lock);
+}
 
-  swift_error s_err;
-  unsigned long response;
+STATIC int
+swift_ulong_compare(const void *a, const void *b) {
 
-  if (!(context->valid_auth)) {
-    if ( (s_err = swift_authenticate(context)) ) {
-      return s_err;
-    }
-  }
+  unsigned long x = *(const unsigned long *)a;
+  unsigned long y = *(const unsigned long *)b;
 
+  return (x > y) - (x < y);
+}
 
-  if ( (s_err = swift_node_list_setup(context, path))  ) {
-    return s_err;
-  }
+/* The percentile-th percentile of n samples, sorting them on the way */
+STATIC unsigned long
+swift_hedge_percentile(unsigned long *samples, unsigned int n,
+    unsigned int percentile) {
 
-  response = swift_perform(context);
+  qsort(samples, n, sizeof(unsigned long), swift_ulong_compare);
+  return samples[(n - 1) * percentile / 100];
+}
 
-  if (context->state == SWIFT_STATE_OBJECTLIST) {
-    swift_string_to_list(context->buffer, context->num_objects, contents);
-    *n_entries = context->num_objects;
-  } else {
-    swift_string_to_list(context->buffer, context->num_containers, contents);
-    *n_entries = context->num_containers;
-  }
+/* Count a read that may be hedged, once however often it is sent.  Returns
+ * the milliseconds it waits on its first byte before it is, -1 while the
+ * context has too few samples */
+STATIC long
+swift_hedge_begin(struct swift_context *context) {
+
+  long delay;
 
- return swift_response(response);
+  pthread_mutex_lock(&context->lock);
+  ++context->hedge_reads;
+  delay = context->hedge_delay;
+  pthread_mutex_unlock(&context->lock);
+
+  return delay;
 }
 
-swift_error
-swift_node_list_free(char ***contents) {
+/* Whether one more hedge stays within the budget */
+STATIC int
+swift_hedge_allow(struct swift_context *context) {
 
-  if (!contents)
-    return SWIFT_SUCCESS;
+  int allow;
 
-  if (!*contents) 
+  pthread_mutex_lock(&context->lock);
+  allow = (context->hedges + 1) * 100 <=
+    (unsigned long)context->hedge_budget * context->hedge_reads;
+  pthread_mutex_unlock(&context->lock);
+
+  return allow;
+}
+
+/* Count a hedge once it is actually on its way */
+STATIC void
+swift_hedge_launched(struct swift_context *context) {
+
+  pthread_mutex_lock(&context->lock);
+  ++context->hedges;
+  pthread_mutex_unlock(&context->lock);
+}
+
+/* Note how many milliseconds a read waited on its first byte and whether
+ * its hedge was the one to answer.  The delay is worked out again every
+ * SWIFT_HEDGE_SAMPLES / 8 reads, outside the lock */
+STATIC void
+swift_hedge_sample(struct swift_context *context, unsigned long ms, int won) {
+
+  unsigned long samples[SWIFT_HEDGE_SAMPLES];
+  unsigned long delay;
+  unsigned int n;
+
+  pthread_mutex_lock(&context->lock);
+  context->hedge_samples[context->hedge_n_samples++ % SWIFT_HEDGE_SAMPLES] = ms;
+  if (won) {
+    ++context->hedge_wins;
+  }
+  if (context->hedge_n_samples % (SWIFT_HEDGE_SAMPLES / 8)) {
+    pthread_mutex_unlock(&context->lock);
+    return;
+  }
+  n = (context->hedge_n_samples < SWIFT_HEDGE_SAMPLES) ?
+    context->hedge_n_samples : SWIFT_HEDGE_SAMPLES;
+  memcpy(samples, context->hedge_samples, n * sizeof(unsigned long));
+  pthread_mutex_unlock(&context->lock);
+
+  /* Answers inside a millisecond still get a millisecond */
+  delay = swift_hedge_percentile(samples, n, context->hedge_percentile);
+  if (!delay) {
+    delay = 1;
+  }
+
+  pthread_mutex_lock(&context->lock);
+  context->hedge_delay = (long)delay;
+  pthread_mutex_unlock(&context->lock);
+}
+
+/* Run a read, and once the context knows how long reads take, send a copy
+ * of it should its first byte not be back after delay milliseconds.  Both
+ * go through a multi, the first to answer ends up in request and the other
+ * is cancelled.  Returns the result of the one kept */
+STATIC CURLcode
+swift_hedge_perform(struct swift_request *request, long delay) {
+
+  struct swift_context *context = request->context;
+  struct swift_request copy;
+  struct swift_request tmp;
+  struct swift_request *finished;
+  struct swift_request *winner = NULL;
+  struct curl_slist *headers = NULL;
+  struct CURLMsg *curl_msg;
+  CURLM *multi = NULL;
+  CURLcode result = CURLE_OK;
+  unsigned long long sent;
+  unsigned long long now;
+  int n_running;
+  int n_msgs;
+  int running = 1;
+  int copy_running = 0;
+  int hedged = 0;
+  long timeout;
+
+  request->first_byte = 0;
+  request->hedge = NULL;
+  sent = swift_now_ms();
+
+  if (delay >= 0) {
+    multi = swift_multi_get(context);
+  }
+  if (!multi) {
+    result = curl_easy_perform(request->curlhandle);
+    winner = request;
+  } else {
+    curl_multi_add_handle(multi, request->curlhandle);
+  }
+
+  while (!winner) {
+    curl_multi_perform(multi, &n_running);
+    while (!winner &&
+        (curl_msg = curl_multi_info_read(multi, &n_msgs)) != NULL) {
+      if (curl_msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      if (curl_msg->easy_handle == request->curlhandle) {
+        finished = request;
+        running = 0;
+      } else {
+        finished = &copy;
+        copy_running = 0;
+      }
+      curl_multi_remove_handle(multi, curl_msg->easy_handle);
+
+      /* Failing without an answer leaves the race to the other */
+      if (!finished->first_byte && (running || copy_running)) {
+        continue;
+      }
+      winner = finished;
+      result = curl_msg->data.result;
+    }
+    if (winner) {
+      break;
+    }
+
+    /* One has answered, the other can go */
+    if (running && copy_running && (request->first_byte || copy.first_byte)) {
+      if (request->first_byte) {
+        curl_multi_remove_handle(multi, copy.curlhandle);
+        copy_running = 0;
+      } else {
+        curl_multi_remove_handle(multi, request->curlhandle);
+        running = 0;
+      }
+    }
+
+    timeout = 1000;
+    if (!hedged && running && !request->first_byte) {
+      now = swift_now_ms();
+      if (now < sent + delay) {
+        timeout = (long)(sent + delay - now);
+      } else {
+        hedged = 1;
+        if (swift_hedge_allow(context)) {
+          copy = *request;
+          memset(&copy.zstream, 0, sizeof(copy.zstream));
+          copy.authtoken = NULL;
+          copy.authurl = NULL;
+          copy.curlhandle = curl_easy_duphandle(request->curlhandle);
+          if (copy.curlhandle) {
+            copy.hedge = request;
+            request->hedge = &copy;
+            headers = swift_request_headers(&copy);
+            curl_multi_add_handle(multi, copy.curlhandle);
+            copy_running = 1;
+            swift_hedge_launched(context);
+          }
+        }
+      }
+    }
+
+    curl_multi_wait(multi, NULL, 0, timeout, NULL);
+  }
+
+  if (multi) {
+    if (running) {
+      curl_multi_remove_handle(multi, request->curlhandle);
+    }
+    if (copy_running) {
+      curl_multi_remove_handle(multi, copy.curlhandle);
+    }
+    swift_multi_put(context, multi);
+  }
+
+  if (request->hedge) {
+    /* The copy answered first, keep it and let the original go */
+    if (winner == &copy) {
+      tmp = *request;
+      *request = copy;
+      copy = tmp;
+    }
+    request->hedge = NULL;
+    copy.hedge = NULL;
+    swift_request_free(&copy);
+    curl_slist_free_all(headers);
+  }
+
+  if (request->first_byte && request->response < 400) {
+    swift_hedge_sample(context, (unsigned long)(request->first_byte - sent),
+        winner != request);
+  }
+
+  return result;
+}
+
+/* URL of an object, or of a container when object is NULL, built from the
+ * storage URL as it is right now */
+STATIC char *
+swift_object_url(struct swift_context *context, const char *container,
+    const char *object) {
+
+  char *url;
+
+  pthread_rwlock_rdlock(&context->auth_lock);
+  url = (char *)malloc(strlen(context->authurl) + strlen(container) +
+      (object ? strlen(object) : 0) + 3);
+  if (url) {
+    if (object) {
+      sprintf(url, "%s/%s/%s", context->authurl, container, object);
+    } else {
+      sprintf(url, "%s/%s", context->authurl, container);
+    }
+  }
+  pthread_rwlock_unlock(&context->auth_lock);
+
+  return url;
+}
+
+/* Point the handle at the request's callbacks and hand it the token, and
+ * any validators or compression tags, as headers.  The list belongs to the
+ * caller once the request is done */
+STATIC struct curl_slist *
+swift_request_headers(struct swift_request *request) {
+
+  struct curl_slist *headers;
+  char condition[96];
+  char length[64];
+  const char *extra[3] = {NULL, NULL, NULL};
+  int n_extra = 0;
+
+  /* At most one validator is set, see swift_set_validators() */
+  if (request->if_none_match[0]) {
+    sprintf(condition, "If-None-Match: %s", request->if_none_match);
+    extra[n_extra++] = condition;
+  } else if (request->if_modified_since[0]) {
+    sprintf(condition, "If-Modified-Since: %s", request->if_modified_since);
+    extra[n_extra++] = condition;
+  }
+
+  /* Tag compressed uploads so readers know to inflate them */
+  if (request->zstream.mode == SWIFT_COMPRESS_DEFLATE) {
+    extra[n_extra++] = "X-Object-Meta-Compression: deflate";
+    if (request->obj_length) {
+      sprintf(length, "X-Object-Meta-Uncompressed-Length: %lu",
+          (unsigned long)request->obj_length);
+      extra[n_extra++] = length;
+    }
+  }
+
+  curl_easy_setopt(request->curlhandle, CURLOPT_HEADERFUNCTION, swift_header_callback);
+  curl_easy_setopt(request->curlhandle, CURLOPT_WRITEHEADER, request);
+  curl_easy_setopt(request->curlhandle, CURLOPT_WRITEFUNCTION, swift_body_callback);
+  curl_easy_setopt(request->curlhandle, CURLOPT_WRITEDATA, request);
+
+  /* The header list holds its own copy of the token */
+  pthread_rwlock_rdlock(&request->context->auth_lock);
+  headers = swift_set_headers(request->curlhandle, 1 + n_extra,
+      request->context->authtoken, extra[0], extra[1], extra[2]);
+  request->auth_generation = request->context->auth_generation;
+  pthread_rwlock_unlock(&request->context->auth_lock);
+
+  return headers;
+}
+
+STATIC int
+swift_perform(struct swift_request *request)  {
+
+  long response;
+  long delay;
+  long hedge_delay = -1;
+  int replayed = 0;
+  int hedge;
+  unsigned int retries = 0;
+  struct curl_slist *headers = NULL;
+  struct timespec wait;
+  CURLcode result;
+
+  /* Object reads may race a copy of themselves against a slow server */
+  hedge = request->context->hedge_percentile &&
+    (request->state == SWIFT_STATE_OBJECT_READ ||
+     request->state == SWIFT_STATE_OBJECT_READ_FD ||
+     request->state == SWIFT_STATE_OBJECT_EXISTS);
+  /* Counted once, however often it goes out again */
+  if (hedge) {
+    hedge_delay = swift_hedge_begin(request->context);
+  }
+
+  request->failure = SWIFT_SUCCESS;
+
+  for (;;) {
+    /* Authentication and earlier attempts have had their share */
+    if ( (request->failure = swift_set_timeouts(request->curlhandle,
+            request->context, request->deadline_at)) ) {
+      response = 0;
+      break;
+    }
+
+    headers = swift_request_headers(request);
+    if (hedge) {
+      result = swift_hedge_perform(request, hedge_delay);
+    } else {
+      result = curl_easy_perform(request->curlhandle);
+    }
+    curl_slist_free_all(headers);
+
+    curl_easy_getinfo(request->curlhandle, CURLINFO_RESPONSE_CODE, &response);
+
+    /* The token expired or was revoked, get a new one and try once more */
+    if (response == 401) {
+      if (replayed || !swift_request_rewind(request) ||
+          swift_reauthenticate(request->context, request->auth_generation,
+            request->deadline_at)) {
+        break;
+      }
+      replayed = 1;
+      continue;
+    }
+
+    /* A proxy fell over or the cluster is shedding load, back off and go
+     * again */
+    delay = swift_retry_delay(request->context, result, response, retries);
+    if (delay >= 0 && request->deadline_at &&
+        swift_now_ms() + delay >= request->deadline_at) {
+      delay = -1;
+    }
+    if (delay < 0 || !swift_request_rewind(request)) {
+      /* Whatever the status said, the body never made it */
+      if (swift_transport_failure(result)) {
+        request->failure = swift_failure(request->curlhandle, result,
+            request->deadline_at);
+        response = 0;
+      }
+      break;
+    }
+    wait.tv_sec = delay / 1000;
+    wait.tv_nsec = (delay % 1000) * 1000000;
+    while (nanosleep(&wait, &wait) && errno == EINTR);
+    ++retries;
+    swift_retry_count(request->context);
+  }
+
+  return response;
+}                                   
+
+/* Get a token, within deadline_at when that is not 0 */
+STATIC swift_error
+swift_authenticate(struct swift_context *context,
+    unsigned long long deadline_at) {
+
+  struct curl_slist *headerlist = NULL;
+  struct swift_request request;
+  long response;
+  time_t expires = 0;
+  const char *usertag = "X-Storage-User: ";
+  const char *passtag = "X-Storage-Pass: ";
+  char *username = NULL;
+  char *password = NULL;
+  CURLcode result;
+  swift_error s_err;
+
+  if (!context || !context->username || !context->password) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_request_init(&request, context)) ) {
+    return s_err;
+  }
+  if (deadline_at) {
+    request.deadline_at = deadline_at;
+  }
+  if ( (s_err = swift_set_timeouts(request.curlhandle, context,
+          request.deadline_at)) ) {
+    swift_request_free(&request);
+    return s_err;
+  }
+
+  username = (char *)malloc(strlen(context->username) + 
+      strlen(usertag) + 1);
+  password = (char *)malloc(strlen(context->password) + 
+      strlen(passtag) + 1);
+
+  request.state = SWIFT_STATE_AUTH;
+
+  sprintf(username, "%s%s", usertag, context->username);
+  sprintf(password, "%s%s", passtag, context->password);
+
+  headerlist = swift_set_headers(request.curlhandle, 2, username, password);
+
+  curl_easy_setopt(request.curlhandle, CURLOPT_URL, context->connecturl);
+  curl_easy_setopt(request.curlhandle, CURLOPT_HEADERFUNCTION, swift_header_callback);
+  curl_easy_setopt(request.curlhandle, CURLOPT_WRITEHEADER, &request);
+  curl_easy_setopt(request.curlhandle, CURLOPT_WRITEFUNCTION, swift_body_callback);
+  curl_easy_setopt(request.curlhandle, CURLOPT_WRITEDATA, &request);
+
+  result = curl_easy_perform(request.curlhandle);
+  curl_slist_free_all(headerlist);
+
+  curl_easy_getinfo(request.curlhandle, CURLINFO_RESPONSE_CODE, &response);
+  if (result != CURLE_OK && swift_transport_failure(result)) {
+    request.failure = swift_failure(request.curlhandle, result,
+        request.deadline_at);
+  }
+
+  if (request.authtoken) {
+    if (request.token_expires) {
+      expires = time(NULL) + request.token_expires;
+    }
+    if (context->token_cache && request.authurl) {
+      swift_token_cache_store(context, request.authurl,
+          request.authtoken + 14, expires);
+    }
+    swift_set_token(context, request.authurl, request.authtoken, expires);
+    request.authtoken = NULL;
+    request.authurl = NULL;
+  }
+
+  free(username);
+  free(password);
+  s_err = swift_request_error(&request, response);
+  swift_request_free(&request);
+
+  return s_err;
+}
+
+
+/* Authenticate unless the context already holds a token, within
+ * deadline_at for a request that already has one */
+STATIC swift_error
+swift_ensure_auth(struct swift_context *context,
+    unsigned long long deadline_at) {
+
+  int valid_auth;
+
+  pthread_rwlock_rdlock(&context->auth_lock);
+  valid_auth = context->valid_auth;
+  pthread_rwlock_unlock(&context->auth_lock);
+
+  if (valid_auth) {
+    return SWIFT_SUCCESS;
+  }
+
+  /* A token left by another process saves the round trip */
+  if (context->token_cache && !swift_token_cache_load(context)) {
     return SWIFT_SUCCESS;
+  }
 
+  return swift_authenticate(context, deadline_at);
+}
 
-  free(**contents);
-  **contents = NULL;
-  free(*contents);
-  *contents = NULL;
+/* Swap in a new token, and storage URL unless that is NULL, taking
+ * ownership of both.  expires is when the token runs out, 0 if the auth
+ * service did not say.  Requests already running keep the token they
+ * started with */
+STATIC void
+swift_set_token(struct swift_context *context, char *authurl,
+    char *authtoken, time_t expires) {
+
+  time_t now = time(NULL);
+
+  pthread_rwlock_wrlock(&context->auth_lock);
+  free(context->authtoken);
+  context->authtoken = authtoken;
+  if (authurl) {
+    free(context->authurl);
+    context->authurl = authurl;
+  }
+  context->valid_auth = 1;
+  ++context->auth_generation;
+
+  if (!expires && context->token_lifetime) {
+    expires = now + context->token_lifetime;
+  }
+  context->token_expires = expires;
+  context->token_refresh = expires ? expires - (expires - now + 9) / 10 : 0;
+  pthread_rwlock_unlock(&context->auth_lock);
+
+  /* Let the refresher work out its next wakeup */
+  pthread_mutex_lock(&context->refresh_lock);
+  pthread_cond_signal(&context->refresh_cond);
+  pthread_mutex_unlock(&context->refresh_lock);
+}
+
+STATIC unsigned long
+swift_auth_generation(struct swift_context *context) {
+
+  unsigned long generation;
+
+  pthread_rwlock_rdlock(&context->auth_lock);
+  generation = context->auth_generation;
+  pthread_rwlock_unlock(&context->auth_lock);
+
+  return generation;
+}
+
+/* Called after a request sent with the given token generation got a 401.
+ * Only the first of the requests that failed together authenticates, the
+ * rest find a newer token already in place.  deadline_at is that of the
+ * request, 0 for none */
+STATIC swift_error
+swift_reauthenticate(struct swift_context *context,
+    unsigned long generation, unsigned long long deadline_at) {
+
+  swift_error s_err = SWIFT_SUCCESS;
+
+  pthread_mutex_lock(&context->auth_mutex);
+  if (swift_auth_generation(context) == generation) {
+    s_err = swift_authenticate(context, deadline_at);
+  }
+  pthread_mutex_unlock(&context->auth_mutex);
+
+  return s_err;
+}
+
+/* Token cache entries are one line each: connect URL, user name, storage
+ * URL, token and the time it expires, separated by tabs.  The key is
+ * everything up to the storage URL */
+STATIC char *
+swift_token_cache_key(struct swift_context *context) {
+
+  char *key;
+
+  key = (char *)malloc(strlen(context->connecturl) +
+      strlen(context->username) + 3);
+  if (key) {
+    sprintf(key, "%s\t%s\t", context->connecturl, context->username);
+  }
+
+  return key;
+}
+
+STATIC swift_error
+swift_token_cache_load(struct swift_context *context) {
+
+  FILE *fp;
+  char *key;
+  size_t key_len;
+  char *line = NULL;
+  size_t line_size = 0;
+  char *token;
+  char *tab;
+  char *authurl;
+  char *authtoken;
+  unsigned long expires;
+  swift_error s_err = SWIFT_ERROR_NOTFOUND;
+
+  fp = fopen(context->token_cache, "r");
+  if (!fp) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  key = swift_token_cache_key(context);
+  if (!key) {
+    fclose(fp);
+    return SWIFT_ERROR_MEMORY;
+  }
+  key_len = strlen(key);
+
+  while (s_err == SWIFT_ERROR_NOTFOUND && getline(&line, &line_size, fp) > 0) {
+    if (strncmp(line, key, key_len) != 0) {
+      continue;
+    }
+    swift_chomp(line);
+    token = strchr(line + key_len, '\t');
+    if (!token || token == line + key_len || !token[1]) {
+      continue;
+    }
+    *token++ = '\0';
+
+    /* Older entries have no expiry, 0 stands for unknown */
+    expires = 0;
+    if ( (tab = strchr(token, '\t')) ) {
+      *tab = '\0';
+      sscanf(tab + 1, "%lu", &expires);
+    }
+    if (!*token || (expires && (time_t)expires <= time(NULL))) {
+      continue;
+    }
+
+    authurl = (char *)malloc(strlen(line + key_len) + 1);
+    authtoken = (char *)malloc(strlen(token) + 15);
+    if (!authurl || !authtoken) {
+      free(authurl);
+      free(authtoken);
+      s_err = SWIFT_ERROR_MEMORY;
+      break;
+    }
+    strcpy(authurl, line + key_len);
+    sprintf(authtoken, "X-Auth-Token: %s", token);
+    swift_set_token(context, authurl, authtoken, (time_t)expires);
+    s_err = SWIFT_SUCCESS;
+  }
+
+  free(line);
+  free(key);
+  fclose(fp);
+  return s_err;
+}
+
+/* Best effort, a token that can not be cached is only fetched again */
+STATIC void
+swift_token_cache_store(struct swift_context *context, const char *authurl,
+    const char *token, time_t expires) {
+
+  FILE *in;
+  FILE *out;
+  char *key;
+  size_t key_len;
+  char *tmp;
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t line_len;
+  int fd;
+
+  if (strpbrk(context->connecturl, "\t\r\n") ||
+      strpbrk(context->username, "\t\r\n") ||
+      strpbrk(authurl, "\t\r\n") || strpbrk(token, "\t\r\n")) {
+    return;
+  }
+
+  key = swift_token_cache_key(context);
+  tmp = (char *)malloc(strlen(context->token_cache) + 8);
+  if (!key || !tmp) {
+    free(key);
+    free(tmp);
+    return;
+  }
+  key_len = strlen(key);
+
+  /* Write a new file next to the cache and rename it into place, so other
+   * processes only ever see a whole one */
+  sprintf(tmp, "%s.XXXXXX", context->token_cache);
+  fd = mkstemp(tmp);
+  if (fd < 0) {
+    free(key);
+    free(tmp);
+    return;
+  }
+  out = fdopen(fd, "w");
+  if (!out) {
+    close(fd);
+    unlink(tmp);
+    free(key);
+    free(tmp);
+    return;
+  }
+
+  in = fopen(context->token_cache, "r");
+  if (in) {
+    while ((line_len = getline(&line, &line_size, in)) > 0) {
+      if (strncmp(line, key, key_len) == 0) {
+        continue;
+      }
+      fputs(line, out);
+      if (line[line_len - 1] != '\n') {
+        fputc('\n', out);
+      }
+    }
+    free(line);
+    fclose(in);
+  }
+  fprintf(out, "%s%s\t%s\t%lu\n", key, authurl, token,
+      (unsigned long)expires);
+
+  if (fclose(out) != 0 || rename(tmp, context->token_cache) != 0) {
+    unlink(tmp);
+  }
+
+  free(key);
+  free(tmp);
+}
+
+
+swift_error
+swift_init() {
+  
+  if (curl_global_init(CURL_GLOBAL_ALL)) {
+    return SWIFT_ERROR_INTERNAL;
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+
+swift_error
+swift_deinit() {
+  curl_global_cleanup();
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_context_create(struct swift_context ** context,
+                     const char *connecturl,
+                     const char *username,
+                     const char *password) {
+
+  unsigned long seed;
+
+  *context = (struct swift_context *)malloc(sizeof(struct swift_context));
+  if (!*context) {
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  memset(*context, 0, sizeof(struct swift_context));
+  (*context)->checksum = 1;
+  (*context)->max_in_flight = SWIFT_MAX_IN_FLIGHT;
+  (*context)->retry_attempts = SWIFT_RETRY_ATTEMPTS;
+  (*context)->retry_on = SWIFT_RETRY_ALL;
+  (*context)->retry_backoff = SWIFT_RETRY_BACKOFF;
+  (*context)->retry_backoff_max = SWIFT_RETRY_BACKOFF_MAX;
+  /* Processes and contexts started together should not retry in step */
+  seed = (unsigned long)getpid() ^ (unsigned long)time(NULL) ^
+    (unsigned long)*context;
+  (*context)->retry_seed[0] = (unsigned short)seed;
+  (*context)->retry_seed[1] = (unsigned short)(seed >> 16);
+  (*context)->retry_seed[2] = (unsigned short)((seed >> 16) >> 16);
+  (*context)->hedge_delay = -1;
+  pthread_mutex_init(&(*context)->lock, NULL);
+  pthread_mutex_init(&(*context)->auth_mutex, NULL);
+  pthread_rwlock_init(&(*context)->auth_lock, NULL);
+  pthread_mutex_init(&(*context)->refresh_lock, NULL);
+  pthread_cond_init(&(*context)->refresh_cond, NULL);
+
+  /* Allocate memory for strings */
+  (*context)->username = (char *)malloc(strlen(username) + 1);
+  (*context)->password = (char *)malloc(strlen(password) + 1);
+  (*context)->connecturl = (char *)malloc(strlen(connecturl) + 1);
+
+  if ( !(*context)->username ||
+       !(*context)->password ||
+       !(*context)->connecturl ) {
+    swift_context_delete(context);
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  strcpy((*context)->username, username);
+  strcpy((*context)->password, password);
+  strcpy((*context)->connecturl, connecturl);
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_context_create_shared(struct swift_context **context,
+    const char *connecturl, const char *username, const char *password,
+    struct swift_share *share) {
+
+  swift_error s_err;
+
+  if ( (s_err = swift_context_create(context, connecturl, username,
+          password)) ) {
+    return s_err;
+  }
+
+  (*context)->share = share;
+
+  return SWIFT_SUCCESS;
+}
+
+STATIC void
+swift_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access,
+    void *user) {
+
+  struct swift_share *share = (struct swift_share *)user;
+
+  pthread_mutex_lock(&share->locks[data]);
+}
+
+STATIC void
+swift_share_unlock(CURL *handle, curl_lock_data data, void *user) {
+
+  struct swift_share *share = (struct swift_share *)user;
+
+  pthread_mutex_unlock(&share->locks[data]);
+}
+
+swift_error
+swift_share_create(struct swift_share **share) {
+
+  struct swift_share *l_share;
+  int i;
+
+  if (!share) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  l_share = (struct swift_share *)malloc(sizeof(struct swift_share));
+  if (!l_share) {
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  l_share->curlshare = curl_share_init();
+  if (!l_share->curlshare) {
+    free(l_share);
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  /* One lock per kind of data, so DNS lookups never wait on the
+   * connection cache */
+  for (i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+    pthread_mutex_init(&l_share->locks[i], NULL);
+  }
+
+  curl_share_setopt(l_share->curlshare, CURLSHOPT_LOCKFUNC, swift_share_lock);
+  curl_share_setopt(l_share->curlshare, CURLSHOPT_UNLOCKFUNC,
+      swift_share_unlock);
+  curl_share_setopt(l_share->curlshare, CURLSHOPT_USERDATA, l_share);
+  curl_share_setopt(l_share->curlshare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(l_share->curlshare, CURLSHOPT_SHARE,
+      CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(l_share->curlshare, CURLSHOPT_SHARE,
+      CURL_LOCK_DATA_CONNECT);
+
+  *share = l_share;
+
+  return SWIFT_SUCCESS;
+}
+
+void
+swift_share_delete(struct swift_share **share) {
+
+  int i;
+
+  if (!share || !*share) {
+    return;
+  }
+
+  curl_share_cleanup((*share)->curlshare);
+  for (i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+    pthread_mutex_destroy(&(*share)->locks[i]);
+  }
+  free(*share);
+  *share = NULL;
+}
+
+swift_error
+swift_context_delete(struct swift_context **context) {
+
+  /* The refresher uses the rest of the context, stop it first */
+  swift_context_set_token_refresh(*context, 0, 0);
+
+  /* Check each allocated object in it and free it*/
+  if ((*context)->username) {
+    free((*context)->username);
+  }
+
+  if ((*context)->password) {
+    free((*context)->password);
+  }
+
+  if ((*context)->connecturl) {
+    free((*context)->connecturl);
+  }
+
+  if ((*context)->authurl) {
+    free((*context)->authurl);
+  }
+
+  if ((*context)->authtoken) {
+    free((*context)->authtoken);
+  }
+
+  free((*context)->token_cache);
+
+  if ((*context)->multi) {
+    curl_multi_cleanup((*context)->multi);
+  }
+  while ((*context)->pool_count) {
+    curl_easy_cleanup((*context)->pool[--(*context)->pool_count]);
+  }
+
+  swift_compress_free(&(*context)->compress);
+  pthread_mutex_destroy(&(*context)->lock);
+  pthread_mutex_destroy(&(*context)->auth_mutex);
+  pthread_rwlock_destroy(&(*context)->auth_lock);
+  pthread_mutex_destroy(&(*context)->refresh_lock);
+  pthread_cond_destroy(&(*context)->refresh_cond);
+
+  free(*context);
+
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_can_connect(struct swift_context *context) {
+
+  return swift_authenticate(context, 0);
+
+}
+
+swift_error
+swift_context_set_compression(struct swift_context *context, int level,
+    const void *dict, size_t dict_len) {
+
+  struct swift_compress *compress;
+
+  if (!context || level < 0 || level > 9) {
+    return SWIFT_ERROR_INTERNAL;
+  }
+
+  if (!context->compress) {
+    compress = (struct swift_compress *)malloc(sizeof(struct swift_compress));
+    if (!compress) {
+      return SWIFT_ERROR_MEMORY;
+    }
+    memset(compress, 0, sizeof(struct swift_compress));
+    context->compress = compress;
+  }
+  compress = context->compress;
+
+  free(compress->dict);
+  compress->dict = NULL;
+  compress->dict_len = 0;
+  if (dict && dict_len) {
+    compress->dict = (unsigned char *)malloc(dict_len);
+    if (!compress->dict) {
+      return SWIFT_ERROR_MEMORY;
+    }
+    memcpy(compress->dict, dict, dict_len);
+    compress->dict_len = dict_len;
+  }
+  compress->level = level;
+
+  return SWIFT_SUCCESS;
+}
+
+STATIC swift_error
+swift_compress_begin(struct swift_request *request, int mode) {
+
+  struct swift_compress *compress = request->context ?
+    request->context->compress : NULL;
+  struct swift_zstream *zstream = &request->zstream;
+
+  if (zstream->mode == SWIFT_COMPRESS_DEFLATE) {
+    deflateEnd(&zstream->z);
+  } else if (zstream->mode == SWIFT_COMPRESS_INFLATE) {
+    inflateEnd(&zstream->z);
+  }
+  zstream->mode = SWIFT_COMPRESS_NONE;
+  zstream->eof = 0;
+  zstream->finished = 0;
+
+  if (mode == SWIFT_COMPRESS_NONE) {
+    return SWIFT_SUCCESS;
+  }
+
+  if (!zstream->staging) {
+    zstream->staging = (unsigned char *)malloc(SWIFT_ZSTREAM_CHUNK);
+    if (!zstream->staging) {
+      return SWIFT_ERROR_MEMORY;
+    }
+  }
+
+  memset(&zstream->z, 0, sizeof(z_stream));
+  if (mode == SWIFT_COMPRESS_DEFLATE) {
+    if (deflateInit(&zstream->z, request->compress_level) != Z_OK) {
+      return SWIFT_ERROR_MEMORY;
+    }
+    if (compress && compress->dict && deflateSetDictionary(&zstream->z,
+          compress->dict, compress->dict_len) != Z_OK) {
+      deflateEnd(&zstream->z);
+      return SWIFT_ERROR_INTERNAL;
+    }
+  } else {
+    if (inflateInit(&zstream->z) != Z_OK) {
+      return SWIFT_ERROR_MEMORY;
+    }
+  }
+  zstream->mode = mode;
+
+  return SWIFT_SUCCESS;
+}
+
+STATIC void
+swift_compress_free(struct swift_compress **compress) {
+
+  if (!*compress) {
+    return;
+  }
+
+  free((*compress)->dict);
+  free(*compress);
+  *compress = NULL;
+}
+
+/* Fills curl's upload buffer with deflated data, pulling the raw bytes from
+ * the caller's buffer or descriptor as needed */
+STATIC size_t
+swift_deflate_source(struct swift_request *request, void *ptr, size_t len) {
+
+  struct swift_zstream *zstream = &request->zstream;
+  ssize_t n_read;
+  size_t produced;
+  int ret;
+
+  zstream->z.next_out = (unsigned char *)ptr;
+  zstream->z.avail_out = len;
+
+  while (zstream->z.avail_out && !zstream->finished) {
+    if (!zstream->z.avail_in && !zstream->eof) {
+      if (request->state == SWIFT_STATE_OBJECT_WRITE_FD) {
+        do {
+          n_read = read(request->fd, zstream->staging, SWIFT_ZSTREAM_CHUNK);
+        } while (n_read < 0 && errno == EINTR);
+        if (n_read < 0) {
+          return CURL_READFUNC_ABORT;
+        }
+        zstream->z.next_in = zstream->staging;
+        zstream->z.avail_in = n_read;
+      } else {
+        n_read = request->obj_length - request->buffer_pos;
+        if (n_read > SWIFT_ZSTREAM_CHUNK) {
+          n_read = SWIFT_ZSTREAM_CHUNK;
+        }
+        zstream->z.next_in = (unsigned char *)request->buffer +
+          request->buffer_pos;
+        zstream->z.avail_in = n_read;
+      }
+      request->buffer_pos += n_read;
+      if (!n_read) {
+        zstream->eof = 1;
+      }
+    }
+
+    ret = deflate(&zstream->z, zstream->eof ? Z_FINISH : Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      zstream->finished = 1;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      return CURL_READFUNC_ABORT;
+    }
+  }
+
+  produced = len - zstream->z.avail_out;
+  if (request->checksum) {
+    swift_md5_update(&request->md5, ptr, produced);
+  }
+
+  return produced;
+}
+
+/* Inflates a piece of a compressed body into the caller's buffer or
+ * descriptor */
+STATIC size_t
+swift_inflate_sink(struct swift_request *request, void *ptr, size_t len) {
+
+  struct swift_compress *compress = request->context ?
+    request->context->compress : NULL;
+  struct swift_zstream *zstream = &request->zstream;
+  size_t room;
+  size_t produced;
+  size_t written;
+  ssize_t n_written;
+  int ret;
+
+  if (zstream->mode != SWIFT_COMPRESS_INFLATE) {
+    return 0;
+  }
+
+  zstream->z.next_in = (unsigned char *)ptr;
+  zstream->z.avail_in = len;
+
+  while (zstream->z.avail_in && !zstream->finished) {
+    if (request->state == SWIFT_STATE_OBJECT_READ) {
+      if (!request->buffer) {
+        return 0;
+      }
+      if (request->buffer_pos >= request->obj_length) {
+        /* Caller's buffer is full, drop the rest */
+        request->md5.skip = 1;
+        return len;
+      }
+      room = request->obj_length - request->buffer_pos;
+      if (room > SWIFT_ZSTREAM_CHUNK) {
+        room = SWIFT_ZSTREAM_CHUNK;
+      }
+      zstream->z.next_out = (unsigned char *)request->buffer +
+        request->buffer_pos;
+    } else {
+      room = SWIFT_ZSTREAM_CHUNK;
+      zstream->z.next_out = zstream->staging;
+    }
+    zstream->z.avail_out = room;
+
+    ret = inflate(&zstream->z, Z_NO_FLUSH);
+    if (ret == Z_NEED_DICT) {
+      if (!compress || !compress->dict || inflateSetDictionary(&zstream->z,
+            compress->dict, compress->dict_len) != Z_OK) {
+        return 0;
+      }
+      continue;
+    }
+    if (ret == Z_STREAM_END) {
+      zstream->finished = 1;
+    } else if (ret != Z_OK) {
+      return 0;
+    }
+
+    produced = room - zstream->z.avail_out;
+    if (request->state == SWIFT_STATE_OBJECT_READ_FD) {
+      written = 0;
+      while (written < produced) {
+        n_written = write(request->fd, zstream->staging + written,
+            produced - written);
+        if (n_written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          return 0;
+        }
+        written += n_written;
+      }
+    }
+    request->buffer_pos += produced;
+  }
+
+  return len;
+}
+
+void
+swift_context_set_checksum(struct swift_context *context, int enable) {
+
+  context->checksum = enable;
+}
+
+void
+swift_context_set_cache(struct swift_context *context,
+    struct swift_block_cache *cache) {
+
+  context->cache = cache;
+}
+
+swift_error
+swift_context_set_token_cache(struct swift_context *context,
+    const char *path) {
+
+  char *copy = NULL;
+
+  if (path) {
+    copy = (char *)malloc(strlen(path) + 1);
+    if (!copy) {
+      return SWIFT_ERROR_MEMORY;
+    }
+    strcpy(copy, path);
+  }
+
+  free(context->token_cache);
+  context->token_cache = copy;
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_context_set_http2(struct swift_context *context, int mode,
+    unsigned int max_connections) {
+
+  if (mode < SWIFT_HTTP_DEFAULT || mode > SWIFT_HTTP2_PRIOR_KNOWLEDGE) {
+    return SWIFT_ERROR_INTERNAL;
+  }
+
+  context->http2 = mode;
+  context->max_connections = max_connections ? max_connections :
+    SWIFT_HTTP2_CONNECTIONS;
+  return SWIFT_SUCCESS;
+}
+
+void
+swift_context_set_max_in_flight(struct swift_context *context,
+    unsigned int max_in_flight) {
+
+  context->max_in_flight = max_in_flight ? max_in_flight :
+    SWIFT_MAX_IN_FLIGHT;
+}
+
+void
+swift_context_set_retry(struct swift_context *context, unsigned int attempts,
+    int retry_on, unsigned long backoff_ms, unsigned long backoff_max_ms) {
+
+  context->retry_attempts = attempts;
+  context->retry_on = retry_on;
+  context->retry_backoff = backoff_ms;
+  context->retry_backoff_max = backoff_max_ms;
+}
+
+unsigned long
+swift_context_retries(struct swift_context *context) {
+
+  unsigned long retries;
+
+  pthread_mutex_lock(&context->lock);
+  retries = context->retries;
+  pthread_mutex_unlock(&context->lock);
+
+  return retries;
+}
+
+void
+swift_context_set_deadline(struct swift_context *context,
+    unsigned long connect_ms, unsigned long deadline_ms) {
+
+  context->connect_timeout = connect_ms;
+  context->deadline = deadline_ms;
+}
+
+void
+swift_context_set_low_speed(struct swift_context *context,
+    unsigned long bytes_per_sec, unsigned long secs) {
+
+  context->low_speed_limit = bytes_per_sec;
+  context->low_speed_time = secs;
+}
+
+swift_error
+swift_context_set_hedge(struct swift_context *context,
+    unsigned int percentile, unsigned int budget) {
+
+  if (percentile > 100 || budget > 100) {
+    return SWIFT_ERROR_INTERNAL;
+  }
+
+  /* Samples only say something about the percentile they were kept for */
+  pthread_mutex_lock(&context->lock);
+  context->hedge_percentile = percentile;
+  context->hedge_budget = budget;
+  context->hedge_n_samples = 0;
+  context->hedge_delay = -1;
+  pthread_mutex_unlock(&context->lock);
+
+  return SWIFT_SUCCESS;
+}
+
+void
+swift_context_hedge_stats(struct swift_context *context,
+    unsigned long *hedges, unsigned long *wins) {
+
+  pthread_mutex_lock(&context->lock);
+  if (hedges) {
+    *hedges = context->hedges;
+  }
+  if (wins) {
+    *wins = context->hedge_wins;
+  }
+  pthread_mutex_unlock(&context->lock);
+}
+
+/* Sleeps until the token is due for renewal and renews it, for as long as
+ * refresh_running is set.  Requests carry on with the old token meanwhile */
+STATIC void *
+swift_refresh_thread(void *user) {
+
+  struct swift_context *context = (struct swift_context *)user;
+  struct timespec deadline;
+  unsigned long generation;
+  time_t due;
+  time_t now;
+
+  pthread_mutex_lock(&context->refresh_lock);
+  while (context->refresh_running) {
+    pthread_rwlock_rdlock(&context->auth_lock);
+    due = context->valid_auth ? context->token_refresh : 0;
+    generation = context->auth_generation;
+    pthread_rwlock_unlock(&context->auth_lock);
+
+    now = time(NULL);
+    if (!due) {
+      /* Nothing to renew until a token with an expiry turns up */
+      pthread_cond_wait(&context->refresh_cond, &context->refresh_lock);
+      continue;
+    }
+    if (due > now) {
+      deadline.tv_sec = due;
+      deadline.tv_nsec = 0;
+      pthread_cond_timedwait(&context->refresh_cond, &context->refresh_lock,
+          &deadline);
+      continue;
+    }
+
+    pthread_mutex_unlock(&context->refresh_lock);
+    if (swift_reauthenticate(context, generation, 0)) {
+      /* The old token may have some life left, keep it and retry */
+      pthread_rwlock_wrlock(&context->auth_lock);
+      if (context->auth_generation == generation) {
+        context->token_refresh = now + SWIFT_REFRESH_RETRY;
+      }
+      pthread_rwlock_unlock(&context->auth_lock);
+    }
+    pthread_mutex_lock(&context->refresh_lock);
+  }
+  pthread_mutex_unlock(&context->refresh_lock);
+
+  return NULL;
+}
+
+swift_error
+swift_context_set_token_refresh(struct swift_context *context, int enable,
+    unsigned long lifetime) {
+
+  int running;
+
+  context->token_lifetime = lifetime;
+
+  pthread_mutex_lock(&context->refresh_lock);
+  running = context->refresh_running;
+  if (enable && !running) {
+    context->refresh_running = 1;
+    if (pthread_create(&context->refresh_thread, NULL, swift_refresh_thread,
+          context)) {
+      context->refresh_running = 0;
+      pthread_mutex_unlock(&context->refresh_lock);
+      return SWIFT_ERROR_INTERNAL;
+    }
+  } else if (!enable) {
+    context->refresh_running = 0;
+    pthread_cond_signal(&context->refresh_cond);
+  }
+  pthread_mutex_unlock(&context->refresh_lock);
+
+  if (!enable && running) {
+    pthread_join(context->refresh_thread, NULL);
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+STATIC swift_error
+swift_node_list_setup(struct swift_request *request, const char *path) {
+
+  return swift_node_page_setup(request, path, NULL, 0);
+}
+
+/* Ask for at most limit names after marker, either of which can be left
+ * out with NULL and 0 */
+STATIC swift_error
+swift_node_page_setup(struct swift_request *request, const char *path,
+    const char *marker, unsigned int limit) {
+
+  char *url;
+  char *query;
+  char *escaped = NULL;
+
+  if (!request || !path) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if (strncmp("/", path, 1) != 0) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  url = swift_object_url(request->context, path + 1, NULL);
+  if (!url) {
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  if (marker || limit) {
+    if (marker && !(escaped = curl_easy_escape(NULL, marker, 0))) {
+      free(url);
+      return SWIFT_ERROR_MEMORY;
+    }
+    query = (char *)malloc(strlen(url) + (escaped ? strlen(escaped) : 0) + 32);
+    if (!query) {
+      curl_free(escaped);
+      free(url);
+      return SWIFT_ERROR_MEMORY;
+    }
+    strcpy(query, url);
+    free(url);
+    url = query;
+    query += strlen(url);
+    *query++ = '?';
+    if (limit) {
+      query += sprintf(query, "limit=%u%s", limit, escaped ? "&" : "");
+    }
+    if (escaped) {
+      sprintf(query, "marker=%s", escaped);
+      curl_free(escaped);
+    }
+  }
+  
+  /* Determine if this is an account listing, or container listing */
+  if (strcmp("/", path) == 0) {
+    request->state = SWIFT_STATE_CONTAINERLIST;
+  } else {
+    request->state = SWIFT_STATE_OBJECTLIST;
+  }
+  curl_easy_setopt(request->curlhandle, CURLOPT_URL, url);
+
+  free(url);
+
+  return SWIFT_SUCCESS;
+}
+
+/* Listings hold one name a line.  The count headers are of the whole
+ * account or container, more than a page that stops short of it */
+STATIC int
+swift_list_entries(const char *buffer) {
+
+  int n_entries = 0;
+
+  while (buffer && (buffer = strchr(buffer, '\n'))) {
+    ++n_entries;
+    ++buffer;
+  }
+
+  return n_entries;
+}
+
+
+swift_error
+swift_node_list(struct swift_context *context, const char *path,
+    int *n_entries, char ***contents) {
+
+  struct swift_request request;
+  swift_error s_err;
+  unsigned long response;
+  char *list = NULL;
+  char *grown;
+  char *marker = NULL;
+  char *last;
+  size_t list_len = 0;
+  size_t page_len;
+  int page_entries;
+
+  /* Pages are asked for one after the other, each starting after the last
+   * name of the one before, until one stops short */
+  do {
+    if ( (s_err = swift_request_init(&request, context)) ) {
+      break;
+    }
+
+    /* Authenticating comes out of the request's deadline */
+    if ( (s_err = swift_ensure_auth(context, request.deadline_at)) ||
+        (s_err = swift_node_page_setup(&request, path, marker,
+          SWIFT_LISTING_LIMIT)) ) {
+      swift_request_free(&request);
+      break;
+    }
+
+    response = swift_perform(&request);
+    s_err = swift_request_error(&request, response);
+
+    page_len = request.buffer ? request.buffer_pos : 0;
+    page_entries = swift_list_entries(request.buffer);
+    if (!s_err && page_len) {
+      grown = (char *)realloc(list, list_len + page_len + 1);
+      if (grown) {
+        list = grown;
+        memcpy(list + list_len, request.buffer, page_len);
+        list_len += page_len;
+        list[list_len] = '\0';
+      } else {
+        s_err = SWIFT_ERROR_MEMORY;
+      }
+    }
+    free(request.buffer);
+    swift_request_free(&request);
+    if (s_err || !page_entries) {
+      break;
+    }
+
+    /* Every name ends in a newline, the last one too */
+    free(marker);
+    for (last = list + list_len - 1; last > list && last[-1] != '\n';
+        --last);
+    marker = strndup(last, list + list_len - 1 - last);
+    if (!marker) {
+      s_err = SWIFT_ERROR_MEMORY;
+      break;
+    }
+  } while (page_entries >= SWIFT_LISTING_LIMIT);
+  free(marker);
+
+  /* The names point into the list, which the first one frees */
+  *n_entries = swift_list_entries(list);
+  if (!*n_entries) {
+    free(list);
+    list = NULL;
+  }
+  swift_string_to_list(list, *n_entries, contents);
+
+  return s_err;
+}
+
+swift_error
+swift_node_list_free(char ***contents) {
+
+  if (!contents)
+    return SWIFT_SUCCESS;
+
+  if (!*contents) 
+    return SWIFT_SUCCESS;
+
+
+  free(**contents);
+  **contents = NULL;
+  free(*contents);
+  *contents = NULL;
+
+  return SWIFT_SUCCESS;
+
+}
+
+swift_error
+swift_container_exists(struct swift_context *context, const char *container) {
+
+  char **contents = NULL;
+  int n_entries;
+
+  char *temp = (char *)malloc(strlen(container) + 2);
+  if (!temp) {
+    return SWIFT_ERROR_MEMORY;
+  }
+  strcpy(temp + 1, container);
+  temp[0] = '/';
+
+  swift_error e = swift_node_list(context, temp, &n_entries, &contents);
+  free(temp);
+  if (!e) {
+    swift_node_list_free(&contents);
+  }
+  return e;
+}
+
+STATIC swift_error
+swift_container_create_setup(struct swift_request *request, const char *container) {
+
+  char *url;
+
+  if (!request || !container) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+ 
+  url = swift_object_url(request->context, container, NULL);
+  if (!url) {
+    return SWIFT_ERROR_MEMORY;
+  }
+  request->state = SWIFT_STATE_CONTAINER_CREATE;
+  curl_easy_setopt(request->curlhandle, CURLOPT_URL, url);
+  curl_easy_setopt(request->curlhandle, CURLOPT_CUSTOMREQUEST, "PUT"); 
+
+  free(url);
+
+  return SWIFT_SUCCESS;
+}
+
+
+swift_error
+swift_container_create(struct swift_context * context, const char *container) {
+
+  struct swift_request request;
+  int response;
+  swift_error s_err;
+  
+  if ( (s_err = swift_request_init(&request, context)) ) {
+    return s_err;
+  }
+
+  /* Authenticating comes out of the request's deadline */
+  if ( (s_err = swift_ensure_auth(context, request.deadline_at)) ) {
+    swift_request_free(&request);
+    return s_err;
+  }
+
+  if ( (s_err = swift_container_create_setup(&request, container)) ) {
+    swift_request_free(&request);
+    return s_err;
+  }
+
+  response = swift_perform(&request);
+  swift_request_free(&request);
+
+  return swift_request_error(&request, response);
+}
+
+STATIC swift_error
+swift_container_delete_setup(struct swift_request *request, const char *container) {
+
+  char *url;
+
+  if (!request || !container) {
+    return SWIFT_ERROR_NOTFOUND;
+  }                                                                     
+
+  if (strcmp("", container) == 0) {
+    return SWIFT_ERROR_EXISTS;
+  }
+
+  url = swift_object_url(request->context, container, NULL);
+  if (!url) {
+    return SWIFT_ERROR_MEMORY;
+  }
+  request->state = SWIFT_STATE_CONTAINER_DELETE;
+  curl_easy_setopt(request->curlhandle, CURLOPT_URL, url);
+  curl_easy_setopt(request->curlhandle, CURLOPT_CUSTOMREQUEST, "DELETE");  
+
+  free(url);
+
+  return SWIFT_SUCCESS;
+}
+
+
+swift_error
+swift_container_delete(struct swift_context * context, const char *container) {
+                                                                               
+  struct swift_request request;
+  int response;
+  swift_error s_err;
+  
+  if ( (s_err = swift_request_init(&request, context)) ) {
+    return s_err;
+  }
+
+  /* Authenticating comes out of the request's deadline */
+  if ( (s_err = swift_ensure_auth(context, request.deadline_at)) ) {
+    swift_request_free(&request);
+    return s_err;
+  }
+
+  if ( (s_err = swift_container_delete_setup(&request, container)) ) {
+    swift_request_free(&request);
+    return s_err;
+  }
+
+  response = swift_perform(&request);
+  swift_request_free(&request);
+
+  return swift_request_error(&request, response);
+}
+
+STATIC swift_error
+swift_object_exists_setup(struct swift_request *request, const char *container,
+    const char *object) {
+
+  char *url;
+
+  if (!request || !container || !object) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  url = swift_object_url(request->context, container, object);
+  if (!url) {
+    return SWIFT_ERROR_MEMORY;
+  }
+  request->state = SWIFT_STATE_OBJECT_EXISTS;
+  request->etag[0] = '\0';
+  request->last_modified[0] = '\0';
+  request->compressed = 0;
+  request->uncompressed_length = 0;
+  curl_easy_setopt(request->curlhandle, CURLOPT_URL, url);
+  curl_easy_setopt(request->curlhandle, CURLOPT_NOBODY, 1);
+
+  free(url);
+
+  return SWIFT_SUCCESS;
+}
+
+/* HEAD an object, leaving its ETag, dates and compression in the request
+ * for the caller.  length is the size stored, see swift_data_length() for
+ * the size of the data */
+STATIC swift_error
+swift_object_head(struct swift_request *request, const char *container,
+    const char *object, size_t *length) {
+
+  int response;
+  swift_error s_err;
+
+  if ( (s_err = swift_ensure_auth(request->context,
+          request->deadline_at)) ) {
+    return s_err;
+  }
+
+  if ( (s_err = swift_object_exists_setup(request, container, object)) ) {
+    return s_err;
+  }
+
+  response = swift_perform(request);
+  *length = request->obj_length;
+
+  return swift_request_error(request, response);
+}
+
+/* The size of an object's data once inflated, after swift_object_head() */
+STATIC size_t
+swift_data_length(struct swift_request *request) {
+
+  if (request->compressed && request->uncompressed_length) {
+    return request->uncompressed_length;
+  }
+
+  return request->obj_length;
+}
+
+swift_error
+swift_object_exists(struct swift_context *context, const char *container,
+    const char *object, size_t *length) {
+                                                                                
+  struct swift_request request;
+  swift_error s_err;
+  
+  if ( (s_err = swift_request_init(&request, context)) ) {
+    return s_err;
+  }
+
+  s_err = swift_object_head(&request, container, object, length);
+  /* Callers want the size of the data, not what is stored */
+  *length = swift_data_length(&request);
+  swift_request_free(&request);
+
+  return s_err;
+}
+
+/* Ranges are of the stored bytes, and a range of a deflate stream can not
+ * be inflated on its own, so compressed objects are refused here */
+STATIC swift_error
+swift_object_range_length(struct swift_context *context,
+    const char *container, const char *object, size_t *length) {
+
+  struct swift_request request;
+  swift_error s_err;
+
+  if ( (s_err = swift_request_init(&request, context)) ) {
+    return s_err;
+  }
+
+  s_err = swift_object_head(&request, container, object, length);
+  if (!s_err && request.compressed) {
+    s_err = SWIFT_ERROR_COMPRESSED;
+  }
+  swift_request_free(&request);
+
+  return s_err;
+}
+
+STATIC swift_error
+swift_object_delete_setup(struct swift_request *request, const char *container,
+    const char *object) {
+
+  char *url;
+
+  if (!request || !container || !object) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  url = swift_object_url(request->context, container, object);
+  if (!url) {
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  request->state = SWIFT_STATE_OBJECT_DELETE;
+  curl_easy_setopt(request->curlhandle, CURLOPT_URL, url);
+  curl_easy_setopt(request->curlhandle, CURLOPT_CUSTOMREQUEST, "DELETE");
+  free(url);
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_object_delete(struct swift_context *context, const char *container,
+    const char *object) {
+
+  struct swift_request request;
+  int response;
+  swift_error s_err;
+
+  if ( (s_err = swift_request_init(&request, context)) ) {
+    return s_err;
+  }
+
+  /* Authenticating comes out of the request's deadline */
+  if ( (s_err = swift_ensure_auth(context, request.deadline_at)) ) {
+    swift_request_free(&request);
+    return s_err;
+  }
+
+  if ( (s_err = swift_object_delete_setup(&request, container, object)) ) {
+    swift_request_free(&request);
+    return s_err;
+  }
+
+  response = swift_perform(&request);
+  swift_request_free(&request);
+
+  return swift_request_error(&request, response);;
+}
+
+void
+swift_free_transfer_handle(struct swift_transfer_handle **handle) {
+
+  struct swift_transfer_handle *l_handle;
+
+  if (!handle || !*handle)
+    return;
+
+  l_handle = *handle;
+  swift_free_transfer_handle(&l_handle->spare);
+  if (l_handle->multi) {
+    if (l_handle->curlhandle) {
+      curl_multi_remove_handle(l_handle->multi, l_handle->curlhandle);
+    }
+    curl_multi_cleanup(l_handle->multi);
+  }
+  if (l_handle->curlhandle) {
+    swift_handle_put(l_handle->parent, l_handle->curlhandle);
+  }
+  curl_slist_free_all(l_handle->headers);
+  free(l_handle->window);
+  free(l_handle->ptr);
+  free(l_handle->object);
+  free(l_handle->container);
+  free(l_handle);
+  l_handle = NULL;
+  *handle = NULL;
+}
+  
+
+STATIC swift_error
+swift_create_transfer_handle(struct swift_context *context, const char *container, 
+    const char *object, struct swift_transfer_handle **handle, size_t length) {
+
+  struct swift_transfer_handle *l_handle;
+
+  if ( !context || !container || !object ||
+      !handle) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  *handle = (struct swift_transfer_handle *)
+    malloc(sizeof(struct swift_transfer_handle));
+
+  if (!*handle) {
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  /*Set up the various entries in the handle, starting with the path */
+  l_handle = *handle;
+  memset(l_handle, 0, sizeof(struct swift_transfer_handle));
+  l_handle->container = (char *)malloc(strlen(container) + 1);
+  if (!l_handle->container) {
+    swift_free_transfer_handle(handle);
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  l_handle->object = (char *)malloc(strlen(object) + 1);
+  if (!l_handle->object) {
+    swift_free_transfer_handle(handle);
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  /* Streaming handles are created with no backing buffer */
+  if (length) {
+    l_handle->ptr = malloc(length);
+    if (!l_handle->ptr) {
+      swift_free_transfer_handle(handle);
+      return SWIFT_ERROR_MEMORY; 
+    }
+  }
+
+  strcpy(l_handle->container, container);
+  strcpy(l_handle->object, object);
+  l_handle->parent = context;
+  l_handle->length = length;
+  l_handle->fpos = 0;
+
+  return SWIFT_SUCCESS;
+}
+
+
+swift_error
+swift_object_writehandle(struct swift_context *context, const char *container,
+    const char *object, struct swift_transfer_handle **handle, size_t len) {
+
+  size_t length;
+  struct swift_transfer_handle *l_handle;
+  swift_error s_err;
+
+  if (!context || !container ||
+      !object || !handle) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if (swift_object_exists(context, container, object, &length) == SWIFT_SUCCESS) {
+    /* If it already exists, refuse to do anything */
+    return SWIFT_ERROR_EXISTS;
+  }
+
+  if ( (s_err = swift_create_transfer_handle(context, container, object, 
+          handle, len))) {
+    return s_err;
+  }
+
+  /* Make our syntax easier */
+  l_handle = *handle;
+
+  memset(l_handle->ptr, 0, len);
+  l_handle->mode = SWIFT_WRITE;
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_object_readhandle(struct swift_context *context, const char *container,
+    const char *object, struct swift_transfer_handle **handle) {
+
+  size_t length;
+  struct swift_transfer_handle *l_handle;
+  struct swift_request request;
+  char etag[64];
+  int compressed;
+  swift_error s_err;
+
+  if (!context || !container ||
+      !object || !handle) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_request_init(&request, context)) ) {
+    return s_err;
+  }
+
+  s_err = swift_object_head(&request, container, object, &length);
+  length = swift_data_length(&request);
+  strcpy(etag, request.etag);
+  compressed = request.compressed;
+  swift_request_free(&request);
+  if (s_err) {
+    return s_err;
+  }
+
+  if ( (s_err = swift_create_transfer_handle(context, container, object, 
+          handle, length))) {
+    return s_err;
+  }
+
+  l_handle = *handle;
+  l_handle->mode = SWIFT_READ;
+
+  if (context->cache && etag[0] && length && !compressed) {
+    return swift_cache_fetch(context, container, object, etag, length,
+        l_handle->ptr, 0, (length + context->cache->block_size - 1) /
+        context->cache->block_size);
+  }
+
+  return swift_sync(l_handle);
+}
+
+STATIC swift_error
+swift_sync_setup(struct swift_transfer_handle *handle,
+    struct swift_request *request) {
+
+  struct swift_context *context;
+  char *url;
+  swift_error s_err;
+
+  if (!handle || !request) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  context = handle->parent;
+
+  if (!context || !handle->container || !handle->object) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_ensure_auth(context, request->deadline_at)) ) {
+    return s_err;
+  }
+
+  url = swift_object_url(context, handle->container, handle->object);
+  if (!url) {
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  curl_easy_setopt(request->curlhandle, CURLOPT_URL, url);
+  request->buffer = handle->ptr;
+  request->buffer_pos = 0;
+  request->obj_length = handle->length;
+  request->fd = handle->fd;
+  request->compressed = 0;
+  swift_md5_init(&request->md5);
+
+  /* Uploads are deflated when enabled, reads only once the object's
+   * headers say so */
+  if ( (s_err = swift_compress_begin(request, (handle->mode == SWIFT_WRITE &&
+            request->compress_level) ?
+          SWIFT_COMPRESS_DEFLATE : SWIFT_COMPRESS_NONE)) ) {
+    free(url);
+    return s_err;
+  }
+
+  switch (handle->mode) {
+    case SWIFT_READ:
+      request->etag[0] = '\0';
+      request->last_modified[0] = '\0';
+      if (handle->type == SWIFT_HANDLE_FD) {
+        request->state = SWIFT_STATE_OBJECT_READ_FD;
+      } else {
+        request->state = SWIFT_STATE_OBJECT_READ;
+      }
+      break;
+    case SWIFT_WRITE:
+      curl_easy_setopt(request->curlhandle, CURLOPT_UPLOAD, 1);
+      if (handle->type == SWIFT_HANDLE_FD) {
+        request->state = SWIFT_STATE_OBJECT_WRITE_FD;
+      } else {
+        request->state = SWIFT_STATE_OBJECT_WRITE;
+      }
+      /* Descriptors of unknown length and compressed bodies are sent
+       * chunked */
+      if ((handle->type != SWIFT_HANDLE_FD || request->obj_length) &&
+          request->zstream.mode != SWIFT_COMPRESS_DEFLATE) {
+        curl_easy_setopt(request->curlhandle, CURLOPT_INFILESIZE_LARGE,
+            (curl_off_t)request->obj_length);
+      }
+      curl_easy_setopt(request->curlhandle, CURLOPT_READFUNCTION, 
+          swift_upload_callback);
+      curl_easy_setopt(request->curlhandle, CURLOPT_READDATA, request);
+      break;
+  }
+
+  free(url);
+
+  return SWIFT_SUCCESS;
+}
+
+/* Run a buffered or descriptor transfer with a request the caller has set
+ * up */
+STATIC swift_error
+swift_sync_request(struct swift_transfer_handle *handle,
+    struct swift_request *request) {
+
+  swift_error s_err;
+  int response;
+
+  if (  (s_err = swift_sync_setup(handle, request) )) {
+    return s_err;
+  }
+  
+  response = swift_perform(request);
+  if ( (s_err = swift_request_error(request, response)) ) {
+    return s_err;
+  }
+
+  if (request->checksum) {
+    return swift_md5_verify(&request->md5, request->etag);
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_sync(struct swift_transfer_handle *handle) {
+
+  struct swift_request request;
+  swift_error s_err;
+
+  /* For streaming handles report how the transfer has gone so far */
+  if (handle && handle->multi) {
+    if (handle->mode == SWIFT_WRITE) {
+      /* Let the ring drain and the chunked body end */
+      handle->finished = 1;
+      while (handle->running) {
+        swift_stream_perform(handle);
+      }
+    }
+    if (handle->response) {
+      if ( (s_err = swift_response(handle->response)) ) {
+        return s_err;
+      }
+    }
+    if (handle->compressed) {
+      return SWIFT_ERROR_COMPRESSED;
+    }
+    if (handle->result != CURLE_OK) {
+      return SWIFT_ERROR_CONNECT;
+    }
+    return SWIFT_SUCCESS;
+  }
+
+  if (!handle || !handle->parent) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_request_init(&request, handle->parent)) ) {
+    return s_err;
+  }
+
+  s_err = swift_sync_request(handle, &request);
+  swift_request_free(&request);
+
+  return s_err;
+}
+
+size_t
+swift_read(struct swift_transfer_handle *handle, void *buf, size_t nbytes) {
+
+  if (!handle || !buf) {
+    return 0;
+  }
+
+  if (handle->type == SWIFT_HANDLE_STREAM) {
+    return swift_stream_read(handle, buf, nbytes);
+  } else if (handle->type == SWIFT_HANDLE_RANGE) {
+    return swift_range_read(handle, buf, nbytes);
+  }
+
+  size_t newbytes = (handle->length - handle->fpos) < nbytes ?
+    (handle->length - handle->fpos) : 
+    nbytes;
+
+  memcpy(buf, handle->ptr + handle->fpos, newbytes);
+  handle->fpos += newbytes;
+  return newbytes;
+}
+
+
+size_t
+swift_write(struct swift_transfer_handle *handle, const void *buf, size_t nbytes) {
+
+  if (!handle || !buf) {
+    return 0;
+  }
+
+  if (handle->type == SWIFT_HANDLE_STREAM) {
+    return swift_stream_write(handle, buf, nbytes);
+  }
+
+  size_t newbytes = (handle->length - handle->fpos) < nbytes ?
+    (handle->length - handle->fpos) : 
+    nbytes;
+
+  memcpy(handle->ptr + handle->fpos, buf, newbytes);
+  handle->fpos += newbytes;
+  return newbytes;
+
+}
+
+size_t
+swift_get_data(struct swift_transfer_handle *handle, void **ptr) {
+
+  *ptr = handle->ptr;
+  return handle->length;
+
+}
+
+
+void
+swift_seek(struct swift_transfer_handle *handle, unsigned long pos) {
+
+  if (handle->type == SWIFT_HANDLE_STREAM) {
+    return;
+  }
+
+  if (pos < handle->length) {
+    handle->fpos = pos;
+  }
+
+}
+  
+STATIC size_t
+swift_stream_header_callback(void *ptr, size_t size, size_t nmemb, void *user) {
+
+  struct swift_transfer_handle *handle = (struct swift_transfer_handle *)user;
+  char *temp = NULL;
+
+  temp = (char *)malloc(size * nmemb + 1);
+  if (!temp)
+    return 0;
+
+  strncpy(temp, ptr, size * nmemb);
+  temp[size * nmemb] = '\0';
+  swift_chomp(temp);
+
+  if (strncmp("HTTP/", temp, 5) == 0) {
+    sscanf(temp, "HTTP/%*s %ld", &handle->response);
+  } else if (strncasecmp("Content-Length: ", temp, 16) == 0) {
+    /* Range handles know the length already, this is just the range size */
+    if (handle->type == SWIFT_HANDLE_STREAM) {
+      sscanf(temp + 16, "%lu", &handle->length);
+    }
+  } else if (handle->mode == SWIFT_READ &&
+      strncasecmp("X-Object-Meta-Compression: deflate", temp, 34) == 0) {
+    handle->compressed = 1;
+  } else if (strcmp("", temp) == 0) {
+    /* Blank line terminates the header block */
+    handle->headers_done = 1;
+  }
+
+  free(temp);
+  return size * nmemb;
+}
+
+STATIC size_t
+swift_stream_body_callback(void *ptr, size_t size, size_t nmemb, void *user) {
+
+  struct swift_transfer_handle *handle = (struct swift_transfer_handle *)user;
+  size_t real_size = size * nmemb;
+  char *newwindow;
+
+  handle->headers_done = 1;
+
+  /* Never let an error page or stored compressed bytes end up in the
+   * window */
+  if (handle->response >= 300 || handle->compressed) {
+    return 0;
+  }
+
+  /* The window holds outgoing data on write handles */
+  if (handle->mode == SWIFT_WRITE) {
+    return real_size;
+  }
+
+  if (handle->window_len + real_size > handle->window_size) {
+    /* Move the unread bytes to the front to make room at the end */
+    memmove(handle->window, handle->window + handle->window_pos,
+        handle->window_len - handle->window_pos);
+    handle->window_len -= handle->window_pos;
+    handle->window_pos = 0;
+  }
+
+  if (handle->window_len + real_size > handle->window_size) {
+    if (handle->window_len) {
+      /* Window full, curl will hand us this data again once unpaused */
+      handle->paused = 1;
+      return CURL_WRITEFUNC_PAUSE;
+    }
+    /* A single write larger than the whole window, grow to fit it */
+    newwindow = (char *)realloc(handle->window, real_size);
+    if (!newwindow) {
+      return 0;
+    }
+    handle->window = newwindow;
+    handle->window_size = real_size;
+  }
+
+  memcpy(handle->window + handle->window_len, ptr, real_size);
+  handle->window_len += real_size;
+
+  return real_size;
+}
+
+STATIC size_t
+swift_stream_source_callback(void *ptr, size_t size, size_t nmemb, void *user) {
+
+  struct swift_transfer_handle *handle = (struct swift_transfer_handle *)user;
+  size_t real_size = size * nmemb;
+  size_t newbytes;
+  size_t total = 0;
+
+  if (!handle->window_len) {
+    if (handle->finished) {
+      /* Ends the chunked body */
+      return 0;
+    }
+    handle->paused = 1;
+    return CURL_READFUNC_PAUSE;
+  }
+
+  /* At most two copies, the tail of the ring and then its head */
+  while (total < real_size && handle->window_len) {
+    newbytes = handle->window_size - handle->window_pos;
+    if (newbytes > handle->window_len) {
+      newbytes = handle->window_len;
+    }
+    if (newbytes > real_size - total) {
+      newbytes = real_size - total;
+    }
+
+    memcpy((char *)ptr + total, handle->window + handle->window_pos, newbytes);
+    handle->window_pos = (handle->window_pos + newbytes) % handle->window_size;
+    handle->window_len -= newbytes;
+    total += newbytes;
+  }
+
+  return total;
+}
+
+STATIC swift_error
+swift_stream_perform(struct swift_transfer_handle *handle) {
+
+  int n_running;
+  int n_msgs;
+  struct CURLMsg *curl_msg;
+
+  if (!handle->running) {
+    return SWIFT_SUCCESS;
+  }
+
+  if (handle->paused) {
+    handle->paused = 0;
+    curl_easy_pause(handle->curlhandle, CURLPAUSE_CONT);
+  }
+
+  if (curl_multi_perform(handle->multi, &n_running) != CURLM_OK) {
+    handle->running = 0;
+    handle->result = CURLE_FAILED_INIT;
+    return SWIFT_ERROR_INTERNAL;
+  }
+
+  while ((curl_msg = curl_multi_info_read(handle->multi, &n_msgs)) != NULL) {
+    if (curl_msg->msg == CURLMSG_DONE) {
+      handle->result = curl_msg->data.result;
+      handle->running = 0;
+    }
+  }
+
+  /* No part of a 401 reaches the window, so the same range can simply be
+   * asked for again with a new token */
+  if (!handle->running && handle->response < 300) {
+    handle->replayed = 0;
+  }
+  if (!handle->running && handle->response == 401 &&
+      handle->mode == SWIFT_READ && !handle->replayed &&
+      !swift_reauthenticate(handle->parent, handle->auth_generation, 0)) {
+    handle->replayed = 1;
+    swift_stream_start(handle, handle->range_start,
+        handle->type == SWIFT_HANDLE_RANGE ?
+        handle->range_end - handle->range_start : 0);
+    return SWIFT_SUCCESS;
+  }
+
+  /* Only block if curl has nothing for us yet */
+  if (handle->running && !handle->paused) {
+    curl_multi_wait(handle->multi, NULL, 0, 1000, NULL);
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+STATIC size_t
+swift_stream_read(struct swift_transfer_handle *handle, void *buf, size_t nbytes) {
+
+  size_t total = 0;
+  size_t newbytes;
+
+  if (handle->mode != SWIFT_READ) {
+    return 0;
+  }
+
+  while (total < nbytes) {
+    if (handle->window_pos == handle->window_len) {
+      if (!handle->running) {
+        break;
+      }
+      swift_stream_perform(handle);
+      continue;
+    }
+
+    newbytes = handle->window_len - handle->window_pos;
+    if (newbytes > nbytes - total) {
+      newbytes = nbytes - total;
+    }
+
+    memcpy((char *)buf + total, handle->window + handle->window_pos, newbytes);
+    handle->window_pos += newbytes;
+    handle->fpos += newbytes;
+    total += newbytes;
+  }
+
+  return total;
+}
+
+STATIC size_t
+swift_stream_write(struct swift_transfer_handle *handle, const void *buf,
+    size_t nbytes) {
+
+  size_t total = 0;
+  size_t newbytes;
+  size_t tail;
+  int n_running;
+
+  if (handle->mode != SWIFT_WRITE || handle->finished) {
+    return 0;
+  }
+
+  while (total < nbytes) {
+    if (handle->window_len == handle->window_size) {
+      /* Ring full, let curl drain some of it */
+      if (!handle->running) {
+        break;
+      }
+      swift_stream_perform(handle);
+      continue;
+    }
+
+    tail = (handle->window_pos + handle->window_len) % handle->window_size;
+    newbytes = handle->window_size - handle->window_len;
+    if (newbytes > handle->window_size - tail) {
+      newbytes = handle->window_size - tail;
+    }
+    if (newbytes > nbytes - total) {
+      newbytes = nbytes - total;
+    }
+
+    memcpy(handle->window + tail, (const char *)buf + total, newbytes);
+    handle->window_len += newbytes;
+    handle->fpos += newbytes;
+    total += newbytes;
+  }
+
+  /* The upload only moves while we are in here, so give it a turn on every
+   * write, waking it if it ran dry waiting on us, without blocking */
+  if (handle->running) {
+    if (handle->paused && handle->window_len) {
+      handle->paused = 0;
+      curl_easy_pause(handle->curlhandle, CURLPAUSE_CONT);
+    }
+    curl_multi_perform(handle->multi, &n_running);
+  }
+
+  return total;
+}
+
+STATIC swift_error
+swift_stream_create(struct swift_context *context, const char *container,
+    const char *object, struct swift_transfer_handle **handle,
+    swift_handletype type) {
+
+  struct swift_transfer_handle *l_handle;
+  swift_error s_err;
+
+  if ( (s_err = swift_create_transfer_handle(context, container, object,
+          handle, 0))) {
+    return s_err;
+  }
+
+  l_handle = *handle;
+  l_handle->mode = SWIFT_READ;
+  l_handle->type = type;
+  l_handle->window_size = SWIFT_STREAM_WINDOW;
+  l_handle->window = (char *)malloc(l_handle->window_size);
+  l_handle->multi = curl_multi_init();
+  l_handle->curlhandle = swift_handle_get(context);
+
+  if (!l_handle->window || !l_handle->multi || !l_handle->curlhandle) {
+    swift_free_transfer_handle(handle);
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+STATIC swift_error
+swift_stream_start(struct swift_transfer_handle *handle, unsigned long offset,
+    unsigned long length) {
+
+  struct swift_context *context = handle->parent;
+  char *url;
+  char range[64];
+
+  url = swift_object_url(context, handle->container, handle->object);
+  if (!url) {
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  /* Abandon whatever the handle was doing before */
+  curl_multi_remove_handle(handle->multi, handle->curlhandle);
+  curl_slist_free_all(handle->headers);
+  curl_easy_reset(handle->curlhandle);
+  swift_handle_configure(context, handle->curlhandle);
+
+  curl_easy_setopt(handle->curlhandle, CURLOPT_URL, url);
+  free(url);
+
+  pthread_rwlock_rdlock(&context->auth_lock);
+  if (length) {
+    sprintf(range, "Range: bytes=%lu-%lu", offset, offset + length - 1);
+    handle->headers = swift_set_headers(handle->curlhandle, 2,
+        context->authtoken, range);
+  } else {
+    handle->headers = swift_set_headers(handle->curlhandle, 1,
+        context->authtoken);
+  }
+  handle->auth_generation = context->auth_generation;
+  pthread_rwlock_unlock(&context->auth_lock);
+  curl_easy_setopt(handle->curlhandle, CURLOPT_HEADERFUNCTION,
+      swift_stream_header_callback);
+  curl_easy_setopt(handle->curlhandle, CURLOPT_WRITEHEADER, handle);
+  curl_easy_setopt(handle->curlhandle, CURLOPT_WRITEFUNCTION,
+      swift_stream_body_callback);
+  curl_easy_setopt(handle->curlhandle, CURLOPT_WRITEDATA, handle);
+
+  handle->range_start = offset;
+  handle->range_end = length ? offset + length : handle->length;
+  handle->headers_done = 0;
+  handle->paused = 0;
+  handle->response = 0;
+  handle->result = CURLE_OK;
+
+  curl_multi_add_handle(handle->multi, handle->curlhandle);
+  handle->running = 1;
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_object_streamhandle(struct swift_context *context, const char *container,
+    const char *object, struct swift_transfer_handle **handle) {
+
+  struct swift_transfer_handle *l_handle;
+  swift_error s_err;
+
+  if (!context || !container ||
+      !object || !handle) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  /* The stream itself has no deadline, authenticating still does */
+  if ( (s_err = swift_ensure_auth(context, swift_deadline_at(context, 0))) ) {
+    return s_err;
+  }
+
+  if ( (s_err = swift_stream_create(context, container, object, handle,
+          SWIFT_HANDLE_STREAM)) ) {
+    return s_err;
+  }
+
+  l_handle = *handle;
+  if ( (s_err = swift_stream_start(l_handle, 0, 0)) ) {
+    swift_free_transfer_handle(handle);
+    return s_err;
+  }
+
+  /* Wait for the response headers only, the body is pulled by swift_read.
+   * A 401 is waited out until it has been sent again */
+  while ((!l_handle->headers_done ||
+        (l_handle->response == 401 && !l_handle->replayed)) &&
+      l_handle->running) {
+    swift_stream_perform(l_handle);
+  }
+
+  if ( (s_err = swift_sync(l_handle)) ) {
+    swift_free_transfer_handle(handle);
+    return s_err;
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_object_streamwritehandle(struct swift_context *context,
+    const char *container, const char *object,
+    struct swift_transfer_handle **handle) {
+
+  struct swift_transfer_handle *l_handle;
+  swift_error s_err;
+  size_t length;
+  char *url;
+
+  if (!context || !container ||
+      !object || !handle) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if (swift_object_exists(context, container, object, &length) == SWIFT_SUCCESS) {
+    /* If it already exists, refuse to do anything */
+    return SWIFT_ERROR_EXISTS;
+  }
+
+  if ( (s_err = swift_stream_create(context, container, object, handle,
+          SWIFT_HANDLE_STREAM)) ) {
+    return s_err;
+  }
+
+  l_handle = *handle;
+  l_handle->mode = SWIFT_WRITE;
+
+  url = swift_object_url(context, container, object);
+  if (!url) {
+    swift_free_transfer_handle(handle);
+    return SWIFT_ERROR_MEMORY;
+  }
+  curl_easy_setopt(l_handle->curlhandle, CURLOPT_URL, url);
+  free(url);
+
+  /* No length given, so curl sends the body chunked */
+  pthread_rwlock_rdlock(&context->auth_lock);
+  l_handle->headers = swift_set_headers(l_handle->curlhandle, 1,
+      context->authtoken);
+  pthread_rwlock_unlock(&context->auth_lock);
+  curl_easy_setopt(l_handle->curlhandle, CURLOPT_UPLOAD, 1L);
+  curl_easy_setopt(l_handle->curlhandle, CURLOPT_READFUNCTION,
+      swift_stream_source_callback);
+  curl_easy_setopt(l_handle->curlhandle, CURLOPT_READDATA, l_handle);
+  curl_easy_setopt(l_handle->curlhandle, CURLOPT_HEADERFUNCTION,
+      swift_stream_header_callback);
+  curl_easy_setopt(l_handle->curlhandle, CURLOPT_WRITEHEADER, l_handle);
+  curl_easy_setopt(l_handle->curlhandle, CURLOPT_WRITEFUNCTION,
+      swift_stream_body_callback);
+  curl_easy_setopt(l_handle->curlhandle, CURLOPT_WRITEDATA, l_handle);
+
+  curl_multi_add_handle(l_handle->multi, l_handle->curlhandle);
+  l_handle->running = 1;
+
+  return SWIFT_SUCCESS;
+}
+
+/* Once the reader is half way through the range being read, ask for the
+ * one after it on the other stream, so that its first byte is on the way
+ * while the rest of this one is still being read */
+STATIC void
+swift_range_prefetch(struct swift_transfer_handle *handle) {
+
+  struct swift_transfer_handle *active;
+  struct swift_transfer_handle *next;
+  unsigned long length;
+  int n_running;
+
+  active = handle->active ? handle->active : handle;
+
+  /* Only continue a range that is going well and that the reader has
+   * worked through at least half of, lone header/footer reads stay small */
+  if (active->range_end <= active->range_start ||
+      active->result != CURLE_OK || active->response >= 300 ||
+      active->range_end >= handle->length ||
+      handle->fpos < active->range_start ||
+      handle->fpos - active->range_start <
+      (active->range_end - active->range_start) / 2) {
+    return;
+  }
+
+  if (!handle->spare && swift_stream_create(handle->parent,
+        handle->container, handle->object, &handle->spare,
+        SWIFT_HANDLE_RANGE)) {
+    return;
+  }
+  next = (active == handle) ? handle->spare : handle;
+
+  /* Already on its way */
+  if (next->window_off == active->range_end &&
+      next->range_end > next->window_off && next->result == CURLE_OK &&
+      next->response < 300) {
+    return;
+  }
+
+  handle->readahead *= 2;
+  if (handle->readahead > SWIFT_READAHEAD_MAX) {
+    handle->readahead = SWIFT_READAHEAD_MAX;
+  }
+
+  length = handle->length - active->range_end;
+  if (length > handle->readahead) {
+    length = handle->readahead;
+  }
+
+  next->length = handle->length;
+  next->window_pos = 0;
+  next->window_len = 0;
+  next->window_off = active->range_end;
+  if (swift_stream_start(next, active->range_end, length) == SWIFT_SUCCESS) {
+    curl_multi_perform(next->multi, &n_running);
+  }
+}
+
+STATIC size_t
+swift_range_read(struct swift_transfer_handle *handle, void *buf, size_t nbytes) {
+
+  size_t total = 0;
+  size_t newbytes;
+  size_t started_at = (size_t)-1;
+  unsigned long avail;
+  unsigned long length;
+  unsigned long index;
+  size_t block_size;
+  int n_running;
+  struct swift_transfer_handle *active;
+  struct swift_transfer_handle *next;
+
+  /* With a block cache, read whole blocks through it instead */
+  while (handle->ptr && total < nbytes && handle->fpos < handle->length) {
+    block_size = handle->parent->cache->block_size;
+    index = handle->fpos / block_size;
+
+    if (!handle->block_len || index != handle->block_index) {
+      handle->block_len = 0;
+      if (swift_cache_fetch(handle->parent, handle->container, handle->object,
+            handle->etag, handle->length, handle->ptr, index, 1)) {
+        break;
+      }
+      handle->block_index = index;
+      handle->block_len = (handle->length - index * block_size > block_size) ?
+        block_size : handle->length - index * block_size;
+    }
+
+    newbytes = handle->block_len - (handle->fpos - index * block_size);
+    if (newbytes > nbytes - total) {
+      newbytes = nbytes - total;
+    }
+    memcpy((char *)buf + total,
+        (char *)handle->ptr + (handle->fpos - index * block_size), newbytes);
+    handle->fpos += newbytes;
+    total += newbytes;
+  }
+
+  while (total < nbytes && handle->fpos < handle->length) {
+    swift_range_prefetch(handle);
+    active = handle->active ? handle->active : handle;
+    next = (active == handle) ? handle->spare : handle;
+    avail = active->window_len - active->window_pos;
+
+    /* Serve from the window, dropping anything before fpos */
+    if (handle->fpos >= active->window_off &&
+        handle->fpos < active->window_off + avail) {
+      active->window_pos += handle->fpos - active->window_off;
+      active->window_off = handle->fpos;
+
+      newbytes = active->window_len - active->window_pos;
+      if (newbytes > nbytes - total) {
+        newbytes = nbytes - total;
+      }
+
+      memcpy((char *)buf + total, active->window + active->window_pos,
+          newbytes);
+      active->window_pos += newbytes;
+      active->window_off += newbytes;
+      handle->fpos += newbytes;
+      total += newbytes;
+      continue;
+    }
+
+    /* The bytes are on their way in the current range, or close enough
+     * behind it that reading through is cheaper than a new request.  The
+     * range asked for ahead moves along meanwhile */
+    if (active->running && handle->fpos >= active->window_off &&
+        handle->fpos < active->range_end &&
+        handle->fpos - (active->window_off + avail) < SWIFT_READAHEAD_MIN) {
+      active->window_off += avail;
+      active->window_pos = active->window_len;
+      swift_stream_perform(active);
+      if (next && next->running) {
+        curl_multi_perform(next->multi, &n_running);
+      }
+      continue;
+    }
+
+    /* Carry on with the range asked for ahead once it starts at fpos */
+    if (next && next->window_off == handle->fpos &&
+        next->range_end > handle->fpos && next->result == CURLE_OK &&
+        (next->running || next->window_len > next->window_pos)) {
+      handle->active = next;
+      continue;
+    }
+
+    /* Give up if the last request we made got us nothing */
+    if (started_at == total) {
+      break;
+    }
+    started_at = total;
+
+    if (handle->fpos == active->range_end && handle->readahead) {
+      handle->readahead *= 2;
+      if (handle->readahead > SWIFT_READAHEAD_MAX) {
+        handle->readahead = SWIFT_READAHEAD_MAX;
+      }
+    } else {
+      handle->readahead = SWIFT_READAHEAD_MIN;
+    }
+
+    length = handle->length - handle->fpos;
+    if (length > handle->readahead) {
+      length = handle->readahead;
+    }
+
+    active->window_pos = 0;
+    active->window_len = 0;
+    active->window_off = handle->fpos;
+    if (swift_stream_start(active, handle->fpos, length)) {
+      break;
+    }
+  }
+
+  swift_range_prefetch(handle);
+
+  return total;
+}
+
+swift_error
+swift_object_rangehandle(struct swift_context *context, const char *container,
+    const char *object, struct swift_transfer_handle **handle) {
+
+  struct swift_request request;
+  swift_error s_err;
+  size_t length;
+  char etag[64];
+  int compressed;
+
+  if (!context || !container ||
+      !object || !handle) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_request_init(&request, context)) ) {
+    return s_err;
+  }
+
+  s_err = swift_object_head(&request, container, object, &length);
+  strcpy(etag, request.etag);
+  compressed = request.compressed;
+  swift_request_free(&request);
+  if (s_err) {
+    return s_err;
+  }
+
+  /* Ranges of a deflate stream can not be inflated on their own */
+  if (compressed) {
+    return SWIFT_ERROR_COMPRESSED;
+  }
+
+  if ( (s_err = swift_stream_create(context, container, object, handle,
+          SWIFT_HANDLE_RANGE)) ) {
+    return s_err;
+  }
+
+  (*handle)->length = length;
+  (*handle)->active = *handle;
+
+  if (context->cache && etag[0]) {
+    strcpy((*handle)->etag, etag);
+    (*handle)->ptr = malloc(context->cache->block_size);
+    if (!(*handle)->ptr) {
+      swift_free_transfer_handle(handle);
+      return SWIFT_ERROR_MEMORY;
+    }
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_object_put(struct swift_context *c, char *container,
+    char *object, void *data, size_t length) {
+
+  struct swift_transfer_handle handle;
+
+  if (!data || !object || !container || !c) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  memset(&handle, 0, sizeof(handle));
+  handle.container = container;
+  handle.object = object;
+  handle.mode = SWIFT_WRITE;
+  handle.parent = c;
+  handle.fpos = 0;
+  handle.length = length;
+  handle.ptr = data;
+
+  return swift_sync(&handle);
+
+}
+
+
+swift_error
+swift_object_get(struct swift_context *c, char *container,
+    char *object, void *data, size_t maxlen) {
+
+  struct swift_transfer_handle handle;
+  swift_error s_err;
+  size_t length;
+
+  if (!data || !object || !container || !c) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_object_exists(c, container, object, &length)) ) {
+    return s_err;
+  }
+
+  memset(&handle, 0, sizeof(handle));
+  handle.container = container;
+  handle.object = object;
+  handle.mode = SWIFT_READ;
+  handle.parent = c;
+  handle.fpos = 0;
+  handle.length = (length > maxlen) ? maxlen : length;
+  handle.ptr = data;
+
+  return swift_sync(&handle);
+
+}
+
+STATIC void
+swift_set_validators(struct swift_request *request,
+    const struct swift_object_info *info) {
+
+  request->if_none_match[0] = '\0';
+  request->if_modified_since[0] = '\0';
+
+  if (!info) {
+    return;
+  }
+
+  /* An ETag is the stronger validator, only fall back to the date */
+  if (info->etag[0]) {
+    sprintf(request->if_none_match, "%.60s", info->etag);
+  } else if (info->last_modified[0]) {
+    strcpy(request->if_modified_since, info->last_modified);
+  }
+}
+
+swift_error
+swift_object_stat(struct swift_context *c, const char *container,
+    const char *object, struct swift_object_info *info) {
+
+  struct swift_request request;
+  swift_error s_err;
+  size_t length;
+
+  if (!object || !container || !c || !info) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_request_init(&request, c)) ) {
+    return s_err;
+  }
+
+  swift_set_validators(&request, info);
+  s_err = swift_object_head(&request, container, object, &length);
+
+  if (s_err == SWIFT_SUCCESS) {
+    info->length = swift_data_length(&request);
+    strcpy(info->etag, request.etag);
+    strcpy(info->last_modified, request.last_modified);
+  }
+  swift_request_free(&request);
+
+  return s_err;
+}
+
+swift_error
+swift_object_get_if_modified(struct swift_context *c, const char *container,
+    const char *object, void *data, size_t maxlen,
+    struct swift_object_info *info) {
+
+  struct swift_transfer_handle handle;
+  struct swift_request request;
+  swift_error s_err;
+
+  if (!data || !object || !container || !c || !info) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  /* No HEAD first, the GET itself carries the validators */
+  memset(&handle, 0, sizeof(handle));
+  handle.container = (char *)container;
+  handle.object = (char *)object;
+  handle.mode = SWIFT_READ;
+  handle.parent = c;
+  handle.length = maxlen;
+  handle.ptr = data;
+
+  if ( (s_err = swift_request_init(&request, c)) ) {
+    return s_err;
+  }
+
+  swift_set_validators(&request, info);
+  s_err = swift_sync_request(&handle, &request);
+
+  if (s_err == SWIFT_SUCCESS) {
+    info->length = request.buffer_pos;
+    strcpy(info->etag, request.etag);
+    strcpy(info->last_modified, request.last_modified);
+  }
+  swift_request_free(&request);
+
+  return s_err;
+}
+
+swift_error
+swift_object_get_fd(struct swift_context *c, const char *container,
+    const char *object, int fd) {
+
+  struct swift_transfer_handle handle;
+  swift_error s_err;
+  size_t length;
+
+  if (!object || !container || !c || fd < 0) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_object_exists(c, container, object, &length)) ) {
+    return s_err;
+  }
+
+  memset(&handle, 0, sizeof(handle));
+  handle.container = (char *)container;
+  handle.object = (char *)object;
+  handle.mode = SWIFT_READ;
+  handle.type = SWIFT_HANDLE_FD;
+  handle.fd = fd;
+  handle.parent = c;
+  handle.length = length;
+
+  return swift_sync(&handle);
+}
+
+
+STATIC swift_error
+swift_map_file(const char *path, size_t length, int *fd, void **map) {
+
+  *map = NULL;
+  *fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (*fd < 0) {
+    return SWIFT_ERROR_PERMISSIONS;
+  }
+
+  if (!length) {
+    return SWIFT_SUCCESS;
+  }
+
+  if (ftruncate(*fd, length) != 0) {
+    close(*fd);
+    unlink(path);
+    return SWIFT_ERROR_MEMORY;
+  }
+  *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+  if (*map == MAP_FAILED) {
+    close(*fd);
+    unlink(path);
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+
+swift_error
+swift_object_get_path(struct swift_context *c, const char *container,
+    const char *object, const char *path) {
+
+  struct swift_transfer_handle handle;
+  swift_error s_err;
+  size_t length;
+  void *map;
+  int fd;
+
+  if (!object || !container || !c || !path) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_object_exists(c, container, object, &length)) ) {
+    return s_err;
+  }
+
+  if ( (s_err = swift_map_file(path, length, &fd, &map)) ) {
+    return s_err;
+  }
+
+  if (length) {
+    memset(&handle, 0, sizeof(handle));
+    handle.container = (char *)container;
+    handle.object = (char *)object;
+    handle.mode = SWIFT_READ;
+    handle.parent = c;
+    handle.length = length;
+    handle.ptr = map;
+
+    s_err = swift_sync(&handle);
+    munmap(map, length);
+  }
+
+  close(fd);
+  if (s_err) {
+    unlink(path);
+  }
+
+  return s_err;
+}
+
+
+swift_error
+swift_object_put_fd(struct swift_context *c, const char *container,
+    const char *object, int fd) {
+
+  struct swift_transfer_handle handle;
+  struct stat st;
+  swift_error s_err;
+  void *map = MAP_FAILED;
+
+  if (!object || !container || !c || fd < 0) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if (fstat(fd, &st) != 0) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  memset(&handle, 0, sizeof(handle));
+  handle.container = (char *)container;
+  handle.object = (char *)object;
+  handle.mode = SWIFT_WRITE;
+  handle.parent = c;
+
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+
+  if (map != MAP_FAILED) {
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    handle.ptr = map;
+    handle.length = st.st_size;
+  } else {
+    /* Fall back to reading the descriptor from the upload callback */
+    handle.type = SWIFT_HANDLE_FD;
+    handle.fd = fd;
+    handle.length = S_ISREG(st.st_mode) ? st.st_size : 0;
+  }
+
+  s_err = swift_sync(&handle);
+
+  if (map != MAP_FAILED) {
+    munmap(map, st.st_size);
+  }
+
+  return s_err;
+}
+
+STATIC size_t
+swift_multi_callback(void *ptr, size_t size, size_t nmemb, void *user) {
+
+  struct swift_multi_op *op = (struct swift_multi_op *)user;
+  size_t n;
+
+  /* Keep error bodies from the callback, the read may be sent again */
+  if (op->mode == SWIFT_READ && op->response >= 300) {
+    return size * nmemb;
+  }
+
+  n = op->callback(ptr, size * nmemb, op->userdata);
+  op->moved = 1;
+
+  /* Each stream keeps its own digest, fed from the buffer curl hands us */
+  if (op->context->checksum && n <= size * nmemb) {
+    swift_md5_update(&op->md5, ptr, n);
+  }
+
+  return n;
+}
+
+/* Response bodies of uploads are of no interest */
+STATIC size_t
+swift_discard_callback(void *ptr, size_t size, size_t nmemb, void *user) {
+
+  return size * nmemb;
+}
+
+STATIC size_t
+swift_multi_header_callback(void *ptr, size_t size, size_t nmemb, void *user) {
+
+  struct swift_multi_op *op = (struct swift_multi_op *)user;
+  size_t real_size = size * nmemb;
+  char *temp;
+
+  temp = (char *)malloc(real_size + 1);
+  if (!temp)
+    return 0;
+
+  strncpy(temp, ptr, real_size);
+  temp[real_size] = '\0';
+  swift_chomp(temp);
+
+  if (strncmp("HTTP/", temp, 5) == 0) {
+    /* Of a hedged read and its copy the first to answer is kept, the other
+     * gives up here */
+    if (op->hedge && op->hedge->first_byte) {
+      free(temp);
+      return 0;
+    }
+    if (!op->first_byte) {
+      op->first_byte = swift_now_ms();
+    }
+    sscanf(temp, "HTTP/%*s %ld", &op->response);
+  } else if (strncasecmp("ETag: ", temp, 6) == 0) {
+    if (swift_copy_etag(op->etag, temp + 6)) {
+      op->md5.skip = 1;
+    }
+  } else if (op->mode == SWIFT_READ &&
+      strncasecmp("X-Object-Meta-Compression: deflate", temp, 34) == 0) {
+    /* Ranges of a deflate stream can not be inflated on their own, so
+     * rather than hand the caller stored bytes the read is ended here */
+    op->compressed = 1;
+    free(temp);
+    return 0;
+  }
+
+  free(temp);
+  return real_size;
+}
+
+STATIC swift_error
+swift_multi_setup(struct swift_multi_op *op) {
+
+  char *url;
+  char range[64];
+  swift_error s_err;
+
+  op->curlhandle = swift_handle_get(op->context);
+  if (!op->curlhandle) {
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  op->response = 0;
+  op->moved = 0;
+  op->compressed = 0;
+  op->sent_at = swift_now_ms();
+  op->first_byte = 0;
+
+  /* Ranges only ever see part of the object */
+  swift_md5_init(&op->md5);
+  if (op->mode == SWIFT_READ && op->length) {
+    op->md5.skip = 1;
+  }
+
+  url = swift_object_url(op->context, op->container, op->objname);
+  if (!url) {
+    swift_handle_put(op->context, op->curlhandle);
+    op->curlhandle = NULL;
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  curl_easy_setopt(op->curlhandle, CURLOPT_URL, url);
+  free(url);
+
+  /* Retries and replays get what is left of the op's time */
+  if ( (s_err = swift_set_timeouts(op->curlhandle, op->context,
+          op->deadline_at)) ) {
+    swift_handle_put(op->context, op->curlhandle);
+    op->curlhandle = NULL;
+    return s_err;
+  }
+
+  curl_easy_setopt(op->curlhandle, CURLOPT_PRIVATE, op);
+  /* Wait for a stream on a connection being set up rather than open
+   * another */
+  if (op->context->http2 >= SWIFT_HTTP2) {
+    curl_easy_setopt(op->curlhandle, CURLOPT_PIPEWAIT, 1L);
+  }
+  curl_easy_setopt(op->curlhandle, CURLOPT_HEADERFUNCTION,
+      swift_multi_header_callback);
+  curl_easy_setopt(op->curlhandle, CURLOPT_WRITEHEADER, op);
+  pthread_rwlock_rdlock(&op->context->auth_lock);
+  if (op->mode == SWIFT_WRITE) {
+    curl_easy_setopt(op->curlhandle, CURLOPT_CUSTOMREQUEST, "PUT");
+    curl_easy_setopt(op->curlhandle, CURLOPT_READFUNCTION, swift_multi_callback);
+    curl_easy_setopt(op->curlhandle, CURLOPT_READDATA, op);
+    curl_easy_setopt(op->curlhandle, CURLOPT_UPLOAD, 1);
+    curl_easy_setopt(op->curlhandle, CURLOPT_WRITEFUNCTION,
+        swift_discard_callback);
+    if (op->length) {
+      curl_easy_setopt(op->curlhandle, CURLOPT_INFILESIZE_LARGE,
+          (curl_off_t)op->length);
+      op->headers = swift_set_headers(op->curlhandle, 1, op->context->authtoken);
+    } else {
+      op->headers = swift_set_headers(op->curlhandle, 2, op->context->authtoken, 
+          "Transfer-Encoding: chunked");
+    }
+  } else if (op->mode == SWIFT_READ) {
+    curl_easy_setopt(op->curlhandle, CURLOPT_CUSTOMREQUEST, "GET");
+    curl_easy_setopt(op->curlhandle, CURLOPT_WRITEFUNCTION, swift_multi_callback);
+    curl_easy_setopt(op->curlhandle, CURLOPT_WRITEDATA, op);
+    if (op->length) {
+      sprintf(range, "Range: bytes=%lu-%lu", op->offset,
+          op->offset + op->length - 1);
+      op->headers = swift_set_headers(op->curlhandle, 2,
+          op->context->authtoken, range);
+    } else {
+      op->headers = swift_set_headers(op->curlhandle, 1, op->context->authtoken);
+    }
+  }
+  op->auth_generation = op->context->auth_generation;
+  pthread_rwlock_unlock(&op->context->auth_lock);
+
+  return SWIFT_SUCCESS;
+}
+
+/* Check out the context's idle multi, so its connection cache outlives
+ * each use.  Concurrent users of the same context each get a multi of
+ * their own */
+STATIC CURLM *
+swift_multi_get(struct swift_context *context) {
+
+  CURLM *multi;
+
+  pthread_mutex_lock(&context->lock);
+  multi = context->multi;
+  context->multi = NULL;
+  pthread_mutex_unlock(&context->lock);
+  if (!multi) {
+    multi = curl_multi_init();
+  }
+  if (multi) {
+    swift_multi_configure(context, multi);
+  }
+
+  return multi;
+}
+
+/* Give a multi back, keeping it as the idle one if there is none */
+STATIC void
+swift_multi_put(struct swift_context *context, CURLM *multi) {
+
+  pthread_mutex_lock(&context->lock);
+  if (!context->multi) {
+    context->multi = multi;
+    multi = NULL;
+  }
+  pthread_mutex_unlock(&context->lock);
+  if (multi) {
+    curl_multi_cleanup(multi);
+  }
+}
+
+/* Multi handle options that follow the context's settings */
+STATIC void
+swift_multi_configure(struct swift_context *context, CURLM *multi) {
+
+  /* Multiplexed ops share a few connections instead of one each */
+  if (context->http2 >= SWIFT_HTTP2) {
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  }
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+      context->http2 >= SWIFT_HTTP2 ? (long)context->max_connections : 0L);
+}
+
+/* Take an op's request off the multi and give its handle back */
+STATIC void
+swift_multi_release(CURLM *multi, struct swift_multi_op *op) {
+
+  curl_slist_free_all(op->headers);
+  op->headers = NULL;
+  curl_multi_remove_handle(multi, op->curlhandle);
+  swift_handle_put(op->context, op->curlhandle);
+  op->curlhandle = NULL;
+}
+
+/* Send a copy of a read that has waited on its first byte for too long.
+ * The copy hands the body to the same callback, once it has answered
+ * first */
+STATIC void
+swift_hedge_start(CURLM *multi, struct swift_multi_op *op) {
+
+  struct swift_multi_op *copy;
+
+  copy = (struct swift_multi_op *)malloc(sizeof(struct swift_multi_op));
+  if (!copy) {
+    return;
+  }
+
+  memcpy(copy, op, sizeof(struct swift_multi_op));
+  copy->headers = NULL;
+  copy->hedge = op;
+  copy->hedge_copy = 1;
+  if (swift_multi_setup(copy)) {
+    free(copy);
+    return;
+  }
+
+  op->hedge = copy;
+  curl_multi_add_handle(multi, copy->curlhandle);
+  swift_hedge_launched(op->context);
+}
+
+/* Settle a hedged read one of whose requests curl is done with, its handle
+ * already given back.  Returns 1 when that one lost, or failed without an
+ * answer while the other still runs, and is to be forgotten.  Otherwise
+ * the other is cancelled and *op is left at the op itself, holding the
+ * outcome of whichever answered */
+STATIC int
+swift_hedge_resolve(CURLM *multi, struct swift_multi_op **op) {
+
+  struct swift_multi_op *t_op = *op;
+  struct swift_multi_op *peer = t_op->hedge;
+
+  if (!t_op->first_byte && peer->curlhandle) {
+    if (t_op->hedge_copy) {
+      peer->hedge = NULL;
+      free(t_op);
+    }
+    return 1;
+  }
+
+  if (peer->curlhandle) {
+    swift_multi_release(multi, peer);
+  }
+  if (!t_op->hedge_copy) {
+    free(peer);
+    t_op->hedge = NULL;
+    return 0;
+  }
+
+  peer->response = t_op->response;
+  strcpy(peer->etag, t_op->etag);
+  peer->md5 = t_op->md5;
+  peer->moved = t_op->moved;
+  peer->first_byte = t_op->first_byte;
+  peer->hedge = NULL;
+  free(t_op);
+  *op = peer;
+
+  return 0;
+}
+
+/* Watch a read a chunked operation has just sent for hedging */
+STATIC void
+swift_hedge_watch(struct swift_multi_op *op, struct swift_multi_op **flight) {
+
+  if (!op->context->hedge_percentile || op->mode != SWIFT_READ) {
+    return;
+  }
+
+  /* Retries are the same read going out again */
+  if (!op->retries) {
+    swift_hedge_begin(op->context);
+  }
+  op->hedge_next = *flight;
+  *flight = op;
+}
+
+/* Go over the reads being watched: hedge those that have waited on their
+ * first byte past the context's delay, cancel the loser of each race that
+ * has been answered and stop watching reads there is nothing more to do
+ * for.  Returns the milliseconds until the next read is due a hedge, -1
+ * for none */
+STATIC long
+swift_hedge_scan(struct swift_context *context, CURLM *multi,
+    struct swift_multi_op **flight) {
+
+  struct swift_multi_op **link = flight;
+  struct swift_multi_op *t_op;
+  unsigned long long now = swift_now_ms();
+  unsigned long long due;
+  long delay;
+  long next = -1;
+
+  pthread_mutex_lock(&context->lock);
+  delay = context->hedge_delay;
+  pthread_mutex_unlock(&context->lock);
+
+  while ( (t_op = *link) ) {
+    /* Finished, backing off or left to its copy */
+    if (!t_op->curlhandle) {
+      *link = t_op->hedge_next;
+      continue;
+    }
+
+    if (t_op->hedge) {
+      if (!t_op->first_byte && !t_op->hedge->first_byte) {
+        link = &t_op->hedge_next;
+        continue;
+      }
+      if (t_op->first_byte) {
+        swift_multi_release(multi, t_op->hedge);
+        free(t_op->hedge);
+        t_op->hedge = NULL;
+      } else {
+        swift_multi_release(multi, t_op);
+      }
+      *link = t_op->hedge_next;
+      continue;
+    }
+
+    if (t_op->first_byte || delay < 0) {
+      *link = t_op->hedge_next;
+      continue;
+    }
+
+    due = t_op->sent_at + delay;
+    if (due > now) {
+      if (next < 0 || due - now < (unsigned long long)next) {
+        next = (long)(due - now);
+      }
+      link = &t_op->hedge_next;
+      continue;
+    }
+
+    if (swift_hedge_allow(context)) {
+      swift_hedge_start(multi, t_op);
+    }
+    if (t_op->hedge) {
+      link = &t_op->hedge_next;
+    } else {
+      *link = t_op->hedge_next;
+    }
+  }
+
+  return next;
+}
+
+/* Collect the ops curl is done with.  Reads turned away with a 401 go out
+ * once more with a new token.  With a retries list, ops failing in a way
+ * the retry policy covers are put on it with retry_at set, to be set up
+ * again once that time has come.  The rest get retval and done set and
+ * are passed to done_cb.  Returns how many ops finished */
+STATIC unsigned int
+swift_multi_collect(CURLM *multi, struct swift_multi_op **retries,
+    swift_done_callback done_cb, void *user) {
+
+  struct swift_multi_op *t_op;
+  struct CURLMsg *curl_msg;
+  int n_msgs;
+  long curl_responsecode;
+  long delay;
+  CURLcode result;
+  swift_error failure;
+  int won;
+  unsigned int n_done = 0;
+
+  while ((curl_msg = curl_multi_info_read(multi, &n_msgs)) != NULL) {
+    if (curl_msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+
+    result = curl_msg->data.result;
+    curl_easy_getinfo(curl_msg->easy_handle, CURLINFO_PRIVATE, &t_op);
+    curl_easy_getinfo(t_op->curlhandle, CURLINFO_RESPONSE_CODE,
+        &curl_responsecode);
+    failure = swift_transport_failure(result) ?
+      swift_failure(t_op->curlhandle, result, t_op->deadline_at) :
+      SWIFT_SUCCESS;
+    swift_multi_release(multi, t_op);
+
+    /* Of a hedged read and its copy only the one that answered counts */
+    won = t_op->hedge_copy;
+    if (t_op->hedge && swift_hedge_resolve(multi, &t_op)) {
+      continue;
+    }
+    if (t_op->mode == SWIFT_READ && t_op->first_byte &&
+        t_op->context->hedge_percentile && curl_responsecode < 400) {
+      swift_hedge_sample(t_op->context,
+          (unsigned long)(t_op->first_byte - t_op->sent_at), won);
+    }
+
+    /* Writes have handed their data to curl already */
+    if (curl_responsecode == 401 && t_op->mode == SWIFT_READ &&
+        !t_op->replayed &&
+        !swift_reauthenticate(t_op->context, t_op->auth_generation,
+          t_op->deadline_at) &&
+        !swift_multi_setup(t_op)) {
+      t_op->replayed = 1;
+      curl_multi_add_handle(multi, t_op->curlhandle);
+      continue;
+    }
+
+    if (retries && (delay = swift_retry_delay(t_op->context, result,
+            curl_responsecode, t_op->retries)) >= 0 &&
+        (!t_op->deadline_at ||
+         swift_now_ms() + delay < t_op->deadline_at) &&
+        (!t_op->moved || (t_op->rewind && t_op->rewind(t_op->userdata)))) {
+      ++t_op->retries;
+      swift_retry_count(t_op->context);
+      t_op->retry_at = swift_now_ms() + delay;
+      t_op->retry_next = *retries;
+      *retries = t_op;
+      continue;
+    }
+
+    if (t_op->compressed) {
+      t_op->retval = SWIFT_ERROR_COMPRESSED;
+    } else {
+      t_op->retval = failure ? failure : swift_response(curl_responsecode);
+    }
+    if (!t_op->retval && t_op->context->checksum) {
+      t_op->retval = swift_md5_verify(&t_op->md5, t_op->etag);
+    }
+    t_op->done = 1;
+    ++n_done;
+    if (done_cb) {
+      done_cb(t_op, user);
+    }
+  }
+
+  return n_done;
+}
+
+/* Run the ops next_cb hands out, keeping at most max_in_flight of them
+ * going and asking for more as they finish.  Finished ops, including
+ * those that could not be started, are passed to done_cb */
+STATIC swift_error
+swift_multi_run(struct swift_context *context, unsigned int max_in_flight,
+    swift_next_callback next_cb, swift_done_callback done_cb, void *user) {
+
+  CURLM *multi;
+  int n_running;
+  unsigned int n_pending = 0;
+  int n_waiting = 0;
+  unsigned long long now;
+  unsigned long long wake;
+  long timeout;
+  long hedge_wait;
+  swift_error s_err;
+  struct swift_multi_op *t_op;
+  struct swift_multi_op *retries = NULL;
+  struct swift_multi_op *flight = NULL;
+  struct swift_multi_op **link;
+  struct timespec wait;
+  unsigned long long deadline_at;
+
+  /* Authenticating and the ops without a deadline of their own share one
+   * that starts with the run */
+  deadline_at = swift_deadline_at(context, 0);
+  if ( (s_err = swift_ensure_auth(context, deadline_at)) ) {
+    return s_err;
+  }
+
+  if (!max_in_flight) {
+    max_in_flight = SWIFT_MAX_IN_FLIGHT;
+  }
+                      
+  multi = swift_multi_get(context);
+  if (!multi) {
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  for (;;) {
+    /* Ops backing off keep their place in the window, send those whose
+     * time has come again */
+    now = swift_now_ms();
+    link = &retries;
+    while ( (t_op = *link) ) {
+      if (t_op->retry_at > now) {
+        link = &t_op->retry_next;
+        continue;
+      }
+      *link = t_op->retry_next;
+      if ( (t_op->retval = swift_multi_setup(t_op)) ) {
+        --n_pending;
+        t_op->done = 1;
+        if (done_cb) {
+          done_cb(t_op, user);
+        }
+        continue;
+      }
+      curl_multi_add_handle(multi, t_op->curlhandle);
+      swift_hedge_watch(t_op, &flight);
+    }
+
+    /* Top the window up */
+    while (n_pending < max_in_flight && (t_op = next_cb(user))) {
+      t_op->deadline_at = t_op->deadline ?
+        swift_deadline_at(context, t_op->deadline) : deadline_at;
+      if ( (t_op->retval = swift_multi_setup(t_op)) ) {
+        t_op->done = 1;
+        if (done_cb) {
+          done_cb(t_op, user);
+        }
+        continue;
+      }
+      curl_multi_add_handle(multi, t_op->curlhandle);
+      swift_hedge_watch(t_op, &flight);
+      ++n_pending;
+    }
+
+    if (!n_pending) {
+      break;
+    }
+
+    curl_multi_perform(multi, &n_running);
+    n_pending -= swift_multi_collect(multi, &retries, done_cb, user);
+    /* Before any finished op is handed out again */
+    hedge_wait = flight ? swift_hedge_scan(context, multi, &flight) : -1;
+    if (!n_pending) {
+      continue;
+    }
+
+    /* Sleep until a socket is ready, curl has a timeout to run, a retry
+     * is due or a read a hedge */
+    timeout = 1000;
+    if (hedge_wait >= 0 && hedge_wait < timeout) {
+      timeout = hedge_wait;
+    }
+    now = swift_now_ms();
+    for (t_op = retries; t_op; t_op = t_op->retry_next) {
+      wake = t_op->retry_at > now ? t_op->retry_at - now : 0;
+      if (wake < (unsigned long long)timeout) {
+        timeout = (long)wake;
+      }
+    }
+    if (curl_multi_wait(multi, NULL, 0, timeout, &n_waiting) == CURLM_OK &&
+        !n_waiting && !n_running && timeout) {
+      /* Nothing for curl to wait on, only retries */
+      wait.tv_sec = timeout / 1000;
+      wait.tv_nsec = (timeout % 1000) * 1000000;
+      nanosleep(&wait, NULL);
+    }
+  }
+
+  swift_multi_put(context, multi);
+
+  return SWIFT_SUCCESS;
+}
+
+STATIC struct swift_multi_op *
+swift_op_list_next(void *user) {
+
+  struct swift_op_list *list = (struct swift_op_list *)user;
+
+  if (list->next == list->n_ops) {
+    return NULL;
+  }
+  return &list->ops[list->next++];
+}
+
+swift_error
+swift_object_chunked_operation(struct swift_context *context,
+    struct swift_multi_op *oplist, unsigned int n_ops) {
+
+  struct swift_op_list list;
+
+  if (!oplist || !n_ops) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  list.ops = oplist;
+  list.n_ops = n_ops;
+  list.next = 0;
+
+  return swift_multi_run(context, context->max_in_flight, swift_op_list_next,
+      NULL, &list);
+}
+
+STATIC int
+swift_engine_socket(CURL *handle, curl_socket_t fd, int what, void *user,
+    void *socketp) {
+
+  struct swift_engine *engine = (struct swift_engine *)user;
+  int events = 0;
+
+  if (what == CURL_POLL_REMOVE) {
+    events = SWIFT_POLL_REMOVE;
+  } else {
+    if (what & CURL_POLL_IN) {
+      events |= SWIFT_POLL_IN;
+    }
+    if (what & CURL_POLL_OUT) {
+      events |= SWIFT_POLL_OUT;
+    }
+  }
+
+  engine->socket_cb(fd, events, engine->user);
+  return 0;
+}
+
+STATIC int
+swift_engine_timer(CURLM *multi, long timeout_ms, void *user) {
+
+  struct swift_engine *engine = (struct swift_engine *)user;
+
+  engine->timer_cb(timeout_ms, engine->user);
+  return 0;
+}
+
+/* Drop a finished op from the engine before handing it to the caller */
+STATIC void
+swift_engine_done(struct swift_multi_op *op, void *user) {
+
+  struct swift_engine *engine = (struct swift_engine *)user;
+  unsigned int cur_op;
+
+  for (cur_op = 0; cur_op < engine->n_ops; ++cur_op) {
+    if (engine->ops[cur_op] == op) {
+      engine->ops[cur_op] = engine->ops[--engine->n_ops];
+      break;
+    }
+  }
+
+  if (engine->done_cb) {
+    engine->done_cb(op, engine->user);
+  }
+}
+
+swift_error
+swift_engine_create(struct swift_engine **engine,
+    struct swift_context *context, swift_socket_callback socket_cb,
+    swift_timer_callback timer_cb, swift_done_callback done_cb, void *user) {
+
+  struct swift_engine *l_engine;
+
+  if (!engine || !context || !socket_cb || !timer_cb) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  l_engine = (struct swift_engine *)malloc(sizeof(struct swift_engine));
+  if (!l_engine) {
+    return SWIFT_ERROR_MEMORY;
+  }
+  memset(l_engine, 0, sizeof(struct swift_engine));
+
+  l_engine->multi = curl_multi_init();
+  if (!l_engine->multi) {
+    free(l_engine);
+    return SWIFT_ERROR_MEMORY;
+  }
+
+  l_engine->context = context;
+  l_engine->socket_cb = socket_cb;
+  l_engine->timer_cb = timer_cb;
+  l_engine->done_cb = done_cb;
+  l_engine->user = user;
+
+  swift_multi_configure(context, l_engine->multi);
+  curl_multi_setopt(l_engine->multi, CURLMOPT_SOCKETFUNCTION,
+      swift_engine_socket);
+  curl_multi_setopt(l_engine->multi, CURLMOPT_SOCKETDATA, l_engine);
+  curl_multi_setopt(l_engine->multi, CURLMOPT_TIMERFUNCTION,
+      swift_engine_timer);
+  curl_multi_setopt(l_engine->multi, CURLMOPT_TIMERDATA, l_engine);
+
+  *engine = l_engine;
+  return SWIFT_SUCCESS;
+}
+
+void
+swift_engine_delete(struct swift_engine **engine) {
+
+  struct swift_multi_op *op;
+
+  if (!engine || !*engine) {
+    return;
+  }
+
+  while ((*engine)->n_ops) {
+    op = (*engine)->ops[--(*engine)->n_ops];
+    curl_multi_remove_handle((*engine)->multi, op->curlhandle);
+    curl_slist_free_all(op->headers);
+    op->headers = NULL;
+    swift_handle_put(op->context, op->curlhandle);
+    op->curlhandle = NULL;
+    op->retval = SWIFT_ERROR_INTERNAL;
+    op->done = 1;
+  }
+
+  curl_multi_cleanup((*engine)->multi);
+  free((*engine)->ops);
+  free(*engine);
+  *engine = NULL;
+}
+
+/* Authentication, when the context has no token yet, still blocks */
+swift_error
+swift_engine_add(struct swift_engine *engine, struct swift_multi_op *op) {
+
+  struct swift_multi_op **newops;
+  swift_error s_err;
+
+  if (!engine || !op) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if (engine->n_ops == engine->ops_size) {
+    newops = (struct swift_multi_op **)realloc(engine->ops,
+        sizeof(struct swift_multi_op *) * (engine->ops_size * 2 + 16));
+    if (!newops) {
+      return SWIFT_ERROR_MEMORY;
+    }
+    engine->ops = newops;
+    engine->ops_size = engine->ops_size * 2 + 16;
+  }
+
+  op->deadline_at = swift_deadline_at(op->context, op->deadline);
+  if ( (s_err = swift_ensure_auth(op->context, op->deadline_at)) ||
+      (s_err = swift_multi_setup(op)) ) {
+    return s_err;
+  }
+
+  op->done = 0;
+  engine->ops[engine->n_ops++] = op;
+  curl_multi_add_handle(engine->multi, op->curlhandle);
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_engine_action(struct swift_engine *engine, int fd, int events,
+    unsigned int *n_running) {
+
+  int curl_events = 0;
+  int n_transfers;
+
+  if (!engine) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if (events & SWIFT_POLL_IN) {
+    curl_events |= CURL_CSELECT_IN;
+  }
+  if (events & SWIFT_POLL_OUT) {
+    curl_events |= CURL_CSELECT_OUT;
+  }
+
+  if (curl_multi_socket_action(engine->multi,
+        fd == SWIFT_SOCKET_TIMEOUT ? CURL_SOCKET_TIMEOUT : fd, curl_events,
+        &n_transfers) != CURLM_OK) {
+    return SWIFT_ERROR_INTERNAL;
+  }
+  swift_multi_collect(engine->multi, NULL, swift_engine_done, engine);
+
+  if (n_running) {
+    *n_running = engine->n_ops;
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+swift_error
+swift_async_create(struct swift_async **async, struct swift_context *context) {
+
+  struct swift_async *l_async;
+
+  if (!async || !context) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  l_async = (struct swift_async *)malloc(sizeof(struct swift_async));
+  if (!l_async) {
+    return SWIFT_ERROR_MEMORY;
+  }
+  memset(l_async, 0, sizeof(struct swift_async));
+
+  l_async->multi = curl_multi_init();
+  if (!l_async->multi) {
+    free(l_async);
+    return SWIFT_ERROR_MEMORY;
+  }
+  l_async->context = context;
+  swift_multi_configure(context, l_async->multi);
+
+  *async = l_async;
+  return SWIFT_SUCCESS;
+}
+
+void
+swift_async_delete(struct swift_async **async) {
+
+  struct swift_async_op *op;
+
+  if (!async || !*async) {
+    return;
+  }
+
+  while ( (op = (*async)->running) ) {
+    (*async)->running = op->next;
+    curl_multi_remove_handle((*async)->multi, op->request->curlhandle);
+    curl_slist_free_all(op->headers);
+    op->headers = NULL;
+    /* Listings are the only requests with a buffer of their own */
+    if (op->request->state == SWIFT_STATE_CONTAINERLIST ||
+        op->request->state == SWIFT_STATE_OBJECTLIST) {
+      free(op->request->buffer);
+    }
+    swift_request_free(op->request);
+    free(op->request);
+    op->request = NULL;
+    op->retval = SWIFT_ERROR_INTERNAL;
+    op->done = 1;
+  }
+
+  curl_multi_cleanup((*async)->multi);
+  free(*async);
+  *async = NULL;
+}
+
+/* Give op a request of its own for one of the _setup functions to fill
+ * in */
+STATIC swift_error
+swift_async_begin(struct swift_async *async, struct swift_async_op *op,
+    swift_async_callback callback, void *user) {
+
+  swift_error s_err;
+
+  if (!async || !op) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  memset(op, 0, sizeof(struct swift_async_op));
+  op->callback = callback;
+  op->userdata = user;
+
+  op->request = (struct swift_request *)malloc(sizeof(struct swift_request));
+  if (!op->request) {
+    return SWIFT_ERROR_MEMORY;
+  }
+  if ( (s_err = swift_request_init(op->request, async->context)) ||
+      (s_err = swift_ensure_auth(async->context, op->request->deadline_at)) ) {
+    if (op->request->curlhandle) {
+      swift_request_free(op->request);
+    }
+    free(op->request);
+    op->request = NULL;
+    return s_err;
+  }
+
+  return SWIFT_SUCCESS;
+}
+
+/* Start the request set up for op, or drop it when setting it up failed */
+STATIC swift_error
+swift_async_submit(struct swift_async *async, struct swift_async_op *op,
+    swift_error s_err) {
+
+  CURL *handle = op->request->curlhandle;
+
+  if (!s_err) {
+    s_err = swift_set_timeouts(handle, async->context,
+        op->request->deadline_at);
+  }
+  if (s_err) {
+    swift_request_free(op->request);
+    free(op->request);
+    op->request = NULL;
+    return s_err;
+  }
+
+  curl_easy_setopt(handle, CURLOPT_PRIVATE, op);
+  /* Wait for a stream on a connection being set up rather than open
+   * another */
+  if (async->context->http2 >= SWIFT_HTTP2) {
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+  }
+  op->headers = swift_request_headers(op->request);
+
+  op->prev = NULL;
+  op->next = async->running;
+  if (async->running) {
+    async->running->prev = op;
+  }
+  async->running = op;
+  ++async->n_running;
+
+  curl_multi_add_handle(async->multi, handle);
+
+  return SWIFT_SUCCESS;
+}
+
+/* Work out what the request of a finished op came to, the way its
+ * synchronous namesake would, and pass the op on */
+STATIC void
+swift_async_finish(struct swift_async *async, struct swift_async_op *op,
+    long response) {
+
+  struct swift_request *request = op->request;
+
+  op->retval = swift_request_error(request, response);
+
+  switch (request->state) {
+    case SWIFT_STATE_CONTAINERLIST:
+    case SWIFT_STATE_OBJECTLIST: /*Fallthrough */
+      if (op->retval) {
+        free(request->buffer);
+        break;
+      }
+      /* The list takes over the buffer */
+      op->n_entries = swift_list_entries(request->buffer);
+      swift_string_to_list(request->buffer, op->n_entries, &op->contents);
+      break;
+    case SWIFT_STATE_OBJECT_EXISTS:
+      /* Callers want the size of the data, not what is stored */
+      if (request->compressed && request->uncompressed_length) {
+        op->length = request->uncompressed_length;
+      } else {
+        op->length = request->obj_length;
+      }
+      break;
+    case SWIFT_STATE_OBJECT_READ:
+      op->length = request->buffer_pos;
+      /*Fallthrough */
+    case SWIFT_STATE_OBJECT_WRITE:
+      if (!op->retval && request->checksum) {
+        op->retval = swift_md5_verify(&request->md5, request->etag);
+      }
+      break;
+    default:
+      break;
+  }
+
+  swift_request_free(request);
+  free(request);
+  op->request = NULL;
+  op->done = 1;
+
+  if (op->callback) {
+    op->callback(op, op->userdata);
+    return;
+  }
+
+  op->next = NULL;
+  if (async->queue_tail) {
+    async->queue_tail->next = op;
+  } else {
+    async->queue_head = op;
+  }
+  async->queue_tail = op;
+}
+
+/* Finish the ops curl is done with, sending those turned away with a 401
+ * once more with a new token.  Returns how many finished */
+STATIC unsigned int
+swift_async_collect(struct swift_async *async) {
+
+  struct swift_async_op *op;
+  struct CURLMsg *curl_msg;
+  int n_msgs;
+  long response;
+  unsigned int n_done = 0;
+
+  while ((curl_msg = curl_multi_info_read(async->multi, &n_msgs)) != NULL) {
+    if (curl_msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+
+    curl_easy_getinfo(curl_msg->easy_handle, CURLINFO_PRIVATE, &op);
+    curl_easy_getinfo(curl_msg->easy_handle, CURLINFO_RESPONSE_CODE,
+        &response);
+    if (swift_transport_failure(curl_msg->data.result)) {
+      op->request->failure = swift_failure(curl_msg->easy_handle,
+          curl_msg->data.result, op->request->deadline_at);
+    }
+    curl_multi_remove_handle(async->multi, curl_msg->easy_handle);
+    curl_slist_free_all(op->headers);
+    op->headers = NULL;
+
+    if (response == 401 && !op->replayed &&
+        swift_request_rewind(op->request) &&
+        !swift_reauthenticate(async->context, op->request->auth_generation,
+          op->request->deadline_at) &&
+        !swift_set_timeouts(curl_msg->easy_handle, async->context,
+          op->request->deadline_at)) {
+      op->replayed = 1;
+      op->headers = swift_request_headers(op->request);
+      curl_multi_add_handle(async->multi, curl_msg->easy_handle);
+      continue;
+    }
+
+    if (op->prev) {
+      op->prev->next = op->next;
+    } else {
+      async->running = op->next;
+    }
+    if (op->next) {
+      op->next->prev = op->prev;
+    }
+    --async->n_running;
+
+    swift_async_finish(async, op, response);
+    ++n_done;
+  }
+
+  return n_done;
+}
+
+swift_error
+swift_async_node_list(struct swift_async *async, struct swift_async_op *op,
+    const char *path, swift_async_callback callback, void *user) {
+
+  swift_error s_err;
+
+  if ( (s_err = swift_async_begin(async, op, callback, user)) ) {
+    return s_err;
+  }
+
+  return swift_async_submit(async, op,
+      swift_node_list_setup(op->request, path));
+}
+
+swift_error
+swift_async_container_create(struct swift_async *async,
+    struct swift_async_op *op, const char *container,
+    swift_async_callback callback, void *user) {
+
+  swift_error s_err;
+
+  if ( (s_err = swift_async_begin(async, op, callback, user)) ) {
+    return s_err;
+  }
+
+  return swift_async_submit(async, op,
+      swift_container_create_setup(op->request, container));
+}
+
+swift_error
+swift_async_container_delete(struct swift_async *async,
+    struct swift_async_op *op, const char *container,
+    swift_async_callback callback, void *user) {
+
+  swift_error s_err;
+
+  if ( (s_err = swift_async_begin(async, op, callback, user)) ) {
+    return s_err;
+  }
+
+  return swift_async_submit(async, op,
+      swift_container_delete_setup(op->request, container));
+}
+
+swift_error
+swift_async_object_exists(struct swift_async *async,
+    struct swift_async_op *op, const char *container, const char *object,
+    swift_async_callback callback, void *user) {
+
+  swift_error s_err;
+
+  if ( (s_err = swift_async_begin(async, op, callback, user)) ) {
+    return s_err;
+  }
+
+  return swift_async_submit(async, op,
+      swift_object_exists_setup(op->request, container, object));
+}
+
+swift_error
+swift_async_object_delete(struct swift_async *async,
+    struct swift_async_op *op, const char *container, const char *object,
+    swift_async_callback callback, void *user) {
+
+  swift_error s_err;
+
+  if ( (s_err = swift_async_begin(async, op, callback, user)) ) {
+    return s_err;
+  }
+
+  return swift_async_submit(async, op,
+      swift_object_delete_setup(op->request, container, object));
+}
+
+/* Unlike swift_object_get() there is no HEAD first, the body is read
+ * straight into data and cut off at maxlen */
+swift_error
+swift_async_object_get(struct swift_async *async, struct swift_async_op *op,
+    const char *container, const char *object, void *data, size_t maxlen,
+    swift_async_callback callback, void *user) {
+
+  struct swift_transfer_handle handle;
+  swift_error s_err;
+
+  if (!data) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_async_begin(async, op, callback, user)) ) {
+    return s_err;
+  }
+
+  memset(&handle, 0, sizeof(handle));
+  handle.container = (char *)container;
+  handle.object = (char *)object;
+  handle.mode = SWIFT_READ;
+  handle.parent = async->context;
+  handle.length = maxlen;
+  handle.ptr = data;
+
+  return swift_async_submit(async, op, swift_sync_setup(&handle, op->request));
+}
+
+swift_error
+swift_async_object_put(struct swift_async *async, struct swift_async_op *op,
+    const char *container, const char *object, const void *data,
+    size_t length, swift_async_callback callback, void *user) {
+
+  struct swift_transfer_handle handle;
+  swift_error s_err;
+
+  if (!data) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
 
-  return SWIFT_SUCCESS;
+  if ( (s_err = swift_async_begin(async, op, callback, user)) ) {
+    return s_err;
+  }
 
+  memset(&handle, 0, sizeof(handle));
+  handle.container = (char *)container;
+  handle.object = (char *)object;
+  handle.mode = SWIFT_WRITE;
+  handle.parent = async->context;
+  handle.length = length;
+  handle.ptr = (void *)data;
+
+  return swift_async_submit(async, op, swift_sync_setup(&handle, op->request));
 }
 
 swift_error
-swift_container_exists(struct swift_context *context, const char *container) {
+swift_async_wait(struct swift_async *async, long timeout_ms,
+    unsigned int *n_running) {
 
-  char **contents = NULL;
-  int n_entries;
+  int n_transfers;
 
-  char *temp = (char *)malloc(strlen(container) + 2);
-  if (!temp) {
-    return SWIFT_ERROR_MEMORY;
+  if (!async) {
+    return SWIFT_ERROR_NOTFOUND;
   }
-  strcpy(temp + 1, container);
-  temp[0] = '/';
 
-  swift_error e = swift_node_list(context, temp, &n_entries, &contents);
-  free(temp);
-  if (!e) {
-    swift_node_list_free(&contents);
+  if (curl_multi_perform(async->multi, &n_transfers) != CURLM_OK) {
+    return SWIFT_ERROR_INTERNAL;
   }
-  return e;
+
+  /* Sleep only when there is nothing to report yet */
+  if (!swift_async_collect(async) && async->n_running && timeout_ms > 0) {
+    curl_multi_wait(async->multi, NULL, 0, timeout_ms, NULL);
+    curl_multi_perform(async->multi, &n_transfers);
+    swift_async_collect(async);
+  }
+
+  if (n_running) {
+    *n_running = async->n_running;
+  }
+
+  return SWIFT_SUCCESS;
 }
 
-STATIC swift_error
-swift_container_create_setup(struct swift_context *context, const char *container) {
+swift_error
+swift_async_next(struct swift_async *async, long timeout_ms,
+    struct swift_async_op **op) {
 
-  char *url;
+  swift_error s_err;
 
-  if (!context || !container) {
+  if (!async || !op) {
     return SWIFT_ERROR_NOTFOUND;
   }
- 
-  url = (char *)malloc(strlen(container) + strlen(context->authurl) + 2);
-  if (!url) {
-    return SWIFT_ERROR_MEMORY;
+
+  *op = NULL;
+  if (!async->queue_head) {
+    do {
+      if ( (s_err = swift_async_wait(async, timeout_ms < 0 ? 1000 : timeout_ms,
+              NULL)) ) {
+        return s_err;
+      }
+    } while (timeout_ms < 0 && !async->queue_head && async->n_running);
+  }
+
+  if (!async->queue_head) {
+    return SWIFT_ERROR_NOTFOUND;
   }
-  sprintf(url, "%s/%s", context->authurl, container); 
-  context->state = SWIFT_STATE_CONTAINER_CREATE;
-  curl_easy_reset(context->curlhandle);
-  curl_easy_setopt(context->curlhandle, CURLOPT_URL, url);
-  curl_easy_setopt(context->curlhandle, CURLOPT_CUSTOMREQUEST, "PUT"); 
 
+  *op = async->queue_head;
+  async->queue_head = (*op)->next;
+  if (!async->queue_head) {
+    async->queue_tail = NULL;
+  }
+  (*op)->next = NULL;
 
   return SWIFT_SUCCESS;
 }
 
+/* Ask for the page after marker into the slot page */
+STATIC swift_error
+swift_listing_fetch(struct swift_listing *listing, int page,
+    const char *marker) {
 
-swift_error
-swift_container_create(struct swift_context * context, const char *container) {
-
-  int response;
+  struct swift_async_op *op = &listing->pages[page];
   swift_error s_err;
-  
-  if (!context->valid_auth) {
-    if ( (s_err = swift_authenticate(context)) ) {
-      return s_err;
-    }
+  int n_transfers;
+
+  if ( (s_err = swift_async_begin(listing->async, op, NULL, NULL)) ) {
+    return s_err;
+  }
+  if ( (s_err = swift_async_submit(listing->async, op,
+          swift_node_page_setup(op->request, listing->path, marker,
+            listing->limit))) ) {
+    return s_err;
   }
+  listing->fetching = page;
 
-  swift_container_create_setup(context, container);
-  response = swift_perform(context);
+  /* Send the request now, the answer can wait in the socket until the
+   * page is needed */
+  curl_multi_perform(listing->async->multi, &n_transfers);
 
-  return swift_response(response);
+  return SWIFT_SUCCESS;
 }
 
-STATIC swift_error
-swift_container_delete_setup(struct swift_context *context, const char *container) {
+swift_error
+swift_listing_create(struct swift_listing **listing,
+    struct swift_context *context, const char *path, const char *marker,
+    unsigned int limit) {
 
-  char *url;
+  struct swift_listing *l_listing;
+  swift_error s_err;
 
-  if (!context || !container) {
+  if (!listing || !context || !path) {
     return SWIFT_ERROR_NOTFOUND;
-  }                                                                     
-
-  if (strcmp("", container) == 0) {
-    return SWIFT_ERROR_EXISTS;
   }
 
-  url = (char *)malloc(strlen(container) + strlen(context->authurl) + 2);
-  if (!url) {
+  l_listing = (struct swift_listing *)malloc(sizeof(struct swift_listing));
+  if (!l_listing) {
     return SWIFT_ERROR_MEMORY;
   }
-  sprintf(url, "%s/%s", context->authurl, container); 
-  context->state = SWIFT_STATE_CONTAINER_DELETE;
-  curl_easy_reset(context->curlhandle);
-  curl_easy_setopt(context->curlhandle, CURLOPT_URL, url);
-  curl_easy_setopt(context->curlhandle, CURLOPT_CUSTOMREQUEST, "DELETE");  
-
-  free(url);
+  memset(l_listing, 0, sizeof(struct swift_listing));
+  l_listing->limit = limit ? limit : SWIFT_LISTING_LIMIT;
+  l_listing->current = -1;
+  l_listing->fetching = -1;
+
+  l_listing->path = strdup(path);
+  if (!l_listing->path) {
+    s_err = SWIFT_ERROR_MEMORY;
+  } else if (!(s_err = swift_async_create(&l_listing->async, context))) {
+    s_err = swift_listing_fetch(l_listing, 0, marker);
+  }
+  if (s_err) {
+    swift_listing_delete(&l_listing);
+    return s_err;
+  }
 
+  *listing = l_listing;
   return SWIFT_SUCCESS;
 }
 
-
 swift_error
-swift_container_delete(struct swift_context * context, const char *container) {
-                                                                               
-  int response;
+swift_listing_next(struct swift_listing *listing, const char **name) {
+
+  struct swift_async_op *page;
+  struct swift_async_op *op;
   swift_error s_err;
-  
-  if (!context->valid_auth) {
-    if ( (s_err = swift_authenticate(context)) ) {
+  int n_transfers;
+
+  if (!listing || !name) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+  *name = NULL;
+
+  /* Pages can come back empty, go on until one has a name or the walk
+   * ends */
+  for (;;) {
+    if (listing->current >= 0) {
+      page = &listing->pages[listing->current];
+      if (listing->pos < page->n_entries) {
+        /* Keep the next page moving while this one is worked through */
+        if (listing->fetching >= 0 && listing->pos % 64 == 0) {
+          curl_multi_perform(listing->async->multi, &n_transfers);
+        }
+        *name = page->contents[listing->pos++];
+        return SWIFT_SUCCESS;
+      }
+      swift_node_list_free(&page->contents);
+      listing->current = -1;
+    }
+
+    if (listing->failure) {
+      return listing->failure;
+    }
+    if (listing->fetching < 0) {
+      return SWIFT_ERROR_NOTFOUND;
+    }
+
+    if ( (s_err = swift_async_next(listing->async, -1, &op)) ) {
+      listing->failure = s_err;
       return s_err;
     }
-  }
+    listing->current = listing->fetching;
+    listing->fetching = -1;
+    listing->pos = 0;
+    if (op->retval) {
+      listing->failure = op->retval;
+      return op->retval;
+    }
 
-  if ( (s_err = swift_container_delete_setup(context, container)) ) {
-    return s_err;
+    /* A short page is the last, otherwise the next starts after the last
+     * name of this one.  Failing to ask for it ends the walk after this
+     * page */
+    if ((unsigned int)op->n_entries >= listing->limit) {
+      listing->failure = swift_listing_fetch(listing, !listing->current,
+          op->contents[op->n_entries - 1]);
+    }
   }
+}
 
-  response = swift_perform(context);
+void
+swift_listing_delete(struct swift_listing **listing) {
 
-  return swift_response(response);
+  if (!listing || !*listing) {
+    return;
+  }
+
+  /* Drops the page in flight, if any */
+  swift_async_delete(&(*listing)->async);
+  swift_node_list_free(&(*listing)->pages[0].contents);
+  swift_node_list_free(&(*listing)->pages[1].contents);
+  free((*listing)->path);
+  free(*listing);
+  *listing = NULL;
 }
 
-STATIC swift_error
-swift_object_exists_setup(struct swift_context *context, const char *container,
-    const char *object) {
+STATIC size_t
+swift_range_dest_callback(void *data, size_t len, void *user) {
 
-  char *url;
+  struct swift_range_dest *dest = (struct swift_range_dest *)user;
 
-  if (!context || !container || !object) {
-    return SWIFT_ERROR_NOTFOUND;
+  if (dest->pos + len > dest->end) {
+    return 0;
   }
 
-  url = (char *)malloc(strlen(container) + strlen(context->authurl) +
-      strlen(object) + 3);
-  if (!url) {
-    return SWIFT_ERROR_MEMORY;
+  memcpy(dest->ptr + dest->pos, data, len);
+  dest->pos += len;
+
+  return len;
+}
+
+STATIC size_t
+swift_range_source_callback(void *data, size_t len, void *user) {
+
+  struct swift_range_dest *source = (struct swift_range_dest *)user;
+
+  if (len > source->end - source->pos) {
+    len = source->end - source->pos;
   }
-  sprintf(url, "%s/%s/%s", context->authurl, container, object); 
-  context->state = SWIFT_STATE_OBJECT_EXISTS;
-  curl_easy_reset(context->curlhandle);
-  curl_easy_setopt(context->curlhandle, CURLOPT_URL, url);
-  curl_easy_setopt(context->curlhandle, CURLOPT_NOBODY, 1);
 
-  free(url);
+  memcpy(data, source->ptr + source->pos, len);
+  source->pos += len;
 
-  return SWIFT_SUCCESS;
+  return len;
 }
 
+/* Start a range over before it is sent again */
+STATIC int
+swift_range_rewind(void *user) {
+
+  struct swift_range_dest *dest = (struct swift_range_dest *)user;
 
+  dest->pos = dest->start;
+  return 1;
+}
 
+/* Start the next range in a free slot */
+STATIC struct swift_multi_op *
+swift_range_next(void *user) {
 
-swift_error
-swift_object_exists(struct swift_context *context, const char *container,
-    const char *object, size_t *length) {
-                                                                                
-  int response;
-  swift_error s_err;
-  
-  if (!context->valid_auth) {
-    if ( (s_err = swift_authenticate(context)) ) {
-      return s_err;
-    }
-  }
+  struct swift_range_window *window = (struct swift_range_window *)user;
+  struct swift_multi_op *op;
+  struct swift_range_dest *dest;
+  unsigned int slot;
 
-  if ( (s_err = swift_object_exists_setup(context, container, object)) ) {
-    return s_err;
+  if (window->s_err || window->pos >= window->length || !window->n_free) {
+    return NULL;
   }
 
-  response = swift_perform(context);
+  slot = window->free_slots[--window->n_free];
+  op = &window->ops[slot];
+  dest = &window->dests[slot];
+
+  /* Object bytes from offset onwards land at the start of data */
+  dest->ptr = window->data;
+  dest->start = window->pos;
+  dest->pos = window->pos;
+  dest->end = (window->length - window->pos > window->range_size) ?
+    window->pos + window->range_size : window->length;
+
+  swift_load_op(op, window->context, window->container, window->object,
+      SWIFT_READ, swift_range_dest_callback, dest);
+  op->offset = window->offset + window->pos;
+  op->length = dest->end - window->pos;
+  op->rewind = swift_range_rewind;
+  window->pos = dest->end;
+
+  return op;
+}
+
+STATIC void
+swift_range_done(struct swift_multi_op *op, void *user) {
+
+  struct swift_range_window *window = (struct swift_range_window *)user;
+  unsigned int slot = op - window->ops;
 
-  *length = context->obj_length;
+  if (!window->s_err) {
+    if (op->retval) {
+      window->s_err = op->retval;
+    } else if (window->dests[slot].pos != window->dests[slot].end) {
+      window->s_err = SWIFT_ERROR_UNKNOWN;
+    }
+  }
 
-  return swift_response(response);;
+  window->free_slots[window->n_free++] = slot;
 }
 
 STATIC swift_error
-swift_object_delete_setup(struct swift_context *context, const char *container,
-    const char *object) {
+swift_get_ranges(struct swift_context *c, const char *container,
+    const char *object, void *data, size_t offset, size_t length,
+    size_t range_size, unsigned int parallelism) {
 
-  char *url;
+  struct swift_range_window window;
+  swift_error s_err;
+  unsigned int slot;
 
-  if (!context || !container || !object) {
-    return SWIFT_ERROR_NOTFOUND;
+  if (!range_size) {
+    range_size = SWIFT_PARALLEL_RANGE;
+  }
+  if (!parallelism) {
+    parallelism = SWIFT_PARALLEL_STREAMS;
   }
 
-  url = (char *)malloc(strlen(container) + strlen(context->authurl) +
-      strlen(object) + 3);
-  if (!url) {
+  memset(&window, 0, sizeof(window));
+  window.context = c;
+  window.container = container;
+  window.object = object;
+  window.data = (char *)data;
+  window.offset = offset;
+  window.length = length;
+  window.range_size = range_size;
+
+  window.ops = (struct swift_multi_op *)malloc(sizeof(struct swift_multi_op) *
+      parallelism);
+  window.dests = (struct swift_range_dest *)malloc(
+      sizeof(struct swift_range_dest) * parallelism);
+  window.free_slots = (unsigned int *)malloc(sizeof(unsigned int) *
+      parallelism);
+  if (!window.ops || !window.dests || !window.free_slots) {
+    free(window.ops);
+    free(window.dests);
+    free(window.free_slots);
     return SWIFT_ERROR_MEMORY;
   }
+  for (slot = 0; slot < parallelism; ++slot) {
+    window.free_slots[window.n_free++] = slot;
+  }
 
-  sprintf(url, "%s/%s/%s", context->authurl, container, object); 
-  context->state = SWIFT_STATE_OBJECT_DELETE;
-  curl_easy_reset(context->curlhandle);
-  curl_easy_setopt(context->curlhandle, CURLOPT_URL, url);
-  curl_easy_setopt(context->curlhandle, CURLOPT_CUSTOMREQUEST, "DELETE");
-  free(url);
+  /* A new range starts as soon as any one finishes, a slow range does not
+   * hold up the rest */
+  s_err = swift_multi_run(c, parallelism, swift_range_next, swift_range_done,
+      &window);
+  if (!s_err) {
+    s_err = window.s_err;
+  }
 
-  return SWIFT_SUCCESS;
+  free(window.ops);
+  free(window.dests);
+  free(window.free_slots);
+
+  return s_err;
 }
 
 swift_error
-swift_object_delete(struct swift_context *context, const char *container,
-    const char *object) {
+swift_object_get_parallel(struct swift_context *c, const char *container,
+    const char *object, void *data, size_t maxlen, size_t range_size,
+    unsigned int parallelism) {
 
-  int response;
   swift_error s_err;
+  size_t length;
 
-  if (!context->valid_auth) {
-    if ( (s_err = swift_authenticate(context)) ) {
-      return s_err;
-    }
+  if (!data || !object || !container || !c) {
+    return SWIFT_ERROR_NOTFOUND;
+  }
+
+  if ( (s_err = swift_object_range_length(c, container, object, &length)) ) {
+    return s_err;
+  }
+
+  return swift_get_ranges(c, container, object, data, 0,
+      (length > maxlen) ? maxlen : length, range_size, parallelism);
+}
+
+swift_error
+swift_object_get_parallel_path(struct swift_context *c, const char *container,
+    const char *object, const char *path, size_t range_size,
+    unsigned int parallelism) {
+
+  swift_error s_err;
+  size_t length;
+  void *map;
+  int fd;
+
+  if (!object || !container || !c || !path) {
+    return SWIFT_ERROR_NOTFOUND;
   }
 
-  if ( (s_err = swift_object_delete_setup(context, container, object)) ) {
+  if ( (s_err = swift_object_range_length(c, container, object, &length)) ) {
     return s_err;
   }
 
-  response = swift_perform(context);
+  if ( (s_err = swift_map_file(path, length, &fd, &map)) ) {
+    return s_err;
+  }
+
+  if (length) {
+    s_err = swift_get_ranges(c, container, object, map, 0, length,
+        range_size, parallelism);
+    munmap(map, length);
+  }
+
+  close(fd);
+  if (s_err) {
+    unlink(path);
+  }
 
-  return swift_response(response);;
+  return s_err;
 }
 
-void
-swift_free_transfer_handle(struct swift_transfer_handle **handle) {
+STATIC void
+swift_json_escape(char *out, const char *in) {
+
+  for (; *in; ++in) {
+    if (*in == '"' || *in == '\\') {
+      *out++ = '\\';
+      *out++ = *in;
+    } else if ((unsigned char)*in < 0x20) {
+      sprintf(out, "\\u%04x", (unsigned char)*in);
+      out += 6;
+    } else {
+      *out++ = *in;
+    }
+  }
+  *out = '\0';
+}
 
-  struct swift_transfer_handle *l_handle;
+STATIC char *
+swift_slo_manifest(const char *segment_container, const char *prefix,
+    struct swift_slo_segment *segments, unsigned int n_segments) {
+
+  char *manifest;
+  char *pos;
+  char *path;
+  unsigned int cur_segment;
+
+  /* Worst case every character of the path needs a \u escape */
+  path = (char *)malloc(6 * (strlen(segment_container) + strlen(prefix)) + 16);
+  manifest = (char *)malloc(n_segments *
+      (6 * (strlen(segment_container) + strlen(prefix)) + 128) + 3);
+  if (!path || !manifest) {
+    free(path);
+    free(manifest);
+    return NULL;
+  }
 
-  if (!handle || !*handle)
-    return;
+  pos = manifest;
+  *pos++ = '[';
+  for (cur_segment = 0; cur_segment < n_segments; ++cur_segment) {
+    swift_json_escape(path, segment_container);
+    pos += sprintf(pos, "%s{\"path\": \"/%s/", cur_segment ? ", " : "", path);
+    swift_json_escape(path, prefix);
+    pos += sprintf(pos, "%s%08u\", ", path, cur_segment);
+    if (segments[cur_segment].etag[0]) {
+      pos += sprintf(pos, "\"etag\": \"%s\", ", segments[cur_segment].etag);
+    } else {
+      pos += sprintf(pos, "\"etag\": null, ");
+    }
+    pos += sprintf(pos, "\"size_bytes\": %lu}",
+        (unsigned long)segments[cur_segment].size);
+  }
+  strcpy(pos, "]");
 
-  l_handle = *handle;
-  free(l_handle->ptr);
-  free(l_handle->object);
-  free(l_handle->container);
-  free(l_handle);
-  l_handle = NULL;
-  *handle = NULL;
+  free(path);
+  return manifest;
 }
-  
 
-STATIC swift_error
-swift_create_transfer_handle(struct swift_context *context, const char *container, 
-    const char *object, struct swift_transfer_handle **handle, size_t length) {
+STATIC unsigned int
+swift_checkpoint_load(const char *path, const char *header, const char *name,
+    struct swift_slo_segment *segments, unsigned int n_segments) {
 
-  struct swift_transfer_handle *l_handle;
+  FILE *fp;
+  char line[256];
+  char etag[64];
+  unsigned int index;
+  unsigned long size;
+  unsigned int n_loaded = 0;
+  char *namebuf;
 
-  if ( !context || !container || !object ||
-      !handle) {
-    return SWIFT_ERROR_NOTFOUND;
+  fp = fopen(path, "r");
+  if (!fp) {
+    return 0;
   }
 
-  *handle = (struct swift_transfer_handle *)
-    malloc(sizeof(struct swift_transfer_handle));
+  namebuf = (char *)malloc(strlen(name) + 2);
+  if (!namebuf) {
+    fclose(fp);
+    return 0;
+  }
 
-  if (!*handle) {
-    return SWIFT_ERROR_MEMORY;
+  line[0] = '\0';
+  namebuf[0] = '\0';
+  fgets(line, sizeof(line), fp);
+  fgets(namebuf, strlen(name) + 2, fp);
+  swift_chomp(line);
+  swift_chomp(namebuf);
+
+  /* A checkpoint for some other upload is worthless */
+  if (strcmp(line, header) != 0 || strcmp(namebuf, name) != 0) {
+    free(namebuf);
+    fclose(fp);
+    return 0;
   }
+  free(namebuf);
 
-  /*Set up the various entries in the handle, starting with the path */
-  l_handle = *handle;
-  l_handle->container = (char *)malloc(strlen(container) + 1);
-  if (!l_handle->container) {
-    swift_free_transfer_handle(handle);
-    return SWIFT_ERROR_MEMORY;
+  while (fgets(line, sizeof(line), fp)) {
+    if (sscanf(line, "%u %lu %63s", &index, &size, etag) != 3) {
+      continue;
+    }
+    if (index >= n_segments || size != segments[index].size ||
+        segments[index].done) {
+      continue;
+    }
+    strcpy(segments[index].etag, strcmp(etag, "-") ? etag : "");
+    segments[index].done = 1;
+    ++n_loaded;
   }
 
-  l_handle->object = (char *)malloc(strlen(object) + 1);
-  if (!l_handle->object) {
-    swift_free_transfer_handle(handle);
-    return SWIFT_ERROR_MEMORY;
+  fclose(fp);
+  return n_loaded;
+}
+
+STATIC void
+swift_checkpoint_add(FILE *fp, unsigned int index,
+    struct swift_slo_segment *segment) {
+
+  fprintf(fp, "%u %lu %s\n", index, (unsigned long)segment->size,
+      segment->etag[0] ? segment->etag : "-");
+}
+
+STATIC FILE *
+swift_checkpoint_create(const char *path, const char *header, const char *name,
+    struct swift_slo_segment *segments, unsigned int n_segments) {
+
+  FILE *fp;
+  unsigned int cur_segment;
+
+  /* Rewrite from scratch so stale or foreign entries are dropped */
+  fp = fopen(path, "w");
+  if (!fp) {
+    return NULL;
+  }
+
+  fprintf(fp, "%s\n%s\n", header, name);
+  for (cur_segment = 0; cur_segment < n_segments; ++cur_segment) {
+    if (segments[cur_segment].done) {
+      swift_checkpoint_add(fp, cur_segment, &segments[cur_segment]);
+    }
+  }
+  fflush(fp);
+
+  return fp;
+}
+
+/* Start the next segment not already uploaded in a free slot */
+STATIC struct swift_multi_op *
+swift_segment_next(void *user) {
+
+  struct swift_segment_window *window = (struct swift_segment_window *)user;
+  struct swift_multi_op *op;
+  struct swift_range_dest *source;
+  unsigned int slot;
+
+  while (window->next_segment < window->n_segments &&
+      window->segments[window->next_segment].done) {
+    ++window->next_segment;
+  }
+  if (window->s_err || window->next_segment == window->n_segments ||
+      !window->n_free) {
+    return NULL;
+  }
+
+  slot = window->free_slots[--window->n_free];
+  op = &window->ops[slot];
+  source = &window->sources[slot];
+
+  source->ptr = (char *)window->data;
+  source->start = (size_t)window->next_segment * window->segment_size;
+  source->pos = source->start;
+  source->end = source->pos + window->segments[window->next_segment].size;
+
+  sprintf(window->segname, "%s%08u", window->prefix, window->next_segment);
+  swift_load_op(op, window->context, window->segment_container,
+      window->segname, SWIFT_WRITE, swift_range_source_callback, source);
+  op->length = window->segments[window->next_segment].size;
+  op->rewind = swift_range_rewind;
+  window->op_segments[slot] = window->next_segment++;
+
+  return op;
+}
+
+/* Record every segment that made it, even once others have failed */
+STATIC void
+swift_segment_done(struct swift_multi_op *op, void *user) {
+
+  struct swift_segment_window *window = (struct swift_segment_window *)user;
+  unsigned int slot = op - window->ops;
+  struct swift_slo_segment *segment =
+    &window->segments[window->op_segments[slot]];
+
+  window->free_slots[window->n_free++] = slot;
+
+  if (op->retval) {
+    if (!window->s_err) {
+      window->s_err = op->retval;
+    }
+    return;
+  }
+
+  strcpy(segment->etag, op->etag);
+  segment->done = 1;
+  if (window->cp_file) {
+    swift_checkpoint_add(window->cp_file, window->op_segments[slot], segment);
+    fflush(window->cp_file);
+    fsync(fileno(window->cp_file));
+  }
+}
+
+STATIC swift_error
+swift_put_segments(struct swift_context *c, const char *container,
+    const char *object, const char *data, size_t length,
+    const char *segment_container, size_t segment_size,
+    unsigned int parallelism, const char *checkpoint, unsigned long mtime) {
+
+  struct swift_slo_segment *segments = NULL;
+  struct swift_segment_window window;
+  unsigned int n_segments;
+  unsigned int cur_segment;
+  unsigned int slot;
+  char *default_container = NULL;
+  char *prefix = NULL;
+  char *segname = NULL;
+  char *manifest_name = NULL;
+  char *manifest = NULL;
+  char *cp_name = NULL;
+  char cp_header[128];
+  FILE *cp_file = NULL;
+  struct swift_transfer_handle handle;
+  struct swift_request request;
+  swift_error s_err = SWIFT_SUCCESS;
+
+  if (!segment_size) {
+    segment_size = SWIFT_SEGMENT_SIZE;
+  }
+  if (!parallelism) {
+    parallelism = SWIFT_PARALLEL_STREAMS;
   }
 
-  l_handle->ptr = malloc(length);
-  if (!l_handle->ptr) {
-    swift_free_transfer_handle(handle);
-    return SWIFT_ERROR_MEMORY; 
+  if (!segment_container) {
+    default_container = (char *)malloc(strlen(container) + 10);
+    if (!default_container) {
+      return SWIFT_ERROR_MEMORY;
+    }
+    sprintf(default_container, "%s_segments", container);
+    segment_container = default_container;
   }
 
-  strcpy(l_handle->container, container);
-  strcpy(l_handle->object, object);
-  l_handle->parent = context;
-  l_handle->length = length;
-  l_handle->fpos = 0;
+  n_segments = (length + segment_size - 1) / segment_size;
+
+  memset(&window, 0, sizeof(window));
+  segments = (struct swift_slo_segment *)calloc(n_segments,
+      sizeof(struct swift_slo_segment));
+  window.ops = (struct swift_multi_op *)malloc(sizeof(struct swift_multi_op) *
+      parallelism);
+  window.sources = (struct swift_range_dest *)malloc(
+      sizeof(struct swift_range_dest) * parallelism);
+  window.op_segments = (unsigned int *)malloc(sizeof(unsigned int) *
+      parallelism);
+  window.free_slots = (unsigned int *)malloc(sizeof(unsigned int) *
+      parallelism);
+  prefix = (char *)malloc(strlen(object) + 64);
+  segname = (char *)malloc(strlen(object) + 64);
+  if (!segments || !window.ops || !window.sources || !window.op_segments ||
+      !window.free_slots || !prefix || !segname) {
+    s_err = SWIFT_ERROR_MEMORY;
+    goto out;
+  }
 
-  return SWIFT_SUCCESS;
-}
+  sprintf(prefix, "%s/slo/%lu/%lu/", object, (unsigned long)length,
+      (unsigned long)segment_size);
 
+  for (cur_segment = 0; cur_segment < n_segments; ++cur_segment) {
+    segments[cur_segment].size = (length - cur_segment * segment_size >
+        segment_size) ? segment_size : length - cur_segment * segment_size;
+  }
 
-swift_error
-swift_object_writehandle(struct swift_context *context, const char *container,
-    const char *object, struct swift_transfer_handle **handle, size_t len) {
+  if (checkpoint) {
+    cp_name = (char *)malloc(strlen(container) + strlen(object) + 2);
+    if (!cp_name) {
+      s_err = SWIFT_ERROR_MEMORY;
+      goto out;
+    }
+    sprintf(cp_name, "%s/%s", container, object);
+    sprintf(cp_header, "libswift-slo %lu %lu %lu", (unsigned long)length,
+        (unsigned long)segment_size, mtime);
+
+    swift_checkpoint_load(checkpoint, cp_header, cp_name, segments, n_segments);
+    cp_file = swift_checkpoint_create(checkpoint, cp_header, cp_name,
+        segments, n_segments);
+    if (!cp_file) {
+      s_err = SWIFT_ERROR_PERMISSIONS;
+      goto out;
+    }
+  }
 
-  size_t length;
-  struct swift_transfer_handle *l_handle;
-  swift_error s_err;
+  /* Already existing is fine, anything else shows up on the segment PUTs */
+  swift_container_create(c, segment_container);
+
+  /* Keep parallelism segments going, starting the next one as soon as any
+   * finishes */
+  window.context = c;
+  window.data = data;
+  window.segment_container = segment_container;
+  window.prefix = prefix;
+  window.segname = segname;
+  window.segment_size = segment_size;
+  window.segments = segments;
+  window.n_segments = n_segments;
+  window.cp_file = cp_file;
+  for (slot = 0; slot < parallelism; ++slot) {
+    window.free_slots[window.n_free++] = slot;
+  }
 
-  if (!context || !container ||
-      !object || !handle) {
-    return SWIFT_ERROR_NOTFOUND;
+  s_err = swift_multi_run(c, parallelism, swift_segment_next,
+      swift_segment_done, &window);
+  if (!s_err) {
+    s_err = window.s_err;
   }
 
-  if (swift_object_exists(context, container, object, &length) == SWIFT_SUCCESS) {
-    /* If it already exists, refuse to do anything */
-    return SWIFT_ERROR_EXISTS;
+  if (s_err) {
+    goto out;
   }
 
-  if ( (s_err = swift_create_transfer_handle(context, container, object, 
-          handle, len))) {
-    return s_err;
+  manifest = swift_slo_manifest(segment_container, prefix, segments, n_segments);
+  manifest_name = (char *)malloc(strlen(object) + 32);
+  if (!manifest || !manifest_name) {
+    s_err = SWIFT_ERROR_MEMORY;
+    goto out;
   }
 
-  /* Make our syntax easier */
-  l_handle = *handle;
+  /* The query string rides along on the object part of the URL.  Swift
+   * has to be able to parse the manifest, so it is never compressed */
+  sprintf(manifest_name, "%s?multipart-manifest=put", object);
+  memset(&handle, 0, sizeof(handle));
+  handle.container = (char *)container;
+  handle.object = manifest_name;
+  handle.mode = SWIFT_WRITE;
+  handle.parent = c;
+  handle.length = strlen(manifest);
+  handle.ptr = manifest;
 
-  memset(l_handle->ptr, 0, len);
-  l_handle->mode = SWIFT_WRITE;
+  if ( (s_err = swift_request_init(&request, c)) ) {
+    goto out;
+  }
+  request.compress_level = 0;
+  s_err = swift_sync_request(&handle, &request);
+  swift_request_free(&request);
+
+  if (!s_err && cp_file) {
+    fclose(cp_file);
+    cp_file = NULL;
+    unlink(checkpoint);
+  }
 
-  return SWIFT_SUCCESS;
+out:
+  if (cp_file) {
+    fclose(cp_file);
+  }
+  free(cp_name);
+  free(segments);
+  free(window.ops);
+  free(window.sources);
+  free(window.op_segments);
+  free(window.free_slots);
+  free(prefix);
+  free(segname);
+  free(manifest_name);
+  free(manifest);
+  free(default_container);
+
+  return s_err;
 }
 
 swift_error
-swift_object_readhandle(struct swift_context *context, const char *container,
-    const char *object, struct swift_transfer_handle **handle) {
-
-  size_t length;
-  struct swift_transfer_handle *l_handle;
-  swift_error s_err;
+swift_object_put_slo(struct swift_context *c, const char *container,
+    const char *object, const void *data, size_t length,
+    const char *segment_container, size_t segment_size,
+    unsigned int parallelism) {
 
-  if (!context || !container ||
-      !object || !handle) {
+  if (!object || !container || !c || (!data && length)) {
     return SWIFT_ERROR_NOTFOUND;
   }
 
-  if ( (s_err = swift_object_exists(context, container, object, &length)) ) {
-    /* If it already exists, refuse to do anything */
-    return s_err;
-  }
-
-  if ( (s_err = swift_create_transfer_handle(context, container, object, 
-          handle, length))) {
-    return s_err;
+  /* Nothing to segment */
+  if (!length) {
+    return swift_object_put(c, (char *)container, (char *)object, "", 0);
   }
 
-  l_handle = *handle;
-  l_handle->mode = SWIFT_READ;
-
-  return swift_sync(l_handle);
+  return swift_put_segments(c, container, object, (const char *)data, length,
+      segment_container, segment_size, parallelism, NULL, 0);
 }
 
 STATIC swift_error
-swift_sync_setup(struct swift_transfer_handle *handle) {
+swift_put_segments_fd(struct swift_context *c, const char *container,
+    const char *object, int fd, const char *segment_container,
+    size_t segment_size, unsigned int parallelism, const char *checkpoint) {
 
-  struct swift_context *context;
-  char *url;
+  struct stat st;
   swift_error s_err;
+  void *map = NULL;
 
-  if (!handle) {
+  if (!object || !container || !c || fd < 0) {
     return SWIFT_ERROR_NOTFOUND;
   }
 
-  context = handle->parent;
-
-  if (!context || !handle->container || !handle->object) {
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
     return SWIFT_ERROR_NOTFOUND;
   }
 
-  if (!context->valid_auth) {
-    if ( (s_err = swift_authenticate(context)) ) {
-      return s_err;
-    }
+  if (!st.st_size) {
+    return swift_object_put(c, (char *)container, (char *)object, "", 0);
   }
 
-  url = (char *)malloc(strlen(handle->container) + strlen(context->authurl) +
-      strlen(handle->object) + 3);
-  if (!url) {
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
     return SWIFT_ERROR_MEMORY;
   }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
 
-  sprintf(url, "%s/%s/%s", context->authurl, handle->container, handle->object); 
-  curl_easy_reset(context->curlhandle);
-  curl_easy_setopt(context->curlhandle, CURLOPT_URL, url);
-  context->buffer = handle->ptr;
-  context->buffer_pos = 0;
-  context->obj_length = handle->length;
-
-  switch (handle->mode) {
-    case SWIFT_READ:
-      context->state = SWIFT_STATE_OBJECT_READ;
-      break;
-    case SWIFT_WRITE:
-      context->state = SWIFT_STATE_OBJECT_WRITE;
-      curl_easy_setopt(context->curlhandle, CURLOPT_UPLOAD, 1);
-      curl_easy_setopt(context->curlhandle, CURLOPT_INFILESIZE, context->obj_length);
-      curl_easy_setopt(context->curlhandle, CURLOPT_READFUNCTION, 
-          swift_upload_callback);
-      curl_easy_setopt(context->curlhandle, CURLOPT_READDATA, context);
-      break;
-  }
+  s_err = swift_put_segments(c, container, object, (const char *)map,
+      st.st_size, segment_container, segment_size, parallelism, checkpoint,
+      (unsigned long)st.st_mtime);
 
-  free(url);
+  munmap(map, st.st_size);
 
-  return SWIFT_SUCCESS;
+  return s_err;
 }
 
-
 swift_error
-swift_sync(struct swift_transfer_handle *handle) {
-
-  swift_error s_err;
-  int response;
+swift_object_put_slo_fd(struct swift_context *c, const char *container,
+    const char *object, int fd, const char *segment_container,
+    size_t segment_size, unsigned int parallelism) {
 
-  if (  (s_err = swift_sync_setup(handle) )) {
-    return s_err;
-  }
-  
-  response = swift_perform(handle->parent);
-  return swift_response(response);
+  return swift_put_segments_fd(c, container, object, fd, segment_container,
+      segment_size, parallelism, NULL);
 }
 
-size_t
-swift_read(struct swift_transfer_handle *handle, void *buf, size_t nbytes) {
+swift_error
+swift_object_put_slo_resume(struct swift_context *c, const char *container,
+    const char *object, int fd, const char *segment_container,
+    size_t segment_size, unsigned int parallelism, const char *checkpoint) {
 
-  if (!handle || !buf) {
-    return 0;
+  if (!checkpoint) {
+    return SWIFT_ERROR_NOTFOUND;
   }
 
-  int newbytes = (handle->length - handle->fpos) < nbytes ?
-    (handle->length - handle->fpos) : 
-    nbytes;
-
-  memcpy(buf, handle->ptr + handle->fpos, newbytes);
-  handle->fpos += newbytes;
-  return newbytes;
+  return swift_put_segments_fd(c, container, object, fd, segment_container,
+      segment_size, parallelism, checkpoint);
 }
 
+swift_error
+swift_cache_create(struct swift_block_cache **cache, size_t block_size,
+    size_t max_bytes) {
 
-size_t
-swift_write(struct swift_transfer_handle *handle, const void *buf, size_t nbytes) {
+  struct swift_block_cache *l_cache;
 
-  if (!handle || !buf) {
-    return 0;
+  if (!cache) {
+    return SWIFT_ERROR_NOTFOUND;
   }
 
-  int newbytes = (handle->length - handle->fpos) < nbytes ?
-    (handle->length - handle->fpos) : 
-    nbytes;
+  if (!block_size) {
+    block_size = SWIFT_CACHE_BLOCK;
+  }
 
-  memcpy(handle->ptr + handle->fpos, buf, newbytes);
-  handle->fpos += newbytes;
-  return newbytes;
+  l_cache = (struct swift_block_cache *)malloc(sizeof(struct swift_block_cache));
+  if (!l_cache) {
+    return SWIFT_ERROR_MEMORY;
+  }
+  memset(l_cache, 0, sizeof(struct swift_block_cache));
+
+  l_cache->block_size = block_size;
+  l_cache->max_bytes = max_bytes;
+  l_cache->n_buckets = max_bytes / block_size + 64;
+  l_cache->buckets = (struct swift_cache_block **)calloc(l_cache->n_buckets,
+      sizeof(struct swift_cache_block *));
+  if (!l_cache->buckets) {
+    free(l_cache);
+    return SWIFT_ERROR_MEMORY;
+  }
 
-}
+  pthread_mutex_init(&l_cache->lock, NULL);
+  *cache = l_cache;
 
-size_t
-swift_get_data(struct swift_transfer_handle *handle, void **ptr) {
+  return SWIFT_SUCCESS;
+}
 
-  *ptr = handle->ptr;
-  return handle->length;
+STATIC void
+swift_cache_block_free(struct swift_cache_block *block) {
 
+  free(block->name);
+  free(block->data);
+  free(block);
 }
 
-
 void
-swift_seek(struct swift_transfer_handle *handle, unsigned long pos) {
+swift_cache_delete(struct swift_block_cache **cache) {
 
-  if (pos < handle->length) {
-    handle->fpos = pos;
+  struct swift_cache_block *block;
+  struct swift_cache_block *next;
+
+  if (!cache || !*cache) {
+    return;
+  }
+
+  for (block = (*cache)->lru_head; block; block = next) {
+    next = block->lru_next;
+    swift_cache_block_free(block);
   }
 
+  pthread_mutex_destroy(&(*cache)->lock);
+  free((*cache)->buckets);
+  free(*cache);
+  *cache = NULL;
 }
-  
-swift_error
-swift_object_put(struct swift_context *c, char *container,
-    char *object, void *data, size_t length) {
 
-  struct swift_transfer_handle handle;
+void
+swift_cache_stats(struct swift_block_cache *cache, unsigned long *hits,
+    unsigned long *misses) {
 
-  if (!data || !object || !container || !c) {
-    return SWIFT_ERROR_NOTFOUND;
+  pthread_mutex_lock(&cache->lock);
+  if (hits) {
+    *hits = cache->hits;
+  }
+  if (misses) {
+    *misses = cache->misses;
   }
+  pthread_mutex_unlock(&cache->lock);
+}
 
-  handle.container = container;
-  handle.object = object;
-  handle.mode = SWIFT_WRITE;
-  handle.parent = c;
-  handle.fpos = 0;
-  handle.length = length;
-  handle.ptr = data;
+STATIC char *
+swift_cache_name(const char *container, const char *object, const char *etag) {
 
-  return swift_sync(&handle);
+  char *name;
+
+  name = (char *)malloc(strlen(container) + strlen(object) + strlen(etag) + 3);
+  if (name) {
+    sprintf(name, "%s\n%s\n%s", container, object, etag);
+  }
 
+  return name;
 }
 
+STATIC unsigned long
+swift_cache_hash(const char *name, unsigned long index) {
 
-swift_error
-swift_object_get(struct swift_context *c, char *container,
-    char *object, void *data, size_t maxlen) {
+  unsigned long hash = 5381;
 
-  struct swift_transfer_handle handle;
-  swift_error s_err;
-  size_t length;
+  while (*name) {
+    hash = hash * 33 + (unsigned char)*name++;
+  }
 
-  if (!data || !object || !container || !c) {
-    return SWIFT_ERROR_NOTFOUND;
+  return hash ^ (index * 2654435761UL);
+}
+
+/* Callers hold the lock for these */
+STATIC void
+swift_cache_unlink(struct swift_block_cache *cache,
+    struct swift_cache_block *block) {
+
+  if (block->lru_prev) {
+    block->lru_prev->lru_next = block->lru_next;
+  } else {
+    cache->lru_head = block->lru_next;
+  }
+  if (block->lru_next) {
+    block->lru_next->lru_prev = block->lru_prev;
+  } else {
+    cache->lru_tail = block->lru_prev;
   }
+  block->lru_prev = block->lru_next = NULL;
+}
 
-  if ( (s_err = swift_object_exists(c, container, object, &length)) ) {
-    return s_err;
+STATIC void
+swift_cache_push(struct swift_block_cache *cache,
+    struct swift_cache_block *block) {
+
+  block->lru_next = cache->lru_head;
+  if (cache->lru_head) {
+    cache->lru_head->lru_prev = block;
   }
+  cache->lru_head = block;
+  if (!cache->lru_tail) {
+    cache->lru_tail = block;
+  }
+}
 
-  handle.container = container;
-  handle.object = object;
-  handle.mode = SWIFT_READ;
-  handle.parent = c;
-  handle.fpos = 0;
-  handle.length = (length > maxlen) ? maxlen : length;
-  handle.ptr = data;
+STATIC struct swift_cache_block **
+swift_cache_find(struct swift_block_cache *cache, const char *name,
+    unsigned long index, unsigned long hash) {
 
-  return swift_sync(&handle);
+  struct swift_cache_block **pos = &cache->buckets[hash % cache->n_buckets];
 
+  while (*pos && ((*pos)->hash != hash || (*pos)->index != index ||
+        strcmp((*pos)->name, name) != 0)) {
+    pos = &(*pos)->hash_next;
+  }
+
+  return pos;
 }
 
-STATIC size_t
-swift_multi_callback(void *ptr, size_t size, size_t nmemb, void *user) {
+STATIC void
+swift_cache_evict(struct swift_block_cache *cache) {
 
-  struct swift_multi_op *op = (struct swift_multi_op *)user;
+  struct swift_cache_block *block = cache->lru_tail;
+  struct swift_cache_block **pos;
 
-  return op->callback(ptr, size * nmemb, op->userdata);
+  pos = swift_cache_find(cache, block->name, block->index, block->hash);
+  *pos = block->hash_next;
+  swift_cache_unlink(cache, block);
+  cache->cur_bytes -= block->len;
+  swift_cache_block_free(block);
 }
 
-STATIC swift_error
-swift_multi_setup(struct swift_multi_op *op) {
+STATIC int
+swift_cache_get(struct swift_block_cache *cache, const char *name,
+    unsigned long index, void *data, size_t *len) {
 
-  char *url;
-  op->curlhandle = curl_easy_init();
+  unsigned long hash = swift_cache_hash(name, index);
+  struct swift_cache_block *block;
 
-  url = (char *)malloc(strlen(op->container) + strlen(op->context->authurl) +
-      strlen(op->objname) + 3);
-  if (!url) {
-    return SWIFT_ERROR_MEMORY;
+  pthread_mutex_lock(&cache->lock);
+
+  block = *swift_cache_find(cache, name, index, hash);
+  if (!block) {
+    cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
   }
 
-  sprintf(url, "%s/%s/%s", op->context->authurl, op->container, op->objname); 
+  cache->hits++;
+  swift_cache_unlink(cache, block);
+  swift_cache_push(cache, block);
 
-  curl_easy_setopt(op->curlhandle, CURLOPT_URL, url);
-  curl_easy_setopt(op->curlhandle, CURLOPT_PRIVATE, op);
-  if (op->mode == SWIFT_WRITE) {
-    curl_easy_setopt(op->curlhandle, CURLOPT_CUSTOMREQUEST, "PUT");
-    curl_easy_setopt(op->curlhandle, CURLOPT_READFUNCTION, swift_multi_callback);
-    curl_easy_setopt(op->curlhandle, CURLOPT_READDATA, op);
-    curl_easy_setopt(op->curlhandle, CURLOPT_UPLOAD, 1);
-    swift_set_headers(op->curlhandle, 2, op->context->authtoken, 
-        "Transfer-Encoding: chunked");
-  } else if (op->mode == SWIFT_READ) {
-    curl_easy_setopt(op->curlhandle, CURLOPT_CUSTOMREQUEST, "GET");
-    curl_easy_setopt(op->curlhandle, CURLOPT_WRITEFUNCTION, swift_multi_callback);
-    curl_easy_setopt(op->curlhandle, CURLOPT_WRITEDATA, op);
-    swift_set_headers(op->curlhandle, 1, op->context->authtoken);
-  }
+  /* Copy out under the lock, the block may be evicted as soon as we let go */
+  memcpy(data, block->data, block->len);
+  *len = block->len;
 
+  pthread_mutex_unlock(&cache->lock);
+  return 1;
 }
 
-  
+STATIC void
+swift_cache_put(struct swift_block_cache *cache, const char *name,
+    unsigned long index, const void *data, size_t len) {
 
+  unsigned long hash = swift_cache_hash(name, index);
+  struct swift_cache_block *block;
+  struct swift_cache_block **pos;
 
-swift_error
-swift_object_chunked_operation(struct swift_context *context,
-    struct swift_multi_op *oplist, unsigned int n_ops) {
+  if (len > cache->max_bytes) {
+    return;
+  }
+
+  block = (struct swift_cache_block *)malloc(sizeof(struct swift_cache_block));
+  if (!block) {
+    return;
+  }
+  memset(block, 0, sizeof(struct swift_cache_block));
+  block->name = (char *)malloc(strlen(name) + 1);
+  block->data = (char *)malloc(len ? len : 1);
+  if (!block->name || !block->data) {
+    swift_cache_block_free(block);
+    return;
+  }
+  strcpy(block->name, name);
+  memcpy(block->data, data, len);
+  block->len = len;
+  block->index = index;
+  block->hash = hash;
+
+  pthread_mutex_lock(&cache->lock);
+
+  /* Another reader may have beaten us to it */
+  pos = swift_cache_find(cache, name, index, hash);
+  if (*pos) {
+    pthread_mutex_unlock(&cache->lock);
+    swift_cache_block_free(block);
+    return;
+  }
 
+  while (cache->cur_bytes + len > cache->max_bytes) {
+    swift_cache_evict(cache);
+  }
 
-  CURLM *multi;
-  int cur_entry = 0;
-  int n_running = n_ops;
-  swift_error s_err;
-  struct swift_multi_op *t_op;
-  struct CURLMsg *curl_msg;
-  int n_msgs;
-  long curl_responsecode;
+  pos = swift_cache_find(cache, name, index, hash);
+  *pos = block;
+  swift_cache_push(cache, block);
+  cache->cur_bytes += len;
 
+  pthread_mutex_unlock(&cache->lock);
+}
 
-  if (!oplist || !n_ops) {
-    return SWIFT_ERROR_NOTFOUND;
+STATIC swift_error
+swift_cache_fetch(struct swift_context *c, const char *container,
+    const char *object, const char *etag, size_t length, char *data,
+    unsigned long first_block, unsigned long n_blocks) {
+
+  struct swift_block_cache *cache = c->cache;
+  size_t block_size = cache->block_size;
+  unsigned long index;
+  unsigned long run_start = 0;
+  size_t run_end;
+  size_t block_len;
+  int in_run = 0;
+  swift_error s_err = SWIFT_SUCCESS;
+  char *name;
+
+  name = swift_cache_name(container, object, etag);
+  if (!name) {
+    return SWIFT_ERROR_MEMORY;
   }
 
-  if (!context->valid_auth) {
-    if ( (s_err = swift_authenticate(context)) ) {
-      return s_err;
-    }
-  }
-                      
-  multi = curl_multi_init();
-
-  while (cur_entry != n_ops) {
-    oplist[cur_entry].curlhandle = curl_easy_init();
-    swift_multi_setup(&oplist[cur_entry]);
-    curl_multi_add_handle(multi, oplist[cur_entry].curlhandle);
-    ++cur_entry;
-  }
-
-  while (n_running) {
-    while (curl_multi_perform(multi, &n_running) == CURLM_CALL_MULTI_PERFORM);
-    /* Block here normally */
-    /*Handle return values */
-    while ((curl_msg = curl_multi_info_read(multi, &n_msgs)) != NULL) {   
-      curl_easy_getinfo(curl_msg->easy_handle, CURLINFO_PRIVATE, &t_op);
-      if (curl_msg->msg == CURLMSG_DONE) {
-        curl_easy_getinfo(t_op->curlhandle, CURLINFO_RESPONSE_CODE,
-            &curl_responsecode);
-        t_op->retval = swift_response(curl_responsecode);
-        t_op->done = 1;
+  /* Copy the hits, fetch each run of misses with one set of range GETs */
+  for (index = first_block; index <= first_block + n_blocks; ++index) {
+    if (index < first_block + n_blocks &&
+        !swift_cache_get(cache, name, index,
+          data + (index - first_block) * block_size, &block_len)) {
+      if (!in_run) {
+        run_start = index;
+        in_run = 1;
       }
+      continue;
+    }
+
+    if (!in_run) {
+      continue;
+    }
+    in_run = 0;
+
+    run_end = index * block_size;
+    if (run_end > length) {
+      run_end = length;
+    }
+    s_err = swift_get_ranges(c, container, object,
+        data + (run_start - first_block) * block_size, run_start * block_size,
+        run_end - run_start * block_size, block_size, SWIFT_PARALLEL_STREAMS);
+    if (s_err) {
+      break;
+    }
+
+    for (; run_start < index; ++run_start) {
+      block_len = (run_end - run_start * block_size > block_size) ?
+        block_size : run_end - run_start * block_size;
+      swift_cache_put(cache, name, run_start,
+          data + (run_start - first_block) * block_size, block_len);
     }
   }
 
-  return SWIFT_SUCCESS;
+  free(name);
+  return s_err;
 }
-
@@ -2,6 +2,8 @@
 #define MAIN_H
 
 #include <curl/curl.h>
+#include <pthread.h>
+#include <time.h>
 
 typedef enum {
   SWIFT_SUCCESS = 0,
@@ -12,6 +14,11 @@ typedef enum {
   SWIFT_ERROR_INTERNAL,
   SWIFT_ERROR_MEMORY,
   SWIFT_ERROR_EXISTS,
+  SWIFT_ERROR_NOT_MODIFIED,
+  SWIFT_ERROR_CHECKSUM,
+  SWIFT_ERROR_TIMEOUT,
+  SWIFT_ERROR_STALLED,
+  SWIFT_ERROR_COMPRESSED,
 } swift_error;
 
 typedef enum {
@@ -19,6 +26,13 @@ typedef enum {
   SWIFT_WRITE,
 } swift_transfermode;
 
+typedef enum {
+  SWIFT_HANDLE_BUFFERED,
+  SWIFT_HANDLE_STREAM,
+  SWIFT_HANDLE_FD,
+  SWIFT_HANDLE_RANGE,
+} swift_handletype;
+
 typedef enum {
   SWIFT_STATE_AUTH,
   SWIFT_STATE_CONTAINERLIST,
@@ -28,29 +42,162 @@ typedef enum {
   SWIFT_STATE_OBJECT_EXISTS,
   SWIFT_STATE_OBJECT_DELETE,
   SWIFT_STATE_OBJECT_READ,
+  SWIFT_STATE_OBJECT_READ_FD,
   SWIFT_STATE_OBJECT_WRITE,
+  SWIFT_STATE_OBJECT_WRITE_FD,
   SWIFT_STATE_OBJECT_WRITE_CHUNKED,
 } swift_state;
 
+/* Running MD5 of an object body, computed as the bytes move and compared
+ * with the ETag once the transfer is done.  skip is set when the body was
+ * not seen in full or the ETag is not a plain MD5 (large object manifests
+ * quote theirs) */
+struct swift_md5 {
+  unsigned int state[4];
+  unsigned long long count;
+  unsigned char buffer[64];
+  int skip;
+};
+
+/* Idle easy handles kept per context */
+#define SWIFT_HANDLE_POOL 16
+
+/* Protocols for swift_context_set_http2().  The default leaves it to
+ * curl.  SWIFT_HTTP2 is negotiated on https URLs and falls back to
+ * HTTP/1.1 elsewhere, prior knowledge speaks HTTP/2 on plain http too and
+ * needs a server that does */
+#define SWIFT_HTTP_DEFAULT 0
+#define SWIFT_HTTP1 1
+#define SWIFT_HTTP2 2
+#define SWIFT_HTTP2_PRIOR_KNOWLEDGE 3
+
+/* Connections per host chunked operations multiplex over when not told */
+#define SWIFT_HTTP2_CONNECTIONS 4
+
+/* Ops a chunked operation keeps in flight when not told */
+#define SWIFT_MAX_IN_FLIGHT 64
+
+/* Seconds the token refresher waits after failing to reach the auth
+ * service before it tries again */
+#define SWIFT_REFRESH_RETRY 5
+
+/* Failures swift_context_set_retry() can send a request again for: 5xx
+ * responses, 429 Too Many Requests, and connections that could not be
+ * made or broke off */
+#define SWIFT_RETRY_5XX 1
+#define SWIFT_RETRY_429 2
+#define SWIFT_RETRY_TRANSPORT 4
+#define SWIFT_RETRY_ALL (SWIFT_RETRY_5XX | SWIFT_RETRY_429 | SWIFT_RETRY_TRANSPORT)
+
+/* Retry policy of a new context: attempts per request, and the wait in
+ * milliseconds before the first retry and at most */
+#define SWIFT_RETRY_ATTEMPTS 3
+#define SWIFT_RETRY_BACKOFF 100
+#define SWIFT_RETRY_BACKOFF_MAX 5000
+
+/* Reads whose first byte times swift_context_set_hedge() takes its delay
+ * from, the most recent ones first */
+#define SWIFT_HEDGE_SAMPLES 128
+
+/* Long lived configuration and credentials, shared by any number of
+ * threads.  Everything a single request writes to lives in a request of its
+ * own, so the context only changes when the token is renewed.  The set_*
+ * calls below are not locked and belong before the context is shared */
 struct swift_context {
   char *connecturl;
-  swift_state state;
 
   /* http header related*/
   char *authurl;
   char *authtoken;
-  int num_containers;
-  int num_objects;
-  size_t obj_length;
-
-  /* Nodelist stuff */
-  char *buffer;
-  int buffer_pos;
 
   char *username;
   char *password;
   int valid_auth;
-  CURL *curlhandle;
+
+  /* Requests copy authurl and authtoken out under a read lock, new ones are
+   * swapped in under the write lock once authentication has them.
+   * auth_generation counts the swaps, token_expires and token_refresh are
+   * when the token runs out and when to replace it, 0 when unknown */
+  pthread_rwlock_t auth_lock;
+  unsigned long auth_generation;
+  time_t token_expires;
+  time_t token_refresh;
+
+  /* Lifetime assumed for tokens the auth service gives no expiry for */
+  unsigned long token_lifetime;
+
+  /* Background thread renewing the token before it expires.
+   * refresh_lock guards refresh_running, refresh_cond wakes the thread
+   * when the token changes or it is to stop */
+  pthread_t refresh_thread;
+  pthread_mutex_t refresh_lock;
+  pthread_cond_t refresh_cond;
+  int refresh_running;
+
+  /* Held while authenticating again after a 401, so a burst of failed
+   * requests costs one round trip to the auth service */
+  pthread_mutex_t auth_mutex;
+
+  /* File tokens are shared through between processes, NULL for none */
+  char *token_cache;
+
+  /* Idle easy handles, still holding their connections, and the multi
+   * handle whose connection cache chunked operations share.  Both are
+   * guarded by lock */
+  pthread_mutex_t lock;
+  CURL *pool[SWIFT_HANDLE_POOL];
+  unsigned int pool_count;
+  CURLM *multi;
+
+  /* Optional process wide DNS, TLS session and connection cache */
+  struct swift_share *share;
+
+  /* One of the SWIFT_HTTP* protocols, and the most connections chunked
+   * operations open to one host with HTTP/2 */
+  int http2;
+  unsigned int max_connections;
+
+  /* Most ops of a chunked operation running at once */
+  unsigned int max_in_flight;
+
+  /* Retry policy, see swift_context_set_retry().  retries counts the
+   * requests sent again and retry_seed is the state backoff jitter is drawn
+   * from, both guarded by lock */
+  unsigned int retry_attempts;
+  int retry_on;
+  unsigned long retry_backoff;
+  unsigned long retry_backoff_max;
+  unsigned long retries;
+  unsigned short retry_seed[3];
+
+  /* Time limits in milliseconds and the low speed floor, see
+   * swift_context_set_deadline() and swift_context_set_low_speed() */
+  unsigned long connect_timeout;
+  unsigned long deadline;
+  unsigned long low_speed_limit;
+  unsigned long low_speed_time;
+
+  /* Hedged reads, see swift_context_set_hedge().  Holds the first byte
+   * times in milliseconds of the last SWIFT_HEDGE_SAMPLES reads and the
+   * delay worked out from them, -1 until there are enough.  Samples, delay
+   * and counters are guarded by lock */
+  unsigned int hedge_percentile;
+  unsigned int hedge_budget;
+  unsigned long hedge_samples[SWIFT_HEDGE_SAMPLES];
+  unsigned long hedge_n_samples;
+  long hedge_delay;
+  unsigned long hedge_reads;
+  unsigned long hedges;
+  unsigned long hedge_wins;
+
+  /* Verify object bodies against their ETag, on unless turned off */
+  int checksum;
+
+  /* Deflate settings for object uploads */
+  struct swift_compress *compress;
+
+  /* Optional block cache consulted by read handles */
+  struct swift_block_cache *cache;
 };
 
 
@@ -63,22 +210,228 @@ struct swift_transfer_handle {
 
   int consistant;
   swift_transfermode mode;
+  swift_handletype type;
+  int fd;
   struct swift_context *parent;
+
+  /* Streaming handles pull the body through a fixed size window instead of
+   * buffering the whole object in ptr */
+  CURLM *multi;
+  CURL *curlhandle;
+  struct curl_slist *headers;
+  char *window;
+  size_t window_size;
+  size_t window_pos;
+  size_t window_len;
+  int headers_done;
+  int paused;
+  int running;
+  long response;
+  CURLcode result;
+
+  /* Set when the object being read is stored compressed, which only whole
+   * object reads can inflate */
+  int compressed;
+
+  /* Streaming write handles use the window as a ring of window_len bytes
+   * starting at window_pos, finished is set once the writer is done */
+  int finished;
+
+  /* Range handles with a block cache read whole blocks into ptr */
+  char etag[64];
+  unsigned long block_index;
+  size_t block_len;
+
+  /* Token generation the current range was sent with, and whether it has
+   * already been sent again after a 401 */
+  unsigned long auth_generation;
+  int replayed;
+
+  /* Range handles: object offset of the next unread window byte, the range
+   * currently being fetched and the size of the next one */
+  unsigned long window_off;
+  unsigned long range_start;
+  unsigned long range_end;
+  unsigned long readahead;
+
+  /* Range handles read from active, the handle itself or spare, while the
+   * range after the one being read is fetched on the other */
+  struct swift_transfer_handle *active;
+  struct swift_transfer_handle *spare;
 };
 
+/* Default size of the window used by streaming read handles.  Must be at
+ * least CURL_MAX_WRITE_SIZE so a paused write can always be accepted */
+#define SWIFT_STREAM_WINDOW (64 * 1024)
+
+/* Range handles start with SWIFT_READAHEAD_MIN byte requests and double the
+ * request size for every sequential continuation, up to SWIFT_READAHEAD_MAX */
+#define SWIFT_READAHEAD_MIN (64 * 1024)
+#define SWIFT_READAHEAD_MAX (8 * 1024 * 1024)
+
 swift_error swift_init();
 swift_error swift_deinit();
 
+/* In-process cache of fixed size object blocks, keyed by container, object,
+ * ETag and offset and evicted least recently used first once max_bytes is
+ * reached.  One cache can be shared by any number of contexts and threads.
+ * Attached to a context it is consulted by swift_object_readhandle() and
+ * swift_object_rangehandle() before going to the network.  A block_size of
+ * zero picks SWIFT_CACHE_BLOCK */
+#define SWIFT_CACHE_BLOCK (1024 * 1024)
+
+struct swift_block_cache;
+
+swift_error swift_cache_create(struct swift_block_cache **, size_t block_size,
+    size_t max_bytes);
+void swift_cache_delete(struct swift_block_cache **);
+void swift_cache_stats(struct swift_block_cache *, unsigned long *hits,
+    unsigned long *misses);
+
+/* DNS results, TLS sessions and open connections shared between any number
+ * of contexts and threads, built on curl's share interface.  Delete the
+ * share only after every context using it */
+struct swift_share;
+
+swift_error swift_share_create(struct swift_share **);
+void swift_share_delete(struct swift_share **);
+
 swift_error swift_context_create(struct swift_context **, 
     const char *connecturl, const char *username, const char *password);
+swift_error swift_context_create_shared(struct swift_context **,
+    const char *connecturl, const char *username, const char *password,
+    struct swift_share *);
 swift_error swift_context_delete(struct swift_context **);
 
 swift_error swift_can_connect(struct swift_context *);
+void swift_context_set_cache(struct swift_context *, struct swift_block_cache *);
+
+/* Share tokens through the file at path, created mode 0600 and keyed by
+ * connect URL and user name.  A context that finds its token there skips
+ * authentication, and every new token is written back for the next
+ * process.  NULL turns the cache off.
+ *
+ * Whether the token came from the cache or not, a request answered with
+ * 401 authenticates again and is sent once more.  Uploads from descriptors
+ * that have been partly read and streaming write handles can not be sent
+ * again and fail with SWIFT_ERROR_PERMISSIONS */
+swift_error swift_context_set_token_cache(struct swift_context *,
+    const char *path);
+
+/* Renew the token from a background thread once nine tenths of its life
+ * has gone, so requests never wait on the auth service or meet an expired
+ * token under load.  The expiry comes from X-Auth-Token-Expires, or is
+ * lifetime seconds after the token arrived when the auth service sends
+ * none; with lifetime 0 such tokens are left to run out.  enable 0 stops
+ * the thread, swift_context_delete() does too */
+swift_error swift_context_set_token_refresh(struct swift_context *,
+    int enable, unsigned long lifetime);
+
+/* Speak HTTP/2 where the server allows and multiplex the ops of
+ * swift_object_chunked_operation() over at most max_connections
+ * connections per host, SWIFT_HTTP2_CONNECTIONS for 0, instead of opening
+ * one per op.  Should the server only speak HTTP/1.1 the ops queue for
+ * those connections instead.  Takes one of the SWIFT_HTTP* protocols,
+ * SWIFT_HTTP1 pins every request to HTTP/1.1 */
+swift_error swift_context_set_http2(struct swift_context *, int mode,
+    unsigned int max_connections);
+
+/* Run at most max_in_flight ops of swift_object_chunked_operation() at
+ * once, SWIFT_MAX_IN_FLIGHT for 0, starting the next as each finishes.
+ * Easy handles and sockets stay bounded however long the op list is */
+void swift_context_set_max_in_flight(struct swift_context *,
+    unsigned int max_in_flight);
+
+/* Send requests failing with one of the retry_on SWIFT_RETRY_* failures
+ * again, up to attempts times in all.  The n-th retry waits backoff_ms
+ * doubled n - 1 times, at most backoff_max_ms, and then a random part of
+ * the second half of that again, so a crowd of clients spreads out.
+ * Applies to the single request calls and to chunked operations.  Bodies
+ * are sent again from buffers and mapped files; descriptors already
+ * partly read or written, and multi ops whose callback has already seen
+ * data and that have no rewind callback, fail instead.  attempts 1 turns
+ * retries off.  swift_context_retries() counts the retries made so far */
+void swift_context_set_retry(struct swift_context *, unsigned int attempts,
+    int retry_on, unsigned long backoff_ms, unsigned long backoff_max_ms);
+unsigned long swift_context_retries(struct swift_context *);
+
+/* Give every request at most deadline_ms from when it is set up, failing
+ * it with SWIFT_ERROR_TIMEOUT once that is gone.  The authentication it
+ * needs, sending it again after a 401 and retries with their backoff all
+ * come out of the same time, and no retry is waited for that would not
+ * fit.  connect_ms bounds each connection attempt.  Multi ops can bring a
+ * deadline of their own, those of a chunked operation that do not share
+ * one that starts with it.  Zero turns either off, as for a new context.
+ * Streaming and range handles move at their caller's pace and have
+ * neither */
+void swift_context_set_deadline(struct swift_context *,
+    unsigned long connect_ms, unsigned long deadline_ms);
 
+/* Abort transfers moving fewer than bytes_per_sec bytes a second for secs
+ * seconds with SWIFT_ERROR_STALLED, sending them again where the retry
+ * policy covers broken connections.  Applies to the requests a deadline
+ * does, 0 turns it off as for a new context */
+void swift_context_set_low_speed(struct swift_context *,
+    unsigned long bytes_per_sec, unsigned long secs);
+
+/* Hedge object reads against a slow proxy or object server.  A read that
+ * has had no first byte back after the percentile-th percentile of recent
+ * first byte times is sent a second time, the first of the two to answer
+ * is kept and the other cancelled.  Hedges are held to at most budget
+ * percent of reads.  Covers swift_object_get() and the other whole object
+ * reads, object HEADs, swift_object_readhandle() and READ ops of chunked
+ * operations; streaming and range handles, engines and async ops are not
+ * hedged.  Off, percentile 0, for new contexts.  swift_context_hedge_stats()
+ * counts the hedges sent and how many answered first */
+swift_error swift_context_set_hedge(struct swift_context *,
+    unsigned int percentile, unsigned int budget);
+void swift_context_hedge_stats(struct swift_context *, unsigned long *hedges,
+    unsigned long *wins);
+
+/* Compress object bodies on upload.  level is a zlib level from 1 to 9, 0
+ * turns compression of uploads off.  dict is an optional preset dictionary
+ * (typically sample content of the small objects being stored) and must be
+ * set identically on every context that reads those objects.  Compressed
+ * objects are tagged with X-Object-Meta-Compression and are inflated on the
+ * fly by swift_object_get(), swift_object_get_fd(), swift_object_get_path(),
+ * swift_object_readhandle() and swift_async_object_get() whether or not
+ * compression is enabled.  Streaming, range, parallel and multi op reads of
+ * compressed objects fail with SWIFT_ERROR_COMPRESSED rather than return
+ * the stored bytes, and large object segments are never compressed */
+swift_error swift_context_set_compression(struct swift_context *, int level,
+    const void *dict, size_t dict_len);
+
+/* Whole object reads and all writes are hashed while they transfer and
+ * checked against the ETag the server returns, failing with
+ * SWIFT_ERROR_CHECKSUM on a mismatch.  Enabled by default */
+void swift_context_set_checksum(struct swift_context *, int enable);
+
+/* Lists every name at path, asking for pages of SWIFT_LISTING_LIMIT one
+ * after the other until one comes back short.  The whole listing is held
+ * at once, see swift_listing_create() to walk a large container in
+ * bounded memory */
 swift_error swift_node_list(struct swift_context *, const char *path, 
     int *n_entries, char *** contents);
 swift_error swift_node_list_free(char ***contents);
 
+/* Walk the listing at path page by page, starting after marker when it is
+ * given.  Pages of limit names, SWIFT_LISTING_LIMIT for 0, are asked for
+ * one after the other, the next while the caller works through the
+ * current one, so that no more than two are held whatever the size of the
+ * container.  swift_listing_next() sets name to each in turn, valid until
+ * the next call, and returns SWIFT_ERROR_NOTFOUND with name NULL at the
+ * end.  A page that fails ends the walk with its error, which later calls
+ * return again */
+#define SWIFT_LISTING_LIMIT 10000
+
+struct swift_listing;
+
+swift_error swift_listing_create(struct swift_listing **,
+    struct swift_context *, const char *path, const char *marker,
+    unsigned int limit);
+swift_error swift_listing_next(struct swift_listing *, const char **name);
+void swift_listing_delete(struct swift_listing **);
+
 swift_error swift_container_exists(struct swift_context *, const char *container);
 swift_error swift_container_create(struct swift_context *, const char *container);
 swift_error swift_container_delete(struct swift_context *, const char *container);
@@ -104,6 +457,54 @@ struct swift_multi_op {
   swift_error retval;
   int done;
   CURL *curlhandle;
+  struct curl_slist *headers;
+
+  /* Byte range of the object to read, length 0 means the whole object.  For
+   * writes length is the upload size, 0 sends it chunked */
+  unsigned long offset;
+  unsigned long length;
+
+  /* Milliseconds the op may take from when it is first sent, retries
+   * included, 0 for the context's deadline counted from the start of the
+   * chunked operation or from when the op is added to an engine */
+  unsigned long deadline;
+
+  /* ETag returned by the server, without quotes */
+  char etag[64];
+  struct swift_md5 md5;
+
+  /* Status of the response so far.  Reads answered with a 401 are sent once
+   * more after authenticating again, auth_generation is the token they
+   * went out with */
+  long response;
+  int replayed;
+  unsigned long auth_generation;
+
+  /* Starts userdata over so a failed op can be sent again, returning 0
+   * when it can not.  Without one only ops whose callback has seen no
+   * data yet are retried.  retries is how often the op was sent again */
+  int (*rewind)(void *userdata);
+  unsigned int retries;
+
+  /* Private: whether the callback has seen data or the object read turned
+   * out to be stored compressed, and when and in what list a failed op
+   * waits to go out again */
+  int moved;
+  int compressed;
+  unsigned long long retry_at;
+  struct swift_multi_op *retry_next;
+
+  /* Private: when the op went out and its first byte came back, the copy
+   * of it sent when that took too long, or for the copy the op it stands
+   * in for, and the next read a chunked operation watches for hedging */
+  unsigned long long sent_at;
+  unsigned long long first_byte;
+  struct swift_multi_op *hedge;
+  int hedge_copy;
+  struct swift_multi_op *hedge_next;
+
+  /* Private: when the op's deadline runs out, 0 for never */
+  unsigned long long deadline_at;
 };
 
 static inline void
@@ -111,6 +512,9 @@ swift_load_op(struct swift_multi_op *op, struct swift_context *c,
     const char *container, const char *obj,
     swift_transfermode mode, swift_callback cb, void *ud) {
 
+  /* Everything not set here starts out zero, private fields included */
+  memset(op, 0, sizeof(*op));
+
   strncpy(op->container, container, 256);
   op->container[255] = '\0';
   strncpy(op->objname, obj, 1024);
@@ -120,7 +524,6 @@ swift_load_op(struct swift_multi_op *op, struct swift_context *c,
   op->mode = mode;
   op->callback = cb;
   op->userdata = ud;
-  op->done = 0;
 
 }
 
@@ -128,6 +531,173 @@ swift_load_op(struct swift_multi_op *op, struct swift_context *c,
 swift_error swift_object_chunked_operation(struct swift_context *,
     struct swift_multi_op *oplist, unsigned int n_ops);
 
+/* Runs multi ops from the caller's own event loop instead of blocking.
+ * The engine asks for each socket it needs watched through socket_cb, with
+ * SWIFT_POLL_IN and/or SWIFT_POLL_OUT, or SWIFT_POLL_REMOVE once it no
+ * longer does, and for a timer through timer_cb, in milliseconds and -1 to
+ * cancel it.  Call swift_engine_action() whenever a watched socket is
+ * ready, or with SWIFT_SOCKET_TIMEOUT when the timer fires.  Ops given to
+ * swift_engine_add() get done and retval set as they finish, and done_cb,
+ * if any, is called for each.  Engines are not locked, drive each one from
+ * a single thread.  Deleting an engine fails the ops still running with
+ * SWIFT_ERROR_INTERNAL */
+#define SWIFT_POLL_IN 1
+#define SWIFT_POLL_OUT 2
+#define SWIFT_POLL_REMOVE 4
+#define SWIFT_SOCKET_TIMEOUT (-1)
+
+struct swift_engine;
+
+typedef void (*swift_socket_callback)(int fd, int events, void *user);
+typedef void (*swift_timer_callback)(long timeout_ms, void *user);
+typedef void (*swift_done_callback)(struct swift_multi_op *op, void *user);
+
+swift_error swift_engine_create(struct swift_engine **,
+    struct swift_context *, swift_socket_callback, swift_timer_callback,
+    swift_done_callback, void *user);
+void swift_engine_delete(struct swift_engine **);
+swift_error swift_engine_add(struct swift_engine *, struct swift_multi_op *);
+swift_error swift_engine_action(struct swift_engine *, int fd, int events,
+    unsigned int *n_running);
+
+/* Asynchronous requests.  Each call below starts the same request as its
+ * synchronous namesake and returns at once, so one thread can keep any
+ * number of them in flight over a single multi handle.  Progress is only
+ * made inside swift_async_wait() and swift_async_next(), which is also
+ * where ops finish: ops submitted with a callback are passed to it, the
+ * rest join a completion queue that swift_async_next() hands back oldest
+ * first.  The op belongs to the caller and must stay put until it is done,
+ * after which it can be submitted again.  As with engines, drive each
+ * async from a single thread, and authentication, when the context has no
+ * token yet, still blocks.  Deleting an async fails the ops still running
+ * with SWIFT_ERROR_INTERNAL without calling their callbacks */
+struct swift_async;
+struct swift_request;
+struct swift_async_op;
+
+typedef void (*swift_async_callback)(struct swift_async_op *op, void *user);
+
+struct swift_async_op {
+  swift_async_callback callback;
+  void *userdata;
+
+  /* Set once done is.  length is the object size for
+   * swift_async_object_exists() and the bytes read for
+   * swift_async_object_get(), contents and n_entries the listing of
+   * swift_async_node_list(), freed with swift_node_list_free() */
+  swift_error retval;
+  int done;
+  size_t length;
+  int n_entries;
+  char **contents;
+
+  /* Private: the request in flight, its headers, whether it has been sent
+   * again after a 401, and links of the running list and completion
+   * queue */
+  struct swift_request *request;
+  struct curl_slist *headers;
+  int replayed;
+  struct swift_async_op *prev;
+  struct swift_async_op *next;
+};
+
+swift_error swift_async_create(struct swift_async **, struct swift_context *);
+void swift_async_delete(struct swift_async **);
+
+swift_error swift_async_node_list(struct swift_async *, struct swift_async_op *,
+    const char *path, swift_async_callback, void *user);
+swift_error swift_async_container_create(struct swift_async *,
+    struct swift_async_op *, const char *container, swift_async_callback,
+    void *user);
+swift_error swift_async_container_delete(struct swift_async *,
+    struct swift_async_op *, const char *container, swift_async_callback,
+    void *user);
+swift_error swift_async_object_exists(struct swift_async *,
+    struct swift_async_op *, const char *container, const char *object,
+    swift_async_callback, void *user);
+swift_error swift_async_object_delete(struct swift_async *,
+    struct swift_async_op *, const char *container, const char *object,
+    swift_async_callback, void *user);
+swift_error swift_async_object_get(struct swift_async *,
+    struct swift_async_op *, const char *container, const char *object,
+    void *data, size_t maxlen, swift_async_callback, void *user);
+swift_error swift_async_object_put(struct swift_async *,
+    struct swift_async_op *, const char *container, const char *object,
+    const void *data, size_t length, swift_async_callback, void *user);
+
+/* Move the transfers along, sleeping up to timeout_ms for one of them to
+ * be ready when none has finished yet, and finish the ops that are done.
+ * n_running, if given, is set to the ops still in flight */
+swift_error swift_async_wait(struct swift_async *, long timeout_ms,
+    unsigned int *n_running);
+
+/* Take the oldest op off the completion queue, waiting up to timeout_ms
+ * for one to finish, or for as long as ops are in flight with -1.  Returns
+ * SWIFT_ERROR_NOTFOUND with *op NULL when none did */
+swift_error swift_async_next(struct swift_async *, long timeout_ms,
+    struct swift_async_op **op);
+
+/* Split a large object into ranges of range_size bytes and fetch up to
+ * parallelism of them at once, each landing in place in data or in the file
+ * at path.  Zero picks SWIFT_PARALLEL_RANGE and SWIFT_PARALLEL_STREAMS */
+#define SWIFT_PARALLEL_RANGE (8 * 1024 * 1024)
+#define SWIFT_PARALLEL_STREAMS 4
+
+swift_error swift_object_get_parallel(struct swift_context *, const char *container,
+    const char *object, void *data, size_t maxlen, size_t range_size,
+    unsigned int parallelism);
+swift_error swift_object_get_parallel_path(struct swift_context *,
+    const char *container, const char *object, const char *path,
+    size_t range_size, unsigned int parallelism);
+
+/* Static Large Object upload.  The source is cut into segment_size byte
+ * segments which are uploaded, parallelism at a time, to segment_container
+ * (or "<container>_segments" if NULL) as "<object>/slo/<length>/<size>/<n>".
+ * The manifest tying them together is written to container/object last.
+ * Zero picks SWIFT_SEGMENT_SIZE and SWIFT_PARALLEL_STREAMS.  The _fd variant
+ * needs a descriptor that can be mapped, ie a regular file */
+#define SWIFT_SEGMENT_SIZE (100 * 1024 * 1024)
+
+swift_error swift_object_put_slo(struct swift_context *, const char *container,
+    const char *object, const void *data, size_t length,
+    const char *segment_container, size_t segment_size, unsigned int parallelism);
+swift_error swift_object_put_slo_fd(struct swift_context *, const char *container,
+    const char *object, int fd, const char *segment_container,
+    size_t segment_size, unsigned int parallelism);
+
+/* Resumable variant of swift_object_put_slo_fd().  Every uploaded segment is
+ * recorded (index, size, ETag) in the local file at checkpoint.  Running the
+ * same upload again skips the segments listed there, provided the file size,
+ * modification time and segment size still match.  The checkpoint is
+ * removed once the manifest is written */
+swift_error swift_object_put_slo_resume(struct swift_context *,
+    const char *container, const char *object, int fd,
+    const char *segment_container, size_t segment_size,
+    unsigned int parallelism, const char *checkpoint);
+
+/* Validators for a single object as last seen by the caller */
+struct swift_object_info {
+  size_t length;
+  char etag[64];
+  char last_modified[64];
+};
+
+/* HEAD the object and fill in info.  If info already holds an ETag or
+ * Last-Modified date they are sent as If-None-Match/If-Modified-Since, and
+ * SWIFT_ERROR_NOT_MODIFIED is returned with info untouched when the object
+ * is unchanged */
+swift_error swift_object_stat(struct swift_context *, const char *container,
+    const char *object, struct swift_object_info *info);
+
+/* Conditional swift_object_get().  With validators in info the GET is
+ * conditional and an unchanged object costs a 304 with no body, returning
+ * SWIFT_ERROR_NOT_MODIFIED.  Otherwise up to maxlen bytes are read into data
+ * and info is updated with the new validators and the number of bytes read.
+ * Zero the info structure to force a full read */
+swift_error swift_object_get_if_modified(struct swift_context *,
+    const char *container, const char *object, void *data, size_t maxlen,
+    struct swift_object_info *info);
+
 /* Simple get/put layer for transfering the entire file in one call, no need for
  * handles
  */
@@ -136,11 +706,51 @@ swift_error swift_object_put(struct swift_context *, char *container,
 swift_error swift_object_get(struct swift_context *, char *container,
     char *object, void *data, size_t maxlen);
 
+/* Download an object without staging it in memory.  swift_object_get_fd()
+ * writes the body to fd as it arrives, swift_object_get_path() creates the
+ * file at path, sizes it to the object and receives the body into a shared
+ * mapping of it */
+swift_error swift_object_get_fd(struct swift_context *, const char *container,
+    const char *object, int fd);
+swift_error swift_object_get_path(struct swift_context *, const char *container,
+    const char *object, const char *path);
+
+/* Upload the contents of fd without staging it in memory.  Regular files are
+ * sent from a read-only mapping, anything else (pipes, sockets) is read until
+ * end of file and sent with chunked transfer encoding */
+swift_error swift_object_put_fd(struct swift_context *, const char *container,
+    const char *object, int fd);
+
 /* Easy posix layer for simple read-write. Does not use chunked transfers! */
 swift_error swift_object_delete(struct swift_context *, const char *container, 
     const char *object);
 swift_error swift_object_readhandle(struct swift_context *, const char *container, 
     const char *object, struct swift_transfer_handle **);
+
+/* Streaming read handle.  The GET is started immediately and swift_read()
+ * pulls from the live response body through a window of SWIFT_STREAM_WINDOW
+ * bytes, so memory use does not depend on the object size.  Streaming handles
+ * are sequential: swift_seek() is ignored and swift_get_data() returns no
+ * data.  swift_sync() reports the status of the transfer so far. */
+swift_error swift_object_streamhandle(struct swift_context *, const char *container,
+    const char *object, struct swift_transfer_handle **);
+
+/* Lazy read handle.  Nothing is downloaded up front, swift_seek() and
+ * swift_read() turn into Range GETs for just the bytes touched.  Sequential
+ * reads grow the request size and ask for the next range on a second
+ * connection once half of the current one has been read, random reads fall
+ * back to small requests */
+swift_error swift_object_rangehandle(struct swift_context *, const char *container,
+    const char *object, struct swift_transfer_handle **);
+/* Streaming write handle for data of unknown length.  The PUT is started
+ * immediately with chunked transfer encoding and swift_write() feeds it
+ * through a ring of SWIFT_STREAM_WINDOW bytes, blocking only while the ring
+ * is full.  swift_sync() ends the upload and returns its result.  The
+ * transfer is only driven from inside swift_write() and swift_sync(), so
+ * a producer that pauses between writes pauses the upload, and one that
+ * pauses for longer than the server's timeout can lose it */
+swift_error swift_object_streamwritehandle(struct swift_context *,
+    const char *container, const char *object, struct swift_transfer_handle **);
 size_t swift_read(struct swift_transfer_handle *, void *buf, size_t nbytes);
 size_t swift_write(struct swift_transfer_handle *, const void *buf, size_t n);
 size_t swift_get_data(struct swift_transfer_handle *, void **ptr);
@@ -2,6 +2,8 @@
 #define SWIFT_PRIVATE_H
 
 #include <config.h>
+#include <pthread.h>
+#include <zlib.h>
       
 #ifdef UNITTEST
 #define STATIC
@@ -19,26 +21,411 @@
 #else
 #define STATIC static
 #endif
+
+struct swift_request;
       
 
 
 STATIC void swift_chomp(char *);
+STATIC int swift_copy_etag(char *, const char *);
+STATIC void swift_md5_init(struct swift_md5 *);
+STATIC void swift_md5_block(struct swift_md5 *, const unsigned char *);
+STATIC void swift_md5_update(struct swift_md5 *, const void *, size_t);
+STATIC void swift_md5_final(struct swift_md5 *, char *);
+STATIC swift_error swift_md5_verify(struct swift_md5 *, const char *);
+STATIC void swift_set_validators(struct swift_request *,
+    const struct swift_object_info *);
 STATIC swift_error swift_response(int);
 STATIC struct curl_slist *swift_set_headers(CURL *, int, ...);
+STATIC CURL *swift_handle_get(struct swift_context *);
+STATIC void swift_handle_put(struct swift_context *, CURL *);
 STATIC void swift_string_to_list(char *, int, char ***);
 
 STATIC size_t swift_header_callback(void *, size_t, size_t, void *);
 STATIC size_t swift_body_callback(void *, size_t, size_t, void *);
 STATIC size_t swift_upload_callback(void *, size_t, size_t, void *);
+STATIC size_t swift_stream_header_callback(void *, size_t, size_t, void *);
+STATIC size_t swift_stream_body_callback(void *, size_t, size_t, void *);
+STATIC size_t swift_stream_source_callback(void *, size_t, size_t, void *);
 
 STATIC swift_error swift_create_transfer_handle(struct swift_context *, const char *,
     const char *, struct swift_transfer_handle **, unsigned long);
-STATIC swift_error swift_node_list_setup(struct swift_context *, const char *);
-STATIC swift_error swift_container_create_setup(struct swift_context *, const char *);
-STATIC swift_error swift_container_delete_setup(struct swift_context *, const char *);
-STATIC swift_error swift_object_exists_setup(struct swift_context *, const char *,
+STATIC swift_error swift_node_list_setup(struct swift_request *, const char *);
+STATIC swift_error swift_node_page_setup(struct swift_request *, const char *,
+    const char *, unsigned int);
+STATIC int swift_list_entries(const char *);
+STATIC swift_error swift_container_create_setup(struct swift_request *, const char *);
+STATIC swift_error swift_container_delete_setup(struct swift_request *, const char *);
+STATIC swift_error swift_object_exists_setup(struct swift_request *, const char *,
+    const char *);
+STATIC swift_error swift_object_delete_setup(struct swift_request *, const char *,
+    const char *);
+STATIC swift_error swift_object_head(struct swift_request *, const char *,
+    const char *, size_t *);
+STATIC size_t swift_data_length(struct swift_request *);
+STATIC swift_error swift_object_range_length(struct swift_context *,
+    const char *, const char *, size_t *);
+STATIC swift_error swift_sync_request(struct swift_transfer_handle *,
+    struct swift_request *);
+
+STATIC swift_error swift_stream_create(struct swift_context *, const char *,
+    const char *, struct swift_transfer_handle **, swift_handletype);
+STATIC swift_error swift_stream_start(struct swift_transfer_handle *,
+    unsigned long, unsigned long);
+STATIC swift_error swift_stream_perform(struct swift_transfer_handle *);
+STATIC size_t swift_stream_read(struct swift_transfer_handle *, void *, size_t);
+STATIC size_t swift_stream_write(struct swift_transfer_handle *, const void *,
+    size_t);
+STATIC void swift_range_prefetch(struct swift_transfer_handle *);
+STATIC size_t swift_range_read(struct swift_transfer_handle *, void *, size_t);
+
+/* One range of a parallel transfer, in the caller's buffer */
+struct swift_range_dest {
+  char *ptr;
+  size_t start;
+  size_t pos;
+  size_t end;
+};
+
+STATIC swift_error swift_map_file(const char *, size_t, int *, void **);
+STATIC size_t swift_range_dest_callback(void *, size_t, void *);
+STATIC size_t swift_range_source_callback(void *, size_t, void *);
+STATIC int swift_range_rewind(void *);
+STATIC size_t swift_multi_header_callback(void *, size_t, size_t, void *);
+STATIC size_t swift_discard_callback(void *, size_t, size_t, void *);
+STATIC swift_error swift_get_ranges(struct swift_context *, const char *,
+    const char *, void *, size_t, size_t, size_t, unsigned int);
+
+/* A parallel read in progress.  Each of the parallelism slots holds an op
+ * and the destination of the range it fetches, free_slots those not in
+ * use.  pos is where the next range starts, s_err the first failure */
+struct swift_range_window {
+  struct swift_context *context;
+  const char *container;
+  const char *object;
+  char *data;
+  size_t offset;
+  size_t length;
+  size_t range_size;
+  size_t pos;
+
+  struct swift_multi_op *ops;
+  struct swift_range_dest *dests;
+  unsigned int *free_slots;
+  unsigned int n_free;
+  swift_error s_err;
+};
+
+STATIC struct swift_multi_op *swift_range_next(void *);
+STATIC void swift_range_done(struct swift_multi_op *, void *);
+
+/* State of one segment of a Static Large Object upload */
+struct swift_slo_segment {
+  size_t size;
+  char etag[64];
+  int done;
+};
+
+STATIC void swift_json_escape(char *, const char *);
+STATIC char *swift_slo_manifest(const char *, const char *,
+    struct swift_slo_segment *, unsigned int);
+STATIC unsigned int swift_checkpoint_load(const char *, const char *,
+    const char *, struct swift_slo_segment *, unsigned int);
+STATIC FILE *swift_checkpoint_create(const char *, const char *, const char *,
+    struct swift_slo_segment *, unsigned int);
+STATIC void swift_checkpoint_add(FILE *, unsigned int, struct swift_slo_segment *);
+STATIC swift_error swift_put_segments(struct swift_context *, const char *,
+    const char *, const char *, size_t, const char *, size_t, unsigned int,
+    const char *, unsigned long);
+/* A segment upload in progress, slots as for swift_range_window with
+ * op_segments the segment each one is sending */
+struct swift_segment_window {
+  struct swift_context *context;
+  const char *data;
+  const char *segment_container;
+  const char *prefix;
+  char *segname;
+  size_t segment_size;
+  struct swift_slo_segment *segments;
+  unsigned int n_segments;
+  unsigned int next_segment;
+  FILE *cp_file;
+
+  struct swift_multi_op *ops;
+  struct swift_range_dest *sources;
+  unsigned int *op_segments;
+  unsigned int *free_slots;
+  unsigned int n_free;
+  swift_error s_err;
+};
+
+STATIC struct swift_multi_op *swift_segment_next(void *);
+STATIC void swift_segment_done(struct swift_multi_op *, void *);
+STATIC swift_error swift_put_segments_fd(struct swift_context *, const char *,
+    const char *, int, const char *, size_t, unsigned int, const char *);
+
+struct swift_cache_block {
+  char *name;
+  unsigned long index;
+  unsigned long hash;
+  char *data;
+  size_t len;
+
+  struct swift_cache_block *hash_next;
+  struct swift_cache_block *lru_prev;
+  struct swift_cache_block *lru_next;
+};
+
+struct swift_block_cache {
+  pthread_mutex_t lock;
+  size_t block_size;
+  size_t max_bytes;
+  size_t cur_bytes;
+  unsigned long hits;
+  unsigned long misses;
+
+  /* Most recently used at the head */
+  struct swift_cache_block *lru_head;
+  struct swift_cache_block *lru_tail;
+  struct swift_cache_block **buckets;
+  unsigned long n_buckets;
+};
+
+struct swift_share {
+  CURLSH *curlshare;
+  pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+};
+
+struct swift_engine {
+  struct swift_context *context;
+  CURLM *multi;
+  swift_socket_callback socket_cb;
+  swift_timer_callback timer_cb;
+  swift_done_callback done_cb;
+  void *user;
+
+  /* Ops added and not yet finished */
+  struct swift_multi_op **ops;
+  unsigned int n_ops;
+  unsigned int ops_size;
+};
+
+/* Hands swift_multi_run() the next op to start, NULL once there is none
+ * for now */
+typedef struct swift_multi_op *(*swift_next_callback)(void *user);
+
+/* Feeds an op list to swift_multi_run() in order */
+struct swift_op_list {
+  struct swift_multi_op *ops;
+  unsigned int n_ops;
+  unsigned int next;
+};
+
+STATIC CURLM *swift_multi_get(struct swift_context *);
+STATIC void swift_multi_put(struct swift_context *, CURLM *);
+STATIC void swift_multi_configure(struct swift_context *, CURLM *);
+STATIC void swift_multi_release(CURLM *, struct swift_multi_op *);
+STATIC void swift_hedge_start(CURLM *, struct swift_multi_op *);
+STATIC int swift_hedge_resolve(CURLM *, struct swift_multi_op **);
+STATIC void swift_hedge_watch(struct swift_multi_op *,
+    struct swift_multi_op **);
+STATIC long swift_hedge_scan(struct swift_context *, CURLM *,
+    struct swift_multi_op **);
+STATIC unsigned int swift_multi_collect(CURLM *, struct swift_multi_op **,
+    swift_done_callback, void *);
+STATIC swift_error swift_multi_run(struct swift_context *, unsigned int,
+    swift_next_callback, swift_done_callback, void *);
+STATIC struct swift_multi_op *swift_op_list_next(void *);
+STATIC int swift_engine_socket(CURL *, curl_socket_t, int, void *, void *);
+STATIC int swift_engine_timer(CURLM *, long, void *);
+STATIC void swift_engine_done(struct swift_multi_op *, void *);
+
+struct swift_async {
+  struct swift_context *context;
+  CURLM *multi;
+
+  /* Ops in flight, and finished ops without a callback, oldest first */
+  struct swift_async_op *running;
+  unsigned int n_running;
+  struct swift_async_op *queue_head;
+  struct swift_async_op *queue_tail;
+};
+
+STATIC swift_error swift_async_begin(struct swift_async *,
+    struct swift_async_op *, swift_async_callback, void *);
+STATIC swift_error swift_async_submit(struct swift_async *,
+    struct swift_async_op *, swift_error);
+STATIC void swift_async_finish(struct swift_async *, struct swift_async_op *,
+    long);
+STATIC unsigned int swift_async_collect(struct swift_async *);
+
+struct swift_listing {
+  struct swift_async *async;
+  char *path;
+  unsigned int limit;
+
+  /* The page being handed out and the one after it, fetched while the
+   * first is worked through.  At most these two are held at once */
+  struct swift_async_op pages[2];
+  int current;
+  int pos;
+  int fetching;
+  int last;
+  swift_error failure;
+};
+
+STATIC swift_error swift_listing_fetch(struct swift_listing *, int,
     const char *);
-STATIC swift_error swift_object_delete_setup(struct swift_context *, const char *,
+
+STATIC void swift_share_lock(CURL *, curl_lock_data, curl_lock_access,
+    void *);
+STATIC void swift_share_unlock(CURL *, curl_lock_data, void *);
+
+#define SWIFT_COMPRESS_NONE 0
+#define SWIFT_COMPRESS_DEFLATE 1
+#define SWIFT_COMPRESS_INFLATE 2
+
+/* Size of the staging buffer files are deflated from and bodies inflated
+ * into, and the most handed to zlib in one go from memory, as its counts
+ * are only an unsigned int wide */
+#define SWIFT_ZSTREAM_CHUNK (64 * 1024)
+
+/* Deflate settings of a context */
+struct swift_compress {
+  int level;
+  unsigned char *dict;
+  size_t dict_len;
+};
+
+/* zlib stream of a single request */
+struct swift_zstream {
+  /* What z is currently set up for, one of SWIFT_COMPRESS_* */
+  int mode;
+  z_stream z;
+  int eof;
+  int finished;
+  unsigned char *staging;
+};
+
+/* Everything one request on a context writes to while it runs.  Requests
+ * live on the caller's stack and hold a pooled easy handle for their
+ * duration */
+struct swift_request {
+  struct swift_context *context;
+  CURL *curlhandle;
+  swift_state state;
+
+  int num_containers;
+  int num_objects;
+  size_t obj_length;
+  char etag[64];
+  char last_modified[64];
+
+  /* Validators sent with the request, empty when unused */
+  char if_none_match[64];
+  char if_modified_since[64];
+
+  /* Nodelist stuff */
+  char *buffer;
+  size_t buffer_pos;
+
+  /* Object data goes straight to this descriptor in the _FD states */
+  int fd;
+
+  /* Status of the response so far, and the token generation it was sent
+   * with */
+  long response;
+  unsigned long auth_generation;
+
+  /* Token, storage URL and seconds until the token expires returned to an
+   * auth request */
+  char *authtoken;
+  char *authurl;
+  unsigned long token_expires;
+
+  int checksum;
+  struct swift_md5 md5;
+
+  /* Uploads are deflated at compress_level, zero for none.  compressed is
+   * set when the object being read was stored compressed,
+   * uncompressed_length is its real size when the writer knew it */
+  int compress_level;
+  struct swift_zstream zstream;
+  int compressed;
+  size_t uncompressed_length;
+
+  /* When the request's deadline runs out, 0 for never, and the transport
+   * failure it ended with, SWIFT_SUCCESS when it got an answer */
+  unsigned long long deadline_at;
+  swift_error failure;
+
+  /* When the first byte of the response came back, and the copy of a
+   * hedged read racing this one */
+  unsigned long long first_byte;
+  struct swift_request *hedge;
+};
+
+STATIC swift_error swift_request_init(struct swift_request *,
+    struct swift_context *);
+STATIC void swift_request_free(struct swift_request *);
+STATIC swift_error swift_authenticate(struct swift_context *,
+    unsigned long long);
+STATIC swift_error swift_ensure_auth(struct swift_context *,
+    unsigned long long);
+STATIC unsigned long long swift_deadline_at(struct swift_context *,
+    unsigned long);
+STATIC swift_error swift_set_timeouts(CURL *, struct swift_context *,
+    unsigned long long);
+STATIC swift_error swift_failure(CURL *, CURLcode, unsigned long long);
+STATIC swift_error swift_request_error(struct swift_request *, long);
+STATIC int swift_request_rewind(struct swift_request *);
+STATIC unsigned long long swift_now_ms(void);
+STATIC int swift_transport_failure(CURLcode);
+STATIC long swift_retry_delay(struct swift_context *, CURLcode, long,
+    unsigned int);
+STATIC void swift_retry_count(struct swift_context *);
+STATIC int swift_ulong_compare(const void *, const void *);
+STATIC unsigned long swift_hedge_percentile(unsigned long *, unsigned int,
+    unsigned int);
+STATIC long swift_hedge_begin(struct swift_context *);
+STATIC int swift_hedge_allow(struct swift_context *);
+STATIC void swift_hedge_launched(struct swift_context *);
+STATIC void swift_hedge_sample(struct swift_context *, unsigned long, int);
+STATIC CURLcode swift_hedge_perform(struct swift_request *, long);
+STATIC struct curl_slist *swift_request_headers(struct swift_request *);
+STATIC void swift_handle_configure(struct swift_context *, CURL *);
+STATIC void swift_set_token(struct swift_context *, char *, char *, time_t);
+STATIC unsigned long swift_auth_generation(struct swift_context *);
+STATIC swift_error swift_reauthenticate(struct swift_context *, unsigned long,
+    unsigned long long);
+STATIC char *swift_token_cache_key(struct swift_context *);
+STATIC swift_error swift_token_cache_load(struct swift_context *);
+STATIC void swift_token_cache_store(struct swift_context *, const char *,
+    const char *, time_t);
+STATIC void *swift_refresh_thread(void *);
+STATIC char *swift_object_url(struct swift_context *, const char *,
     const char *);
 
+STATIC swift_error swift_compress_begin(struct swift_request *, int);
+STATIC void swift_compress_free(struct swift_compress **);
+STATIC size_t swift_deflate_source(struct swift_request *, void *, size_t);
+STATIC size_t swift_inflate_sink(struct swift_request *, void *, size_t);
+
+STATIC char *swift_cache_name(const char *, const char *, const char *);
+STATIC void swift_cache_block_free(struct swift_cache_block *);
+STATIC unsigned long swift_cache_hash(const char *, unsigned long);
+STATIC void swift_cache_unlink(struct swift_block_cache *,
+    struct swift_cache_block *);
+STATIC void swift_cache_push(struct swift_block_cache *,
+    struct swift_cache_block *);
+STATIC struct swift_cache_block **swift_cache_find(struct swift_block_cache *,
+    const char *, unsigned long, unsigned long);
+STATIC void swift_cache_evict(struct swift_block_cache *);
+STATIC int swift_cache_get(struct swift_block_cache *, const char *,
+    unsigned long, void *, size_t *);
+STATIC void swift_cache_put(struct swift_block_cache *, const char *,
+    unsigned long, const void *, size_t);
+STATIC swift_error swift_cache_fetch(struct swift_context *, const char *,
+    const char *, const char *, size_t, char *, unsigned long, unsigned long);
+
 #endif
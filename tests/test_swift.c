@@ -2,6 +2,10 @@
 #include <stdlib.h>
 #include <curl/curl.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 #include "../src/swift.h"
 #include "../src/swift_private.h"
@@ -30,10 +34,12 @@ START_TEST (test_swift_response) {
   
   fail_unless(swift_response(200) == SWIFT_SUCCESS);
   fail_unless(swift_response(201) == SWIFT_SUCCESS);
+  fail_unless(swift_response(304) == SWIFT_ERROR_NOT_MODIFIED);
   fail_unless(swift_response(204) == SWIFT_SUCCESS);
   fail_unless(swift_response(404) == SWIFT_ERROR_NOTFOUND);
   fail_unless(swift_response(401) == SWIFT_ERROR_PERMISSIONS);
   fail_unless(swift_response(400) == SWIFT_ERROR_INTERNAL);
+  fail_unless(swift_response(206) == SWIFT_SUCCESS);
 
   fail_unless(swift_response(405) == SWIFT_ERROR_UNKNOWN);
   fail_unless(swift_response(205) == SWIFT_ERROR_UNKNOWN);
@@ -124,193 +130,297 @@ END_TEST
 
 START_TEST (test_swift_header_callback_authtoken) {
 
-  struct swift_context c;
-  c.state = SWIFT_STATE_AUTH;
+  struct swift_request r;
+  r.state = SWIFT_STATE_AUTH;
 
-  c.authtoken = NULL;
-  swift_header_callback("Nonsensical data", 1, 16, (void *)&c);
-  fail_if(c.authtoken != NULL);
+  r.authtoken = NULL;
+  swift_header_callback("Nonsensical data", 1, 16, (void *)&r);
+  fail_if(r.authtoken != NULL);
 
-  swift_header_callback("X-Auth-Token: ABCDEFG\n", 1, 22, (void *)&c);
-  fail_if(c.authtoken == NULL);
-  fail_if( strcmp(c.authtoken, "X-Auth-Token: ABCDEFG") != 0);
-  fail_unless(c.valid_auth == 1);
+  swift_header_callback("X-Auth-Token: ABCDEFG\n", 1, 22, (void *)&r);
+  fail_if(r.authtoken == NULL);
+  fail_if( strcmp(r.authtoken, "X-Auth-Token: ABCDEFG") != 0);
 
-  swift_header_callback("X-Auth-Token:BADDATA\r\n", 1, 22, (void *)&c);
-  fail_if(c.authtoken == NULL);
-  fail_if( strcmp(c.authtoken, "X-Auth-Token: ABCDEFG") != 0);
-  fail_unless(c.valid_auth == 1);
+  swift_header_callback("X-Auth-Token:BADDATA\r\n", 1, 22, (void *)&r);
+  fail_if(r.authtoken == NULL);
+  fail_if( strcmp(r.authtoken, "X-Auth-Token: ABCDEFG") != 0);
 
-  swift_header_callback("X-Auth-Token: AAAAAAAAAAAAAAAAAAAAAA\r\n", 2, 18, &c);
-  fail_if(c.authtoken == NULL);
-  fail_if( strcmp(c.authtoken, "X-Auth-Token: AAAAAAAAAAAAAAAAAAAAAA") != 0);
-  fail_unless(c.valid_auth == 1);
+  swift_header_callback("X-Auth-Token: AAAAAAAAAAAAAAAAAAAAAA\r\n", 2, 18, &r);
+  fail_if(r.authtoken == NULL);
+  fail_if( strcmp(r.authtoken, "X-Auth-Token: AAAAAAAAAAAAAAAAAAAAAA") != 0);
 
-  free(c.authtoken);
+  free(r.authtoken);
 }
 END_TEST
 
 START_TEST (test_swift_header_callback_authurl) {
 
-  struct swift_context c;
-  c.state = SWIFT_STATE_AUTH;
+  struct swift_request r;
+  r.state = SWIFT_STATE_AUTH;
 
-  c.authurl = NULL;
+  r.authurl = NULL;
 
-  swift_header_callback("Nonsensical data", 1, 16, (void *)&c);
-  fail_if(c.authurl != NULL);
+  swift_header_callback("Nonsensical data", 1, 16, (void *)&r);
+  fail_if(r.authurl != NULL);
 
-  swift_header_callback("X-Storage-Url: ABCDEFG\n", 1, 23, (void *)&c);
-  fail_if(c.authurl == NULL);
-  fail_if( strcmp(c.authurl, "ABCDEFG") != 0);
+  swift_header_callback("X-Storage-Url: ABCDEFG\n", 1, 23, (void *)&r);
+  fail_if(r.authurl == NULL);
+  fail_if( strcmp(r.authurl, "ABCDEFG") != 0);
 
-  swift_header_callback("X-Storage-Url:BADDATA\r\n", 1, 23, (void *)&c);
-  fail_if(c.authurl == NULL);
-  fail_if( strcmp(c.authurl, "ABCDEFG") != 0);
+  swift_header_callback("X-Storage-Url:BADDATA\r\n", 1, 23, (void *)&r);
+  fail_if(r.authurl == NULL);
+  fail_if( strcmp(r.authurl, "ABCDEFG") != 0);
 
-  swift_header_callback("X-Storage-Url: AAAAAAAAAAAAAAAAAAAAA\r\n", 2, 19, (void *)&c);
-  fail_if(c.authurl == NULL);
-  fail_if( strcmp(c.authurl, "AAAAAAAAAAAAAAAAAAAAA") != 0);
+  swift_header_callback("X-Storage-Url: AAAAAAAAAAAAAAAAAAAAA\r\n", 2, 19, (void *)&r);
+  fail_if(r.authurl == NULL);
+  fail_if( strcmp(r.authurl, "AAAAAAAAAAAAAAAAAAAAA") != 0);
 
-  free(c.authurl);
+  r.token_expires = 0;
+  swift_header_callback("X-Auth-Token-Expires: 3599\r\n", 1, 28, (void *)&r);
+  fail_unless(r.token_expires == 3599);
+
+  free(r.authurl);
 }
 END_TEST
 
 START_TEST (test_swift_header_callback_counts) {
 
-  struct swift_context c;
-  c.state = SWIFT_STATE_CONTAINERLIST;
+  struct swift_request r;
+  r.state = SWIFT_STATE_CONTAINERLIST;
+
+  swift_header_callback("X-Account-Container-Count: 20", 1, 29, (void *)&r);
+  fail_unless(r.num_containers == 20);
+
+  swift_header_callback("X-Account-Container-Count:\n", 1, 27, (void *)&r);
+  fail_unless(r.num_containers == 20);
+
+  swift_header_callback("X-Container-Object-Count: 55\r\n", 1, 28, (void *)&r);
+  fail_unless(r.num_objects == 55);
+  fail_unless(r.num_containers == 20);
 
-  swift_header_callback("X-Account-Container-Count: 20", 1, 29, (void *)&c);
-  fail_unless(c.num_containers == 20);
+  swift_header_callback("X-Container-Object-Count:\r\n", 1, 25, (void *)&r);
+  fail_unless(r.num_objects == 55);
+  fail_unless(r.num_containers == 20);
 
-  swift_header_callback("X-Account-Container-Count:\n", 1, 27, (void *)&c);
-  fail_unless(c.num_containers == 20);
+  swift_header_callback("Content-Length: 17743\n", 1, 21, (void *)&r);
+  fail_unless(r.obj_length == 17743);
 
-  swift_header_callback("X-Container-Object-Count: 55\r\n", 1, 28, (void *)&c);
-  fail_unless(c.num_objects == 55);
-  fail_unless(c.num_containers == 20);
+  swift_header_callback("Content-Length:\r\n", 1, 17, (void *)&r);
+  fail_unless(r.obj_length == 17743);
+  fail_unless(r.num_objects == 55);
+  fail_unless(r.num_containers == 20);
 
-  swift_header_callback("X-Container-Object-Count:\r\n", 1, 25, (void *)&c);
-  fail_unless(c.num_objects == 55);
-  fail_unless(c.num_containers == 20);
+  /* HTTP/2 header names arrive in lower case */
+  swift_header_callback("content-length: 12\r\n", 1, 20, (void *)&r);
+  fail_unless(r.obj_length == 12);
+  swift_header_callback("x-container-object-count: 7\r\n", 1, 29, (void *)&r);
+  fail_unless(r.num_objects == 7);
 
-  swift_header_callback("Content-Length: 17743\n", 1, 21, (void *)&c);
-  fail_unless(c.obj_length == 17743);
+  r.etag[0] = '\0';
+  swift_header_callback("ETag: \"d41d8cd98f\"\r\n", 1, 20, (void *)&r);
+  fail_if(strcmp(r.etag, "d41d8cd98f") != 0);
 
-  swift_header_callback("Content-Length:\r\n", 1, 17, (void *)&c);
-  fail_unless(c.obj_length == 17743);
-  fail_unless(c.num_objects == 55);
-  fail_unless(c.num_containers == 20);
+  r.state = SWIFT_STATE_OBJECT_READ;
+  swift_header_callback("Last-Modified: Sat, 17 Oct 2026 10:00:00 GMT\r\n", 1,
+      46, (void *)&r);
+  fail_if(strcmp(r.last_modified, "Sat, 17 Oct 2026 10:00:00 GMT") != 0);
 
 }
 END_TEST
 
 START_TEST (test_swift_body_callback_objlist) {
 
-  struct swift_context c;
+  struct swift_request r;
   int retval;
 
-  memset(&c, 0, sizeof(c));
-  c.state = SWIFT_STATE_OBJECTLIST;
-  c.obj_length = 18;
+  memset(&r, 0, sizeof(r));
+  r.state = SWIFT_STATE_OBJECTLIST;
+  r.obj_length = 18;
 
-  retval = swift_body_callback("Test1\nTe", 2, 4, (void *)&c);
+  retval = swift_body_callback("Test1\nTe", 2, 4, (void *)&r);
   fail_unless(retval == 8);
 
-  retval = swift_body_callback("st2", 1, 3, (void *)&c);
+  retval = swift_body_callback("st2", 1, 3, (void *)&r);
   fail_unless(retval == 3);
 
-  retval = swift_body_callback("\nTest3\n", 7, 1, (void *)&c);
+  retval = swift_body_callback("\nTest3\n", 7, 1, (void *)&r);
   fail_unless(retval == 7);
 
-  retval = swift_body_callback("", 0, 0, (void *)&c);
+  retval = swift_body_callback("", 0, 0, (void *)&r);
   fail_unless(retval == 0);
 
-  fail_if(strcmp(c.buffer, "Test1\nTest2\nTest3\n") != 0);
+  fail_if(strcmp(r.buffer, "Test1\nTest2\nTest3\n") != 0);
 
   /*Buffer is already full, this should fail */
-  retval = swift_body_callback("Test4\n", 6, 1, (void *)&c);
+  retval = swift_body_callback("Test4\n", 6, 1, (void *)&r);
   fail_unless(retval == 0);
 
-  free(c.buffer);
+  free(r.buffer);
+
+  /* Without a length the buffer grows to take every piece */
+  memset(&r, 0, sizeof(r));
+  r.state = SWIFT_STATE_CONTAINERLIST;
+
+  retval = swift_body_callback("Test1\nTe", 2, 4, (void *)&r);
+  fail_unless(retval == 8);
+  fail_if(strcmp(r.buffer, "Test1\nTe") != 0);
+
+  retval = swift_body_callback("st2\nTest3\n", 1, 10, (void *)&r);
+  fail_unless(retval == 10);
+  fail_unless(r.buffer_pos == 18);
+  fail_if(strcmp(r.buffer, "Test1\nTest2\nTest3\n") != 0);
+
+  free(r.buffer);
 }
 END_TEST
 
 START_TEST (test_swift_body_callback_objread) {
 
-  struct swift_context c;
+  struct swift_request r;
   char teststr[21];
   int retval;
 
-  memset(&c, 0, sizeof(c));
+  memset(&r, 0, sizeof(r));
   memset(teststr, 0, 21);
 
-  c.state = SWIFT_STATE_OBJECT_READ;
+  r.state = SWIFT_STATE_OBJECT_READ;
 
-  retval = swift_body_callback("Test1", 5, 1, (void *)&c);
+  retval = swift_body_callback("Test1", 5, 1, (void *)&r);
   fail_unless(retval == 0);
 
-  c.buffer = teststr;
-  retval = swift_body_callback("Test1", 5, 1, (void *)&c);
+  r.buffer = teststr;
+  retval = swift_body_callback("Test1", 5, 1, (void *)&r);
   fail_unless(retval == 0);
 
-  c.obj_length = 20;
-  retval = swift_body_callback("Test1", 5, 1, (void *)&c);
+  r.obj_length = 20;
+  retval = swift_body_callback("Test1", 5, 1, (void *)&r);
   fail_unless(retval == 5);
 
-  retval = swift_body_callback("", 0, 1, (void *)&c);
+  retval = swift_body_callback("", 0, 1, (void *)&r);
   fail_unless(retval == 0);
 
-  retval = swift_body_callback("Test2Test3", 5, 2, (void *)&c);
+  retval = swift_body_callback("Test2Test3", 5, 2, (void *)&r);
   fail_unless(retval == 10);
 
-  retval = swift_body_callback("Test4Test5", 2, 5, (void *)&c);
+  retval = swift_body_callback("Test4Test5", 2, 5, (void *)&r);
   printf("retval=%d\n", retval);
   fail_unless(retval == 5);
 
-  fail_if(strcmp(c.buffer, "Test1Test2Test3Test4") != 0);
+  fail_if(strcmp(r.buffer, "Test1Test2Test3Test4") != 0);
+
+  /* Error bodies are swallowed */
+  r.buffer_pos = 0;
+  r.response = 401;
+  retval = swift_body_callback("Nope!", 5, 1, (void *)&r);
+  fail_unless(retval == 5);
+  fail_unless(r.buffer_pos == 0);
+  fail_if(strcmp(r.buffer, "Test1Test2Test3Test4") != 0);
+
+}
+END_TEST
+
+START_TEST (test_swift_body_callback_objread_fd) {
+
+  struct swift_request r;
+  char teststr[21];
+  int pipefds[2];
+  int retval;
+
+  memset(&r, 0, sizeof(r));
+  memset(teststr, 0, 21);
+  fail_if(pipe(pipefds) != 0);
+
+  r.state = SWIFT_STATE_OBJECT_READ_FD;
+  r.fd = pipefds[1];
+  r.obj_length = 15;
+
+  retval = swift_body_callback("Test1Test2", 5, 2, (void *)&r);
+  fail_unless(retval == 10);
+  fail_unless(r.buffer_pos == 10);
+
+  /* Data past the object length is refused */
+  retval = swift_body_callback("Test3Test4", 5, 2, (void *)&r);
+  fail_unless(retval == 5);
+  fail_unless(r.buffer_pos == 15);
+
+  fail_unless(read(pipefds[0], teststr, 20) == 15);
+  fail_if(strcmp(teststr, "Test1Test2Test3") != 0);
+
+  close(pipefds[0]);
+  close(pipefds[1]);
+
+}
+END_TEST
+
+START_TEST (test_swift_body_callback_large) {
+
+  struct swift_request r;
+  size_t start = (size_t)INT_MAX - 4;
+  int retval;
+
+  memset(&r, 0, sizeof(r));
+  r.state = SWIFT_STATE_OBJECT_READ_FD;
+  r.fd = open("/dev/null", O_WRONLY);
+  fail_if(r.fd < 0);
+  r.obj_length = (size_t)INT_MAX + 20;
+  r.buffer_pos = start;
+
+  /* Positions past 2 GiB keep counting */
+  retval = swift_body_callback("Test1Test2", 5, 2, (void *)&r);
+  fail_unless(retval == 10);
+  fail_unless(r.buffer_pos == start + 10);
+
+  retval = swift_body_callback("Test3Test4", 5, 2, (void *)&r);
+  fail_unless(retval == 10);
+  fail_unless(r.buffer_pos == start + 20);
+
+  /* Data past the object length is still refused */
+  retval = swift_body_callback("Test5Test6", 5, 2, (void *)&r);
+  fail_unless(retval == 4);
+  fail_unless(r.buffer_pos == r.obj_length);
+
+  close(r.fd);
 
 }
 END_TEST
 
 START_TEST (test_swift_upload_callback) {
 
-  struct swift_context c;
+  struct swift_request r;
   char teststr[22];
   char testbuf[21];
   int retval;
 
-  memset(&c, 0, sizeof(c));
+  memset(&r, 0, sizeof(r));
   memset(testbuf, 0, 21);
-  c.buffer = teststr;
-  c.obj_length = 20;
-  c.state = SWIFT_STATE_AUTH;
+  r.buffer = teststr;
+  r.obj_length = 20;
+  r.state = SWIFT_STATE_AUTH;
 
   strcpy(teststr, "Test1");
-  retval = swift_upload_callback(testbuf, 1, 5, (void *)&c);
+  retval = swift_upload_callback(testbuf, 1, 5, (void *)&r);
   fail_unless(retval == CURL_READFUNC_ABORT);
   fail_if(strcmp("", testbuf) != 0);
 
-  c.state = SWIFT_STATE_OBJECT_WRITE;
+  r.state = SWIFT_STATE_OBJECT_WRITE;
 
   strcpy(teststr, "Test1Test2Test3Test4A");
 
   /*Test first word: "Test1" */
   memset(testbuf, 0, 21);
-  retval = swift_upload_callback(testbuf, 5, 1, (void *)&c);
+  retval = swift_upload_callback(testbuf, 5, 1, (void *)&r);
   fail_unless(retval == 5);
   fail_if(strcmp("Test1", testbuf) != 0);
 
   /*Test rest of buffer size, "Test2Test3Test4" */
   memset(testbuf, 0, 21);
-  retval = swift_upload_callback(testbuf, 3, 5, (void *)&c);
+  retval = swift_upload_callback(testbuf, 3, 5, (void *)&r);
   fail_unless(retval == 15);
   fail_if(strcmp(testbuf, "Test2Test3Test4") != 0);
 
   /*Attempt one more character after maximum size*/
   memset(testbuf, 0, 21);
-  retval = swift_upload_callback(teststr, 1, 1, (void *)&c);
+  retval = swift_upload_callback(teststr, 1, 1, (void *)&r);
   fail_unless(retval == 0);
   fail_if(strcmp(testbuf, "") != 0);
 
@@ -318,6 +428,202 @@ START_TEST (test_swift_upload_callback) {
 END_TEST
 
 
+START_TEST (test_swift_upload_callback_fd) {
+
+  struct swift_request r;
+  char testbuf[21];
+  int pipefds[2];
+  int retval;
+
+  memset(&r, 0, sizeof(r));
+  memset(testbuf, 0, 21);
+  fail_if(pipe(pipefds) != 0);
+
+  r.state = SWIFT_STATE_OBJECT_WRITE_FD;
+  r.fd = pipefds[0];
+
+  fail_unless(write(pipefds[1], "Test1Test2", 10) == 10);
+  retval = swift_upload_callback(testbuf, 1, 20, (void *)&r);
+  fail_unless(retval == 10);
+  fail_unless(r.buffer_pos == 10);
+  fail_if(strcmp(testbuf, "Test1Test2") != 0);
+
+  /* End of file ends the upload */
+  close(pipefds[1]);
+  retval = swift_upload_callback(testbuf, 1, 20, (void *)&r);
+  fail_unless(retval == 0);
+
+  close(pipefds[0]);
+
+}
+END_TEST
+
+START_TEST (test_swift_compress_callbacks) {
+
+  struct swift_context c;
+  struct swift_request w;
+  struct swift_request r;
+  const char *dict = "{\"level\": \"info\", \"message\": \"";
+  const char *data = "{\"level\": \"info\", \"message\": \"hello\"}\n"
+    "{\"level\": \"info\", \"message\": \"world\"}\n";
+  char packed[256];
+  char unpacked[256];
+  size_t packed_len = 0;
+  size_t n;
+
+  memset(&c, 0, sizeof(c));
+  fail_unless(swift_context_set_compression(&c, 10, NULL, 0) ==
+      SWIFT_ERROR_INTERNAL);
+  fail_unless(swift_context_set_compression(&c, 9, dict, strlen(dict)) ==
+      SWIFT_SUCCESS);
+
+  memset(&w, 0, sizeof(w));
+  w.context = &c;
+  w.compress_level = 9;
+  w.state = SWIFT_STATE_OBJECT_WRITE;
+  w.buffer = (char *)data;
+  w.obj_length = strlen(data);
+  fail_unless(swift_compress_begin(&w, SWIFT_COMPRESS_DEFLATE) == SWIFT_SUCCESS);
+
+  /* Curl asks in small pieces until the stream is done */
+  while ( (n = swift_upload_callback(packed + packed_len, 1, 7, &w)) ) {
+    fail_if(n > 7);
+    packed_len += n;
+  }
+  fail_unless(packed_len > 0);
+  fail_unless(packed_len < strlen(data));
+
+  /* Readers share the context's dictionary but not its stream */
+  memset(&r, 0, sizeof(r));
+  memset(unpacked, 0, sizeof(unpacked));
+  r.context = &c;
+  r.state = SWIFT_STATE_OBJECT_READ;
+  r.buffer = unpacked;
+  r.obj_length = sizeof(unpacked);
+
+  swift_header_callback("X-Object-Meta-Compression: deflate\r\n", 1, 36, &r);
+  fail_unless(r.compressed == 1);
+  fail_unless(swift_body_callback(packed, 1, 5, &r) == 5);
+  fail_unless(swift_body_callback(packed + 5, 1, packed_len - 5, &r) ==
+      packed_len - 5);
+  fail_unless(r.buffer_pos == strlen(data));
+  fail_if(strcmp(unpacked, data) != 0);
+
+  /* Without the dictionary the body can not be read */
+  r.context = NULL;
+  r.buffer_pos = 0;
+  swift_header_callback("X-Object-Meta-Compression: deflate\r\n", 1, 36, &r);
+  fail_unless(swift_body_callback(packed, 1, packed_len, &r) == 0);
+
+  swift_compress_begin(&r, SWIFT_COMPRESS_NONE);
+  swift_compress_begin(&w, SWIFT_COMPRESS_NONE);
+  free(r.zstream.staging);
+  free(w.zstream.staging);
+  swift_compress_free(&c.compress);
+  fail_unless(c.compress == NULL);
+}
+END_TEST
+
+START_TEST (test_swift_range_dest_callback) {
+
+  struct swift_range_dest dest;
+  char testbuf[21];
+
+  memset(testbuf, 0, 21);
+  dest.ptr = testbuf;
+  dest.pos = 5;
+  dest.end = 15;
+
+  fail_unless(swift_range_dest_callback("Test1", 5, &dest) == 5);
+  fail_unless(dest.pos == 10);
+  fail_unless(swift_range_dest_callback("Test2", 5, &dest) == 5);
+  fail_unless(dest.pos == 15);
+  fail_if(memcmp(testbuf + 5, "Test1Test2", 10) != 0);
+
+  /* Never write past the end of the range */
+  fail_unless(swift_range_dest_callback("Test3", 5, &dest) == 0);
+  fail_unless(dest.pos == 15);
+  fail_unless(testbuf[15] == '\0');
+
+  /* Retries start the range over */
+  dest.start = 5;
+  fail_unless(swift_range_rewind(&dest) == 1);
+  fail_unless(dest.pos == 5);
+
+}
+END_TEST
+
+START_TEST (test_swift_range_source_callback) {
+
+  struct swift_range_dest source;
+  char testbuf[21];
+
+  memset(testbuf, 0, 21);
+  source.ptr = "Test1Test2Test3";
+  source.pos = 5;
+  source.end = 15;
+
+  fail_unless(swift_range_source_callback(testbuf, 6, &source) == 6);
+  fail_if(strcmp(testbuf, "Test2T") != 0);
+  fail_unless(swift_range_source_callback(testbuf, 6, &source) == 4);
+  fail_if(memcmp(testbuf, "est3", 4) != 0);
+  fail_unless(swift_range_source_callback(testbuf, 6, &source) == 0);
+
+}
+END_TEST
+
+START_TEST (test_swift_multi_header_callback) {
+
+  struct swift_multi_op op;
+
+  memset(&op, 0, sizeof(op));
+
+  swift_multi_header_callback("HTTP/1.1 401 Unauthorized\r\n", 1, 27, &op);
+  fail_unless(op.response == 401);
+
+  swift_multi_header_callback("Content-Length: 0\r\n", 1, 19, &op);
+  fail_unless(op.etag[0] == '\0');
+
+  swift_multi_header_callback("ETag: d41d8cd98f00b204e9800998ecf8427e\r\n",
+      1, 40, &op);
+  fail_if(strcmp(op.etag, "d41d8cd98f00b204e9800998ecf8427e") != 0);
+
+  /* SLO manifests return a quoted ETag */
+  swift_multi_header_callback("Etag: \"0123456789abcdef\"\r\n", 1, 26, &op);
+  fail_if(strcmp(op.etag, "0123456789abcdef") != 0);
+
+  /* Reads of compressed objects are ended before any body arrives */
+  op.mode = SWIFT_READ;
+  fail_unless(swift_multi_header_callback(
+        "X-Object-Meta-Compression: deflate\r\n", 1, 36, &op) == 0);
+  fail_unless(op.compressed == 1);
+
+}
+END_TEST
+
+START_TEST (test_swift_load_op) {
+
+  struct swift_multi_op op;
+
+  memset(&op, 0xff, sizeof(op));
+  swift_load_op(&op, NULL, "cont", "obj", SWIFT_WRITE, NULL, &op);
+  fail_if(strcmp(op.container, "cont") != 0);
+  fail_if(strcmp(op.objname, "obj") != 0);
+  fail_unless(op.mode == SWIFT_WRITE);
+  fail_unless(op.userdata == &op);
+
+  /* Nothing is left over from an earlier use of the op */
+  fail_unless(op.length == 0);
+  fail_unless(op.sent_at == 0);
+  fail_unless(op.retry_at == 0);
+  fail_unless(op.deadline_at == 0);
+  fail_unless(op.hedge == NULL);
+  fail_unless(op.hedge_next == NULL);
+  fail_unless(op.md5.skip == 0);
+
+}
+END_TEST
+
 START_TEST (test_swift_context_create) {
 
   struct swift_context *c;
@@ -339,26 +645,85 @@ END_TEST
 START_TEST (test_swift_node_list_setup) {
 
   struct swift_context c;
+  struct swift_request r;
   char *url;
 
 
-  c.curlhandle = curl_easy_init();
+  memset(&c, 0, sizeof(c));
+  memset(&r, 0, sizeof(r));
+  r.context = &c;
+  r.curlhandle = curl_easy_init();
   c.authurl = "http://swiftbox";
 
-  fail_unless(swift_node_list_setup(&c, "") == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_node_list_setup(&r, "") == SWIFT_ERROR_NOTFOUND);
   fail_unless(swift_node_list_setup(NULL, NULL) == SWIFT_ERROR_NOTFOUND);
 
-  fail_unless(swift_node_list_setup(&c, "/") == SWIFT_SUCCESS);
-  fail_unless(c.state == SWIFT_STATE_CONTAINERLIST);
-  curl_easy_getinfo(c.curlhandle, CURLINFO_EFFECTIVE_URL, &url);
+  fail_unless(swift_node_list_setup(&r, "/") == SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_CONTAINERLIST);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &url);
   fail_if(strcmp("http://swiftbox/", url) != 0);
 
-  fail_unless(swift_node_list_setup(&c, "/mypath") == SWIFT_SUCCESS);
-  fail_unless(c.state == SWIFT_STATE_OBJECTLIST);
-  curl_easy_getinfo(c.curlhandle, CURLINFO_EFFECTIVE_URL, &url);
+  fail_unless(swift_node_list_setup(&r, "/mypath") == SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_OBJECTLIST);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &url);
   fail_if(strcmp("http://swiftbox/mypath", url) != 0);
 
-  curl_easy_cleanup(c.curlhandle);
+  curl_easy_cleanup(r.curlhandle);
+
+}
+END_TEST
+
+START_TEST (test_swift_node_page_setup) {
+
+  struct swift_context c;
+  struct swift_request r;
+  struct swift_listing *listing = NULL;
+  const char *name;
+  char *url;
+  char list[] = "a\nb b\nc\n";
+
+  memset(&c, 0, sizeof(c));
+  memset(&r, 0, sizeof(r));
+  r.context = &c;
+  r.curlhandle = curl_easy_init();
+  c.authurl = "http://swiftbox";
+
+  fail_unless(swift_node_page_setup(&r, "/cont", NULL, 0) == SWIFT_SUCCESS);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &url);
+  fail_if(strcmp("http://swiftbox/cont", url) != 0);
+
+  fail_unless(swift_node_page_setup(&r, "/cont", NULL, 100) == SWIFT_SUCCESS);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &url);
+  fail_if(strcmp("http://swiftbox/cont?limit=100", url) != 0);
+
+  /* Markers are escaped */
+  fail_unless(swift_node_page_setup(&r, "/cont", "b b/c", 10) ==
+      SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_OBJECTLIST);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &url);
+  fail_if(strcmp("http://swiftbox/cont?limit=10&marker=b%20b%2Fc", url) != 0);
+
+  fail_unless(swift_node_page_setup(&r, "/", "x", 0) == SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_CONTAINERLIST);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &url);
+  fail_if(strcmp("http://swiftbox/?marker=x", url) != 0);
+
+  fail_unless(swift_node_page_setup(&r, "cont", "x", 0) ==
+      SWIFT_ERROR_NOTFOUND);
+
+  curl_easy_cleanup(r.curlhandle);
+
+  /* Pages are counted by their names, not the count headers */
+  fail_unless(swift_list_entries(NULL) == 0);
+  fail_unless(swift_list_entries("") == 0);
+  fail_unless(swift_list_entries(list) == 3);
+
+  fail_unless(swift_listing_create(&listing, NULL, "/cont", NULL, 0) ==
+      SWIFT_ERROR_NOTFOUND);
+  fail_unless(listing == NULL);
+  fail_unless(swift_listing_next(NULL, &name) == SWIFT_ERROR_NOTFOUND);
+  swift_listing_delete(&listing);
+  swift_listing_delete(NULL);
 
 }
 END_TEST
@@ -387,28 +752,32 @@ END_TEST
 START_TEST (test_swift_container_create_setup) {
 
   struct swift_context c;
+  struct swift_request r;
   char *data;
   struct test_curl_params *params = test_curl_getparams();
 
   fail_unless(swift_container_create_setup(NULL, "test") == SWIFT_ERROR_NOTFOUND);
-  fail_unless(swift_container_create_setup(&c, NULL) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_container_create_setup(&r, NULL) == SWIFT_ERROR_NOTFOUND);
 
-  c.curlhandle = curl_easy_init();
+  memset(&c, 0, sizeof(c));
+  memset(&r, 0, sizeof(r));
+  r.context = &c;
+  r.curlhandle = curl_easy_init();
   c.authurl = "http://swiftbox";
 
-  fail_if(swift_container_create_setup(&c, "") != SWIFT_SUCCESS);
-  fail_unless(c.state == SWIFT_STATE_CONTAINER_CREATE);
+  fail_if(swift_container_create_setup(&r, "") != SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_CONTAINER_CREATE);
   fail_if(strcmp(params->request, "PUT") != 0);
-  curl_easy_getinfo(c.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
   fail_if(strcmp(data, "http://swiftbox/") != 0);
 
-  fail_if(swift_container_create_setup(&c, "testcont") != SWIFT_SUCCESS);
-  fail_unless(c.state == SWIFT_STATE_CONTAINER_CREATE);
+  fail_if(swift_container_create_setup(&r, "testcont") != SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_CONTAINER_CREATE);
   fail_if(strcmp(params->request, "PUT") != 0);
-  curl_easy_getinfo(c.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
   fail_if(strcmp(data, "http://swiftbox/testcont") != 0);
 
-  curl_easy_cleanup(c.curlhandle);
+  curl_easy_cleanup(r.curlhandle);
 
 }
 END_TEST
@@ -417,24 +786,28 @@ END_TEST
 START_TEST (test_swift_container_delete_setup) {
 
   struct swift_context c;
+  struct swift_request r;
   char *data;
   struct test_curl_params *params = test_curl_getparams();
 
   fail_unless(swift_container_delete_setup(NULL, "test") == SWIFT_ERROR_NOTFOUND);
-  fail_unless(swift_container_delete_setup(&c, NULL) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_container_delete_setup(&r, NULL) == SWIFT_ERROR_NOTFOUND);
 
-  c.curlhandle = curl_easy_init();
+  memset(&c, 0, sizeof(c));
+  memset(&r, 0, sizeof(r));
+  r.context = &c;
+  r.curlhandle = curl_easy_init();
   c.authurl = "http://swiftbox";
 
-  fail_if(swift_container_delete_setup(&c, "") != SWIFT_ERROR_EXISTS);
+  fail_if(swift_container_delete_setup(&r, "") != SWIFT_ERROR_EXISTS);
 
-  fail_if(swift_container_delete_setup(&c, "testcont") != SWIFT_SUCCESS);
-  fail_unless(c.state == SWIFT_STATE_CONTAINER_DELETE);
+  fail_if(swift_container_delete_setup(&r, "testcont") != SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_CONTAINER_DELETE);
   fail_if(strcmp(params->request, "DELETE") != 0);
-  curl_easy_getinfo(c.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
   fail_if(strcmp(data, "http://swiftbox/testcont") != 0);
 
-  curl_easy_cleanup(c.curlhandle);
+  curl_easy_cleanup(r.curlhandle);
 
 }
 END_TEST
@@ -443,24 +816,28 @@ END_TEST
 START_TEST (test_swift_object_exists_setup) {
 
   struct swift_context c;
+  struct swift_request r;
   char *data;
   struct test_curl_params *params = test_curl_getparams();
 
   fail_unless(swift_object_exists_setup(NULL, "", "") == SWIFT_ERROR_NOTFOUND);
-  fail_unless(swift_object_exists_setup(&c, NULL, "") == SWIFT_ERROR_NOTFOUND);
-  fail_unless(swift_object_exists_setup(&c, "", NULL) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_object_exists_setup(&r, NULL, "") == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_object_exists_setup(&r, "", NULL) == SWIFT_ERROR_NOTFOUND);
 
-  c.curlhandle = curl_easy_init();
+  memset(&c, 0, sizeof(c));
+  memset(&r, 0, sizeof(r));
+  r.context = &c;
+  r.curlhandle = curl_easy_init();
   c.authurl = "http://swiftbox";
 
 
-  fail_if(swift_object_exists_setup(&c, "testcont", "testobj") != SWIFT_SUCCESS);
-  fail_unless(c.state == SWIFT_STATE_OBJECT_EXISTS);
+  fail_if(swift_object_exists_setup(&r, "testcont", "testobj") != SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_OBJECT_EXISTS);
   fail_unless(params->nobody == 1);
-  curl_easy_getinfo(c.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
   fail_if(strcmp(data, "http://swiftbox/testcont/testobj") != 0);
 
-  curl_easy_cleanup(c.curlhandle);
+  curl_easy_cleanup(r.curlhandle);
 
 }
 END_TEST
@@ -469,23 +846,27 @@ END_TEST
 START_TEST (test_swift_object_delete_setup) {
 
   struct swift_context c;
+  struct swift_request r;
   char *data;
   struct test_curl_params *params = test_curl_getparams();
 
   fail_unless(swift_object_delete_setup(NULL, "", "") == SWIFT_ERROR_NOTFOUND);
-  fail_unless(swift_object_delete_setup(&c, NULL, "") == SWIFT_ERROR_NOTFOUND);
-  fail_unless(swift_object_delete_setup(&c, "", NULL) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_object_delete_setup(&r, NULL, "") == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_object_delete_setup(&r, "", NULL) == SWIFT_ERROR_NOTFOUND);
 
-  c.curlhandle = curl_easy_init();
+  memset(&c, 0, sizeof(c));
+  memset(&r, 0, sizeof(r));
+  r.context = &c;
+  r.curlhandle = curl_easy_init();
   c.authurl = "http://swiftbox";
 
-  fail_if(swift_object_delete_setup(&c, "testcont", "testobj") != SWIFT_SUCCESS);
-  fail_unless(c.state == SWIFT_STATE_OBJECT_DELETE);
+  fail_if(swift_object_delete_setup(&r, "testcont", "testobj") != SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_OBJECT_DELETE);
   fail_if(strcmp(params->request, "DELETE") != 0);
-  curl_easy_getinfo(c.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
+  curl_easy_getinfo(r.curlhandle, CURLINFO_EFFECTIVE_URL, &data);
   fail_if(strcmp(data, "http://swiftbox/testcont/testobj") != 0);
 
-  curl_easy_cleanup(c.curlhandle);
+  curl_easy_cleanup(r.curlhandle);
 }
 END_TEST
 
@@ -501,6 +882,7 @@ START_TEST (test_swift_free_transfer_handle) {
 
   handle = (struct swift_transfer_handle *)malloc(
       sizeof(struct swift_transfer_handle));
+  memset(handle, 0, sizeof(struct swift_transfer_handle));
 
   handle->ptr = malloc(1);
   handle->object = malloc(1);
@@ -561,16 +943,21 @@ END_TEST
 START_TEST (test_swift_sync_setup_read) {
 
   struct swift_context c;
+  struct swift_request r;
   struct swift_transfer_handle h;
   struct test_curl_params *params = test_curl_getparams();
   char tempbuf[100];
 
   memset(&h, 0, sizeof(h));
+  memset(&c, 0, sizeof(c));
 
-  fail_unless(swift_sync_setup(NULL) == SWIFT_ERROR_NOTFOUND);
-  fail_unless(swift_sync_setup(&h) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_sync_setup(NULL, &r) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_sync_setup(&h, NULL) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_sync_setup(&h, &r) == SWIFT_ERROR_NOTFOUND);
 
+  c.valid_auth = 1;
   c.authurl = "http://swiftbox";
+  fail_unless(swift_request_init(&r, &c) == SWIFT_SUCCESS);
 
   h.parent = &c;
   h.container = "testcont";
@@ -579,31 +966,72 @@ START_TEST (test_swift_sync_setup_read) {
   h.length = 100;
   h.mode = SWIFT_READ;
 
-  fail_unless(swift_sync_setup(&h) == SWIFT_SUCCESS);
+  fail_unless(swift_sync_setup(&h, &r) == SWIFT_SUCCESS);
   fail_if(strcmp(params->url, "http://swiftbox/testcont/testobj") != 0);
-  fail_unless(c.state == SWIFT_STATE_OBJECT_READ);
-  fail_unless(c.buffer == h.ptr);
-  fail_unless(c.buffer_pos == 0);
-  fail_unless(c.obj_length == 100);
+  fail_unless(r.state == SWIFT_STATE_OBJECT_READ);
+  fail_unless(r.buffer == h.ptr);
+  fail_unless(r.buffer_pos == 0);
+  fail_unless(r.obj_length == 100);
   fail_unless(params->upload == 0);
 
+  /* The easy handle goes back to the context when the request is done */
+  swift_request_free(&r);
+  fail_unless(r.curlhandle == NULL);
+  fail_unless(c.pool_count == 1);
+  curl_easy_cleanup(c.pool[0]);
+
 }
 END_TEST
 
 
+START_TEST (test_swift_sync_setup_read_fd) {
+
+  struct swift_context c;
+  struct swift_request r;
+  struct swift_transfer_handle h;
+
+  memset(&h, 0, sizeof(h));
+  memset(&c, 0, sizeof(c));
+
+  c.valid_auth = 1;
+  c.authurl = "http://swiftbox";
+  fail_unless(swift_request_init(&r, &c) == SWIFT_SUCCESS);
+
+  h.parent = &c;
+  h.container = "testcont";
+  h.object = "testobj";
+  h.length = 100;
+  h.mode = SWIFT_READ;
+  h.type = SWIFT_HANDLE_FD;
+  h.fd = 7;
+
+  fail_unless(swift_sync_setup(&h, &r) == SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_OBJECT_READ_FD);
+  fail_unless(r.fd == 7);
+  fail_unless(r.obj_length == 100);
+
+  curl_easy_cleanup(r.curlhandle);
+}
+END_TEST
+
 START_TEST (test_swift_sync_setup_write) {
 
   struct swift_context c;
+  struct swift_request r;
   struct swift_transfer_handle h;
   struct test_curl_params *params = test_curl_getparams();
   char tempbuf[100];
 
   memset(&h, 0, sizeof(h));
+  memset(&c, 0, sizeof(c));
 
-  fail_unless(swift_sync_setup(NULL) == SWIFT_ERROR_NOTFOUND);
-  fail_unless(swift_sync_setup(&h) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_sync_setup(NULL, &r) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_sync_setup(&h, NULL) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_sync_setup(&h, &r) == SWIFT_ERROR_NOTFOUND);
 
+  c.valid_auth = 1;
   c.authurl = "http://swiftbox";
+  fail_unless(swift_request_init(&r, &c) == SWIFT_SUCCESS);
 
   h.parent = &c;
   h.container = "testcont";
@@ -612,16 +1040,161 @@ START_TEST (test_swift_sync_setup_write) {
   h.length = 100;
   h.mode = SWIFT_WRITE;
 
-  fail_unless(swift_sync_setup(&h) == SWIFT_SUCCESS);
+  fail_unless(swift_sync_setup(&h, &r) == SWIFT_SUCCESS);
   fail_if(strcmp(params->url, "http://swiftbox/testcont/testobj") != 0);
-  fail_unless(c.state == SWIFT_STATE_OBJECT_WRITE);
-  fail_unless(c.buffer == h.ptr);
-  fail_unless(c.buffer_pos == 0);
-  fail_unless(c.obj_length == 100);
+  fail_unless(r.state == SWIFT_STATE_OBJECT_WRITE);
+  fail_unless(r.buffer == h.ptr);
+  fail_unless(r.buffer_pos == 0);
+  fail_unless(r.obj_length == 100);
   fail_unless(params->upload == 1);
   fail_unless(params->infilesize == 100);
   fail_unless(params->readfunc == (curl_read_callback)swift_upload_callback);
-  fail_unless(params->readdata == &c);
+  fail_unless(params->readdata == &r);
+
+  curl_easy_cleanup(r.curlhandle);
+}
+END_TEST
+
+START_TEST (test_swift_sync_setup_write_fd) {
+
+  struct swift_context c;
+  struct swift_request r;
+  struct swift_transfer_handle h;
+  struct test_curl_params *params = test_curl_getparams();
+
+  memset(&h, 0, sizeof(h));
+  memset(&c, 0, sizeof(c));
+
+  c.valid_auth = 1;
+  c.authurl = "http://swiftbox";
+  fail_unless(swift_request_init(&r, &c) == SWIFT_SUCCESS);
+
+  h.parent = &c;
+  h.container = "testcont";
+  h.object = "testobj";
+  h.mode = SWIFT_WRITE;
+  h.type = SWIFT_HANDLE_FD;
+  h.fd = 7;
+
+  /* Unknown length, the size must be left for chunked encoding */
+  fail_unless(swift_sync_setup(&h, &r) == SWIFT_SUCCESS);
+  fail_unless(r.state == SWIFT_STATE_OBJECT_WRITE_FD);
+  fail_unless(r.fd == 7);
+  fail_unless(params->upload == 1);
+  fail_unless(params->infilesize == 0);
+  fail_unless(params->readfunc == (curl_read_callback)swift_upload_callback);
+
+  h.length = 100;
+  fail_unless(swift_sync_setup(&h, &r) == SWIFT_SUCCESS);
+  fail_unless(params->infilesize == 100);
+
+  /* Files past 2 GiB are sent with their whole size */
+  h.length = (unsigned long)INT_MAX + 100;
+  fail_unless(swift_sync_setup(&h, &r) == SWIFT_SUCCESS);
+  fail_unless(params->infilesize == (curl_off_t)INT_MAX + 100);
+
+  curl_easy_cleanup(r.curlhandle);
+}
+END_TEST
+
+START_TEST (test_swift_handle_pool) {
+
+  struct swift_context c;
+  CURL *handles[SWIFT_HANDLE_POOL + 1];
+  CURL *handle;
+  int i;
+
+  memset(&c, 0, sizeof(c));
+
+  handle = swift_handle_get(&c);
+  fail_if(handle == NULL);
+  swift_handle_put(&c, handle);
+  fail_unless(c.pool_count == 1);
+
+  /* The idle handle is handed out again rather than a new one */
+  fail_unless(swift_handle_get(&c) == handle);
+  fail_unless(c.pool_count == 0);
+  swift_handle_put(&c, handle);
+
+  for (i = 0; i < SWIFT_HANDLE_POOL + 1; ++i) {
+    handles[i] = swift_handle_get(&c);
+    fail_if(handles[i] == NULL);
+  }
+  fail_unless(c.pool_count == 0);
+
+  /* Handles beyond the pool size are cleaned up */
+  for (i = 0; i < SWIFT_HANDLE_POOL + 1; ++i) {
+    swift_handle_put(&c, handles[i]);
+  }
+  fail_unless(c.pool_count == SWIFT_HANDLE_POOL);
+
+  swift_handle_put(&c, NULL);
+  fail_unless(c.pool_count == SWIFT_HANDLE_POOL);
+
+  while (c.pool_count) {
+    curl_easy_cleanup(c.pool[--c.pool_count]);
+  }
+
+  /* Every handle handed out speaks the protocol asked for */
+  fail_unless(swift_context_set_http2(&c, 7, 0) == SWIFT_ERROR_INTERNAL);
+  fail_if(swift_context_set_http2(&c, SWIFT_HTTP2_PRIOR_KNOWLEDGE, 2));
+  fail_unless(c.max_connections == 2);
+  handle = swift_handle_get(&c);
+  fail_unless(test_curl_getparams()->http_version ==
+      CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+  swift_handle_put(&c, handle);
+  fail_if(swift_context_set_http2(&c, SWIFT_HTTP1, 0));
+  fail_unless(c.max_connections == SWIFT_HTTP2_CONNECTIONS);
+  handle = swift_handle_get(&c);
+  fail_unless(test_curl_getparams()->http_version == CURL_HTTP_VERSION_1_1);
+  curl_easy_cleanup(handle);
+}
+END_TEST
+
+START_TEST (test_swift_compressed_head) {
+
+  struct swift_context c;
+  struct swift_transfer_handle *handle = NULL;
+  struct test_curl_params *params;
+  size_t length;
+
+  memset(&c, 0, sizeof(c));
+  c.authurl = "http://swiftbox";
+  c.authtoken = "AUTHTOKEN";
+  c.valid_auth = 1;
+  /* Requests take this handle, which keeps the canned headers */
+  c.pool[c.pool_count++] = curl_easy_init();
+  params = test_curl_getparams();
+  params->response_code = 200;
+  params->response_headers = "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 10\r\n"
+    "X-Object-Meta-Compression: deflate\r\n"
+    "X-Object-Meta-Uncompressed-Length: 100\r\n";
+
+  /* Callers see the size of the data, ranges of it can not be inflated
+   * and are refused */
+  fail_unless(swift_object_exists(&c, "cont", "obj", &length) ==
+      SWIFT_SUCCESS);
+  fail_unless(length == 100);
+  fail_unless(swift_object_range_length(&c, "cont", "obj", &length) ==
+      SWIFT_ERROR_COMPRESSED);
+  fail_unless(swift_object_rangehandle(&c, "cont", "obj", &handle) ==
+      SWIFT_ERROR_COMPRESSED);
+  fail_unless(handle == NULL);
+  fail_unless(swift_object_get_parallel(&c, "cont", "obj", &length,
+        sizeof(length), 0, 0) == SWIFT_ERROR_COMPRESSED);
+
+  /* Uncompressed objects are planned over their length */
+  params->response_headers = "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 10\r\n";
+  fail_unless(swift_object_range_length(&c, "cont", "obj", &length) ==
+      SWIFT_SUCCESS);
+  fail_unless(length == 10);
+
+  params->response_headers = NULL;
+  while (c.pool_count) {
+    curl_easy_cleanup(c.pool[--c.pool_count]);
+  }
 
 }
 END_TEST
@@ -632,26 +1205,64 @@ START_TEST (test_swift_perform) {
   const int response = 200;
 
   struct swift_context c;
+  struct swift_request r;
   struct test_curl_params *params = test_curl_getparams();
 
+  memset(&c, 0, sizeof(c));
+  memset(&r, 0, sizeof(r));
+  r.context = &c;
   test_curl_easy_reset(&c);
   c.authtoken = (char *)malloc(strlen(token) + 1);
   strcpy(c.authtoken, token);
   params->response_code = response;
 
-  fail_unless(swift_perform(&c) == response);
+  fail_unless(swift_perform(&r) == response);
   fail_unless(params->headerfunc == (curl_write_callback)swift_header_callback);
-  fail_unless(params->headerdata == &c);
+  fail_unless(params->headerdata == &r);
   fail_unless(params->writefunc == (curl_write_callback)swift_body_callback);
-  fail_unless(params->writedata == &c);
+  fail_unless(params->writedata == &r);
   
   fail_if(params->headers == NULL);
   fail_if(strcmp(params->headers->data, token) != 0);
   fail_unless(params->headers->next == NULL);
 
+  /* Validators become conditional request headers */
+  strcpy(r.if_none_match, "abc123");
+  fail_unless(swift_perform(&r) == response);
+  fail_if(params->headers->next == NULL);
+  fail_if(strcmp(params->headers->next->data, "If-None-Match: abc123") != 0);
+
+  /* A 401 is only sent again once there are credentials to renew with */
+  params->response_code = 401;
+  fail_unless(swift_perform(&r) == 401);
+  fail_unless(swift_request_error(&r, 401) == SWIFT_ERROR_PERMISSIONS);
+
+  /* Nothing goes out once the deadline has passed */
+  params->response_code = 200;
+  r.deadline_at = 1;
+  fail_unless(swift_perform(&r) == 0);
+  fail_unless(swift_request_error(&r, 0) == SWIFT_ERROR_TIMEOUT);
+  r.deadline_at = 0;
+
   test_curl_easy_reset(&c);
   free(c.authtoken);
 
+  /* Requests can go out again unless they have used up their source */
+  r.state = SWIFT_STATE_AUTH;
+  fail_unless(swift_request_rewind(&r) == 0);
+  r.state = SWIFT_STATE_OBJECT_WRITE_FD;
+  r.buffer_pos = 10;
+  fail_unless(swift_request_rewind(&r) == 0);
+  r.state = SWIFT_STATE_OBJECT_READ_FD;
+  fail_unless(swift_request_rewind(&r) == 0);
+  r.state = SWIFT_STATE_OBJECT_READ;
+  r.response = 401;
+  r.compressed = 1;
+  fail_unless(swift_request_rewind(&r) == 1);
+  fail_unless(r.buffer_pos == 0);
+  fail_unless(r.response == 0);
+  fail_unless(r.compressed == 0);
+
 }
 END_TEST
 
@@ -666,29 +1277,34 @@ START_TEST (test_swift_authenticate) {
   struct test_curl_params *params = test_curl_getparams();
 
   memset(&c, 0, sizeof(c));
+  /* Hand the request a pooled handle so the response code set below
+   * survives */
+  c.pool[c.pool_count++] = curl_easy_init();
   test_curl_easy_reset(&c);
   params->response_code = response;
 
   /* Test degenerates */
-  fail_unless(swift_authenticate(NULL) == SWIFT_ERROR_NOTFOUND);
-  fail_unless(swift_authenticate(&c) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_authenticate(NULL, 0) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_authenticate(&c, 0) == SWIFT_ERROR_NOTFOUND);
 
   c.username = user;
   c.password = pass;
   c.connecturl = "http://swiftbox:11000";
 
-  fail_unless(swift_authenticate(&c) == SWIFT_SUCCESS);
+  fail_unless(swift_authenticate(&c, 0) == SWIFT_SUCCESS);
   fail_unless(c.valid_auth == 0);
-  fail_unless(c.state == SWIFT_STATE_AUTH);
+  fail_unless(c.authtoken == NULL);
   fail_unless(slist_contains(params->headers, "X-Storage-User: testuser"));
   fail_unless(slist_contains(params->headers, "X-Storage-Pass: testpass"));
   fail_unless(params->headerfunc == (curl_write_callback)swift_header_callback);
-  fail_unless(params->headerdata == &c);
+  fail_if(params->headerdata == NULL);
   fail_unless(params->writefunc == (curl_write_callback)swift_body_callback);
-  fail_unless(params->writedata == &c);
+  fail_unless(params->writedata == params->headerdata);
   fail_unless(strcmp(params->url, c.connecturl) == 0);
 
-  test_curl_easy_reset(&c);
+  /* The handle went back to the pool */
+  fail_unless(c.pool_count == 1);
+  curl_easy_cleanup(c.pool[0]);
 
 }
 END_TEST
@@ -814,6 +1430,960 @@ START_TEST (test_swift_get_data) {
 END_TEST
 
 
+START_TEST (test_swift_stream_header_callback) {
+
+  struct swift_transfer_handle h;
+
+  memset(&h, 0, sizeof(h));
+  h.type = SWIFT_HANDLE_STREAM;
+
+  swift_stream_header_callback("HTTP/1.1 200 OK\r\n", 1, 17, (void *)&h);
+  fail_unless(h.headers_done == 0);
+  fail_unless(h.response == 200);
+
+  swift_stream_header_callback("Content-Length: 17743\r\n", 1, 23, (void *)&h);
+  fail_unless(h.length == 17743);
+  fail_unless(h.headers_done == 0);
+
+  swift_stream_header_callback("content-length: 42\r\n", 1, 20, (void *)&h);
+  fail_unless(h.length == 42);
+
+  swift_stream_header_callback("X-Object-Meta-Compression: deflate\r\n", 1,
+      36, (void *)&h);
+  fail_unless(h.compressed == 1);
+
+  swift_stream_header_callback("\r\n", 1, 2, (void *)&h);
+  fail_unless(h.headers_done == 1);
+
+  /* Range handles already know the object length */
+  h.type = SWIFT_HANDLE_RANGE;
+  swift_stream_header_callback("Content-Length: 100\r\n", 1, 21, (void *)&h);
+  fail_unless(h.length == 42);
+
+}
+END_TEST
+
+START_TEST (test_swift_stream_body_callback) {
+
+  struct swift_transfer_handle h;
+  char window[10];
+  int retval;
+
+  memset(&h, 0, sizeof(h));
+  h.window = window;
+  h.window_size = 10;
+
+  retval = swift_stream_body_callback("Test1", 5, 1, (void *)&h);
+  fail_unless(retval == 5);
+  fail_unless(h.headers_done == 1);
+  fail_unless(h.window_len == 5);
+
+  retval = swift_stream_body_callback("Test2", 1, 5, (void *)&h);
+  fail_unless(retval == 5);
+  fail_unless(h.window_len == 10);
+  fail_if(memcmp(window, "Test1Test2", 10) != 0);
+
+  /* Window is full, curl must be told to pause */
+  retval = swift_stream_body_callback("Test3", 1, 5, (void *)&h);
+  fail_unless(retval == CURL_WRITEFUNC_PAUSE);
+  fail_unless(h.paused == 1);
+  fail_unless(h.window_len == 10);
+
+  /* Consume part of the window, the unread part moves to the front */
+  h.paused = 0;
+  h.window_pos = 7;
+  retval = swift_stream_body_callback("Test3", 1, 5, (void *)&h);
+  fail_unless(retval == 5);
+  fail_unless(h.window_pos == 0);
+  fail_unless(h.window_len == 8);
+  fail_if(memcmp(window, "st2Test3", 8) != 0);
+
+  /* Error bodies are refused */
+  h.response = 404;
+  retval = swift_stream_body_callback("Test4", 1, 5, (void *)&h);
+  fail_unless(retval == 0);
+
+  /* So are the stored bytes of compressed objects */
+  h.response = 200;
+  h.compressed = 1;
+  retval = swift_stream_body_callback("Test4", 1, 5, (void *)&h);
+  fail_unless(retval == 0);
+
+}
+END_TEST
+
+START_TEST (test_swift_stream_read) {
+
+  struct swift_transfer_handle h;
+  char window[10];
+  char testbuf[10];
+
+  memset(&h, 0, sizeof(h));
+  memset(testbuf, 0, 10);
+  h.type = SWIFT_HANDLE_STREAM;
+  h.window = window;
+  h.window_size = 10;
+  memcpy(window, "ABCDEFGHIJ", 10);
+  h.window_len = 10;
+
+  fail_unless(swift_read(&h, testbuf, 4) == 4);
+  fail_if(memcmp(testbuf, "ABCD", 4) != 0);
+  fail_unless(h.fpos == 4);
+  fail_unless(h.window_pos == 4);
+
+  /* Transfer is finished, so we only get what is left in the window */
+  fail_unless(swift_read(&h, testbuf, 10) == 6);
+  fail_if(memcmp(testbuf, "EFGHIJ", 6) != 0);
+  fail_unless(h.fpos == 10);
+  fail_unless(swift_read(&h, testbuf, 10) == 0);
+
+  /* Seeking is not supported on streams */
+  swift_seek(&h, 2);
+  fail_unless(h.fpos == 10);
+
+}
+END_TEST
+
+START_TEST (test_swift_stream_write) {
+
+  struct swift_transfer_handle h;
+  char window[8];
+  char testbuf[10];
+
+  memset(&h, 0, sizeof(h));
+  memset(testbuf, 0, 10);
+  h.type = SWIFT_HANDLE_STREAM;
+  h.mode = SWIFT_WRITE;
+  h.window = window;
+  h.window_size = 8;
+
+  fail_unless(swift_write(&h, "ABCDE", 5) == 5);
+  fail_unless(h.window_len == 5);
+
+  /* Transfer is not running, so only what fits in the ring is taken */
+  fail_unless(swift_write(&h, "FGHIJ", 5) == 3);
+  fail_unless(h.window_len == 8);
+  fail_unless(h.fpos == 8);
+
+  fail_unless(swift_stream_source_callback(testbuf, 1, 6, &h) == 6);
+  fail_if(memcmp(testbuf, "ABCDEF", 6) != 0);
+  fail_unless(h.window_len == 2);
+
+  /* Writes wrap around the end of the ring */
+  fail_unless(swift_write(&h, "IJKL", 4) == 4);
+  fail_unless(swift_stream_source_callback(testbuf, 1, 10, &h) == 6);
+  fail_if(memcmp(testbuf, "GHIJKL", 6) != 0);
+
+  /* An empty ring pauses the upload until the writer is finished */
+  fail_unless(swift_stream_source_callback(testbuf, 1, 10, &h) ==
+      CURL_READFUNC_PAUSE);
+  fail_unless(h.paused == 1);
+  h.finished = 1;
+  fail_unless(swift_stream_source_callback(testbuf, 1, 10, &h) == 0);
+  fail_unless(swift_write(&h, "MN", 2) == 0);
+
+  /* Write handles can not be read from */
+  fail_unless(swift_read(&h, testbuf, 10) == 0);
+
+}
+END_TEST
+
+START_TEST (test_swift_range_read) {
+
+  struct swift_transfer_handle h;
+  char window[10];
+  char testbuf[10];
+
+  memset(&h, 0, sizeof(h));
+  memset(testbuf, 0, 10);
+  h.type = SWIFT_HANDLE_RANGE;
+  h.window = window;
+  h.window_size = 10;
+  h.length = 30;
+
+  /* Window holds object bytes 20-29, the last range of the object */
+  memcpy(window, "ABCDEFGHIJ", 10);
+  h.window_len = 10;
+  h.window_off = 20;
+  h.range_start = 20;
+  h.range_end = 30;
+
+  swift_seek(&h, 22);
+  fail_unless(h.fpos == 22);
+  fail_unless(swift_read(&h, testbuf, 3) == 3);
+  fail_if(memcmp(testbuf, "CDE", 3) != 0);
+  fail_unless(h.window_off == 25);
+  fail_unless(h.window_pos == 5);
+
+  /* Skipping forward inside the window needs no request */
+  swift_seek(&h, 27);
+  fail_unless(swift_read(&h, testbuf, 10) == 3);
+  fail_if(memcmp(testbuf, "HIJ", 3) != 0);
+  fail_unless(h.fpos == 30);
+  fail_unless(swift_read(&h, testbuf, 10) == 0);
+
+}
+END_TEST
+
+
+START_TEST (test_swift_json_escape) {
+
+  char testbuf[64];
+
+  swift_json_escape(testbuf, "plain/name");
+  fail_if(strcmp(testbuf, "plain/name") != 0);
+
+  swift_json_escape(testbuf, "a\"b\\c");
+  fail_if(strcmp(testbuf, "a\\\"b\\\\c") != 0);
+
+  swift_json_escape(testbuf, "tab\there");
+  fail_if(strcmp(testbuf, "tab\\u0009here") != 0);
+
+}
+END_TEST
+
+START_TEST (test_swift_slo_manifest) {
+
+  struct swift_slo_segment segments[2];
+  char *manifest;
+
+  memset(segments, 0, sizeof(segments));
+  segments[0].size = 100;
+  strcpy(segments[0].etag, "abc");
+  segments[1].size = 5;
+
+  manifest = swift_slo_manifest("segs", "obj/slo/105/100/", segments, 2);
+  fail_if(manifest == NULL);
+  fail_if(strcmp(manifest, "["
+        "{\"path\": \"/segs/obj/slo/105/100/00000000\", "
+        "\"etag\": \"abc\", \"size_bytes\": 100}, "
+        "{\"path\": \"/segs/obj/slo/105/100/00000001\", "
+        "\"etag\": null, \"size_bytes\": 5}]") != 0);
+  free(manifest);
+
+}
+END_TEST
+
+
+START_TEST (test_swift_block_cache) {
+
+  struct swift_block_cache *cache = NULL;
+  unsigned long hits, misses;
+  char buf[16];
+  size_t len;
+  char *name;
+
+  fail_unless(swift_cache_create(&cache, 8, 16) == SWIFT_SUCCESS);
+  fail_unless(cache->block_size == 8);
+
+  name = swift_cache_name("cont", "obj", "abc");
+  fail_if(strcmp(name, "cont\nobj\nabc") != 0);
+
+  fail_unless(swift_cache_get(cache, name, 0, buf, &len) == 0);
+  swift_cache_put(cache, name, 0, "01234567", 8);
+  swift_cache_put(cache, name, 1, "89abcdef", 8);
+  fail_unless(cache->cur_bytes == 16);
+
+  /* A different ETag is a different object */
+  fail_unless(swift_cache_get(cache, "cont\nobj\nabd", 0, buf, &len) == 0);
+
+  fail_unless(swift_cache_get(cache, name, 0, buf, &len) == 1);
+  fail_unless(len == 8);
+  fail_if(memcmp(buf, "01234567", 8) != 0);
+
+  /* Block 1 is least recently used and goes to make room */
+  swift_cache_put(cache, name, 2, "ghij", 4);
+  fail_unless(cache->cur_bytes == 12);
+  fail_unless(swift_cache_get(cache, name, 1, buf, &len) == 0);
+  fail_unless(swift_cache_get(cache, name, 2, buf, &len) == 1);
+  fail_unless(len == 4);
+
+  /* Blocks bigger than the whole budget are never kept */
+  swift_cache_put(cache, name, 3, "0123456789abcdefg", 17);
+  fail_unless(swift_cache_get(cache, name, 3, buf, &len) == 0);
+  fail_unless(cache->cur_bytes == 12);
+
+  swift_cache_stats(cache, &hits, &misses);
+  fail_unless(hits == 2);
+  fail_unless(misses == 4);
+
+  free(name);
+  swift_cache_delete(&cache);
+  fail_unless(cache == NULL);
+}
+END_TEST
+
+START_TEST (test_swift_set_validators) {
+
+  struct swift_request r;
+  struct swift_object_info info;
+
+  memset(&info, 0, sizeof(info));
+  strcpy(r.if_none_match, "stale");
+  strcpy(r.if_modified_since, "stale");
+
+  swift_set_validators(&r, &info);
+  fail_if(strcmp(r.if_none_match, "") != 0);
+  fail_if(strcmp(r.if_modified_since, "") != 0);
+
+  strcpy(info.last_modified, "Sat, 17 Oct 2026 10:00:00 GMT");
+  swift_set_validators(&r, &info);
+  fail_if(strcmp(r.if_modified_since, info.last_modified) != 0);
+
+  /* The ETag wins when both are known */
+  strcpy(info.etag, "abc");
+  swift_set_validators(&r, &info);
+  fail_if(strcmp(r.if_none_match, "abc") != 0);
+  fail_if(strcmp(r.if_modified_since, "") != 0);
+
+  swift_set_validators(&r, NULL);
+  fail_if(strcmp(r.if_none_match, "") != 0);
+}
+END_TEST
+
+START_TEST (test_swift_share) {
+
+  struct swift_share *share = NULL;
+
+  fail_unless(swift_share_create(NULL) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_share_create(&share) == SWIFT_SUCCESS);
+  fail_if(share == NULL);
+  fail_if(share->curlshare == NULL);
+
+  /* Each kind of data has its own lock */
+  swift_share_lock(NULL, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE, share);
+  swift_share_lock(NULL, CURL_LOCK_DATA_CONNECT, CURL_LOCK_ACCESS_SINGLE, share);
+  fail_unless(pthread_mutex_trylock(&share->locks[CURL_LOCK_DATA_DNS]) != 0);
+  swift_share_unlock(NULL, CURL_LOCK_DATA_CONNECT, share);
+  swift_share_unlock(NULL, CURL_LOCK_DATA_DNS, share);
+  fail_unless(pthread_mutex_trylock(&share->locks[CURL_LOCK_DATA_DNS]) == 0);
+  pthread_mutex_unlock(&share->locks[CURL_LOCK_DATA_DNS]);
+
+  swift_share_delete(&share);
+  fail_unless(share == NULL);
+  swift_share_delete(&share);
+}
+END_TEST
+
+START_TEST (test_swift_md5) {
+
+  struct swift_md5 md5;
+  char hex[33];
+  char data[200];
+  int i;
+
+  swift_md5_init(&md5);
+  swift_md5_final(&md5, hex);
+  fail_if(strcmp(hex, "d41d8cd98f00b204e9800998ecf8427e") != 0);
+
+  swift_md5_init(&md5);
+  swift_md5_update(&md5, "The quick brown fox ", 20);
+  swift_md5_update(&md5, "jumps over the lazy dog", 23);
+  swift_md5_final(&md5, hex);
+  fail_if(strcmp(hex, "9e107d9d372bb6826bd81d3542a419d6") != 0);
+
+  /* Feeding in odd sized pieces across block boundaries */
+  for (i = 0; i < 200; ++i) {
+    data[i] = 'a';
+  }
+  swift_md5_init(&md5);
+  for (i = 0; i < 200; i += 7) {
+    swift_md5_update(&md5, data + i, (200 - i) < 7 ? 200 - i : 7);
+  }
+  swift_md5_final(&md5, hex);
+  fail_if(strcmp(hex, "887f30b43b2867f4a9accceee7d16e6c") != 0);
+
+  swift_md5_init(&md5);
+  swift_md5_update(&md5, "abc", 3);
+  fail_unless(swift_md5_verify(&md5, "900150983CD24FB0D6963F7D28E17F72") ==
+      SWIFT_SUCCESS);
+  swift_md5_init(&md5);
+  swift_md5_update(&md5, "abd", 3);
+  fail_unless(swift_md5_verify(&md5, "900150983cd24fb0d6963f7d28e17f72") ==
+      SWIFT_ERROR_CHECKSUM);
+
+  /* Nothing to check against, or told not to */
+  fail_unless(swift_md5_verify(&md5, "") == SWIFT_SUCCESS);
+  swift_md5_init(&md5);
+  md5.skip = 1;
+  fail_unless(swift_md5_verify(&md5, "900150983cd24fb0d6963f7d28e17f72") ==
+      SWIFT_SUCCESS);
+}
+END_TEST
+
+START_TEST (test_swift_checkpoint) {
+
+  struct swift_slo_segment segments[3];
+  char path[] = "/tmp/test_swift_cpXXXXXX";
+  FILE *fp;
+  int fd;
+
+  fd = mkstemp(path);
+  fail_if(fd < 0);
+  close(fd);
+
+  memset(segments, 0, sizeof(segments));
+  segments[0].size = segments[1].size = 100;
+  segments[2].size = 5;
+  strcpy(segments[0].etag, "abc");
+  segments[0].done = 1;
+
+  fp = swift_checkpoint_create(path, "hdr 1", "cont/obj", segments, 3);
+  fail_if(fp == NULL);
+  segments[2].done = 1;
+  swift_checkpoint_add(fp, 2, &segments[2]);
+  fprintf(fp, "1 99 wrongsize\ngarbage\n");
+  fclose(fp);
+
+  memset(segments, 0, sizeof(segments));
+  segments[0].size = segments[1].size = 100;
+  segments[2].size = 5;
+
+  /* Checkpoints for a different upload are ignored */
+  fail_unless(swift_checkpoint_load(path, "hdr 2", "cont/obj", segments, 3) == 0);
+  fail_unless(swift_checkpoint_load(path, "hdr 1", "cont/obj2", segments, 3) == 0);
+  fail_unless(segments[0].done == 0);
+
+  fail_unless(swift_checkpoint_load(path, "hdr 1", "cont/obj", segments, 3) == 2);
+  fail_unless(segments[0].done == 1);
+  fail_if(strcmp(segments[0].etag, "abc") != 0);
+  fail_unless(segments[1].done == 0);
+  fail_unless(segments[2].done == 1);
+  fail_if(strcmp(segments[2].etag, "") != 0);
+
+  unlink(path);
+
+}
+END_TEST
+
+START_TEST (test_swift_token_cache) {
+
+  struct swift_context c;
+  char path[] = "/tmp/test_swift_tokXXXXXX";
+  char line[256];
+  struct stat st;
+  FILE *fp;
+  int fd;
+  int n_lines = 0;
+
+  fd = mkstemp(path);
+  fail_if(fd < 0);
+  close(fd);
+
+  fp = fopen(path, "w");
+  fail_if(fp == NULL);
+  fprintf(fp, "http://other/auth\tuser\thttp://other/v1\tT0\n"
+      "http://host/auth\tuser\t\tT1\n"
+      "http://host/auth\tuser\thttp://host/v1\tT1\t1000\n"
+      "garbage");
+  fclose(fp);
+
+  memset(&c, 0, sizeof(c));
+  c.connecturl = "http://host/auth";
+  c.username = "user";
+  c.token_cache = path;
+
+  /* Other accounts, broken entries and expired tokens are no use */
+  fail_unless(swift_token_cache_load(&c) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(c.valid_auth == 0);
+
+  swift_token_cache_store(&c, "http://host/v1", "T2", time(NULL) + 100);
+  fail_unless(swift_token_cache_load(&c) == SWIFT_SUCCESS);
+  fail_unless(c.valid_auth == 1);
+  fail_unless(c.auth_generation == 1);
+  fail_if(c.token_expires < time(NULL) + 99);
+  fail_if(strcmp(c.authurl, "http://host/v1") != 0);
+  fail_if(strcmp(c.authtoken, "X-Auth-Token: T2") != 0);
+
+  /* A new token replaces ours, one that would break the format is not
+   * stored at all */
+  swift_token_cache_store(&c, "http://host/v1", "T3", 0);
+  swift_token_cache_store(&c, "http://host/v1", "T\t4", 0);
+  fail_unless(swift_token_cache_load(&c) == SWIFT_SUCCESS);
+  fail_if(strcmp(c.authtoken, "X-Auth-Token: T3") != 0);
+  fail_unless(c.token_expires == 0);
+
+  fp = fopen(path, "r");
+  fail_if(fp == NULL);
+  while (fgets(line, sizeof(line), fp)) {
+    ++n_lines;
+  }
+  fclose(fp);
+  fail_unless(n_lines == 3);
+
+  fail_if(stat(path, &st) != 0);
+  fail_unless((st.st_mode & 0777) == 0600);
+
+  free(c.authurl);
+  free(c.authtoken);
+  unlink(path);
+
+}
+END_TEST
+
+START_TEST (test_swift_token_refresh) {
+
+  struct swift_context *c;
+  char *token;
+  time_t now;
+
+  fail_if(swift_context_create(&c, "http://host/auth", "user", "pass"));
+  fail_if(swift_context_set_token_refresh(c, 1, 1000));
+  fail_unless(c->refresh_running == 1);
+
+  /* Tokens without an expiry get the configured lifetime, and are renewed
+   * with a tenth of it left */
+  token = (char *)malloc(16);
+  strcpy(token, "X-Auth-Token: A");
+  now = time(NULL);
+  swift_set_token(c, NULL, token, 0);
+  fail_if(c->token_expires < now + 1000 || c->token_expires > now + 1001);
+  fail_unless(c->token_refresh == c->token_expires - 100 ||
+      c->token_refresh == c->token_expires - 99);
+
+  token = (char *)malloc(16);
+  strcpy(token, "X-Auth-Token: B");
+  swift_set_token(c, NULL, token, now + 50);
+  fail_unless(c->token_expires == now + 50);
+  fail_unless(c->auth_generation == 2);
+
+  fail_if(swift_context_set_token_refresh(c, 0, 0));
+  fail_unless(c->refresh_running == 0);
+  swift_context_delete(&c);
+
+}
+END_TEST
+
+
+static int test_engine_fd;
+static int test_engine_events;
+static long test_engine_timeout;
+static struct swift_multi_op *test_engine_done_op;
+
+static void
+test_engine_socket_cb(int fd, int events, void *user) {
+  test_engine_fd = fd;
+  test_engine_events = events;
+}
+
+static void
+test_engine_timer_cb(long timeout_ms, void *user) {
+  test_engine_timeout = timeout_ms;
+}
+
+static void
+test_engine_done_cb(struct swift_multi_op *op, void *user) {
+  test_engine_done_op = op;
+}
+
+START_TEST (test_swift_engine) {
+
+  struct swift_context c;
+  struct swift_engine *engine;
+  struct swift_multi_op ops[2];
+
+  memset(&c, 0, sizeof(c));
+
+  fail_unless(swift_engine_create(&engine, &c, NULL, test_engine_timer_cb,
+        NULL, NULL) == SWIFT_ERROR_NOTFOUND);
+  fail_if(swift_engine_create(&engine, &c, test_engine_socket_cb,
+        test_engine_timer_cb, test_engine_done_cb, NULL));
+
+  /* curl's socket and timer requests come out as ours */
+  swift_engine_socket(NULL, 7, CURL_POLL_INOUT, engine, NULL);
+  fail_unless(test_engine_fd == 7);
+  fail_unless(test_engine_events == (SWIFT_POLL_IN | SWIFT_POLL_OUT));
+  swift_engine_socket(NULL, 7, CURL_POLL_IN, engine, NULL);
+  fail_unless(test_engine_events == SWIFT_POLL_IN);
+  swift_engine_socket(NULL, 7, CURL_POLL_REMOVE, engine, NULL);
+  fail_unless(test_engine_events == SWIFT_POLL_REMOVE);
+  swift_engine_timer(NULL, 250, engine);
+  fail_unless(test_engine_timeout == 250);
+
+  /* Finished ops leave the engine before the caller hears of them */
+  engine->ops = (struct swift_multi_op **)malloc(2 * sizeof(*engine->ops));
+  engine->ops[0] = &ops[0];
+  engine->ops[1] = &ops[1];
+  engine->n_ops = engine->ops_size = 2;
+  swift_engine_done(&ops[0], engine);
+  fail_unless(engine->n_ops == 1);
+  fail_unless(engine->ops[0] == &ops[1]);
+  fail_unless(test_engine_done_op == &ops[0]);
+
+  engine->n_ops = 0;
+  swift_engine_delete(&engine);
+  fail_unless(engine == NULL);
+
+}
+END_TEST
+
+
+static struct swift_async_op *test_async_done_op;
+
+static void
+test_async_cb(struct swift_async_op *op, void *user) {
+  test_async_done_op = op;
+}
+
+START_TEST (test_swift_async) {
+
+  struct swift_context c;
+  struct swift_async *async;
+  struct swift_async_op ops[2];
+  struct swift_async_op *op;
+
+  memset(&c, 0, sizeof(c));
+  memset(ops, 0, sizeof(ops));
+
+  fail_unless(swift_async_create(&async, NULL) == SWIFT_ERROR_NOTFOUND);
+  fail_if(swift_async_create(&async, &c));
+  fail_unless(swift_async_object_exists(async, NULL, "c", "o", NULL, NULL) ==
+      SWIFT_ERROR_NOTFOUND);
+  fail_unless(swift_async_object_get(async, &ops[0], "c", "o", NULL, 10, NULL,
+        NULL) == SWIFT_ERROR_NOTFOUND);
+
+  /* Ops with a callback are handed to it with the request's results */
+  ops[0].callback = test_async_cb;
+  ops[0].request = (struct swift_request *)malloc(sizeof(struct swift_request));
+  fail_if(swift_request_init(ops[0].request, &c));
+  ops[0].request->state = SWIFT_STATE_OBJECT_EXISTS;
+  ops[0].request->obj_length = 42;
+  swift_async_finish(async, &ops[0], 200);
+  fail_unless(test_async_done_op == &ops[0]);
+  fail_unless(ops[0].done == 1);
+  fail_unless(ops[0].retval == SWIFT_SUCCESS);
+  fail_unless(ops[0].length == 42);
+  fail_unless(ops[0].request == NULL);
+  fail_unless(async->queue_head == NULL);
+
+  /* The rest wait on the completion queue */
+  ops[1].request = (struct swift_request *)malloc(sizeof(struct swift_request));
+  fail_if(swift_request_init(ops[1].request, &c));
+  ops[1].request->state = SWIFT_STATE_CONTAINER_CREATE;
+  swift_async_finish(async, &ops[1], 404);
+  fail_unless(ops[1].done == 1);
+  fail_unless(swift_async_next(async, 0, &op) == SWIFT_SUCCESS);
+  fail_unless(op == &ops[1]);
+  fail_unless(op->retval == SWIFT_ERROR_NOTFOUND);
+  fail_unless(async->queue_head == NULL && async->queue_tail == NULL);
+  fail_unless(swift_async_next(async, 0, &op) == SWIFT_ERROR_NOTFOUND);
+  fail_unless(op == NULL);
+
+  swift_async_delete(&async);
+  fail_unless(async == NULL);
+
+}
+END_TEST
+
+START_TEST (test_swift_multi_window) {
+
+  struct swift_context c;
+  struct swift_multi_op ops[2];
+  struct swift_range_dest dests[2];
+  struct swift_slo_segment segments[3];
+  unsigned int free_slots[2] = {0, 1};
+  unsigned int op_segments[2];
+  struct swift_op_list list;
+  struct swift_range_window rw;
+  struct swift_segment_window sw;
+  struct swift_multi_op *op;
+  char data[10];
+  char segname[64];
+
+  memset(&c, 0, sizeof(c));
+
+  /* Op lists are handed out in order */
+  list.ops = ops;
+  list.n_ops = 2;
+  list.next = 0;
+  fail_unless(swift_op_list_next(&list) == &ops[0]);
+  fail_unless(swift_op_list_next(&list) == &ops[1]);
+  fail_unless(swift_op_list_next(&list) == NULL);
+
+  /* Ranges take free slots and give them back as they finish */
+  memset(&rw, 0, sizeof(rw));
+  rw.context = &c;
+  rw.container = "c";
+  rw.object = "o";
+  rw.data = data;
+  rw.offset = 100;
+  rw.length = 10;
+  rw.range_size = 4;
+  rw.ops = ops;
+  rw.dests = dests;
+  rw.free_slots = free_slots;
+  rw.n_free = 2;
+  op = swift_range_next(&rw);
+  fail_unless(op == &ops[1]);
+  fail_unless(op->offset == 100 && op->length == 4);
+  op = swift_range_next(&rw);
+  fail_unless(op == &ops[0]);
+  fail_unless(op->offset == 104 && op->length == 4);
+  fail_unless(swift_range_next(&rw) == NULL);
+
+  ops[1].retval = SWIFT_SUCCESS;
+  dests[1].pos = dests[1].end;
+  swift_range_done(&ops[1], &rw);
+  fail_unless(rw.s_err == SWIFT_SUCCESS);
+  op = swift_range_next(&rw);
+  fail_unless(op == &ops[1]);
+  fail_unless(op->offset == 108 && op->length == 2);
+  fail_unless(swift_range_next(&rw) == NULL);
+
+  /* A short range fails the read */
+  ops[0].retval = SWIFT_SUCCESS;
+  swift_range_done(&ops[0], &rw);
+  fail_unless(rw.s_err == SWIFT_ERROR_UNKNOWN);
+  fail_unless(rw.n_free == 1);
+
+  /* Segments already uploaded are skipped, no more start after a failure */
+  memset(&sw, 0, sizeof(sw));
+  memset(segments, 0, sizeof(segments));
+  free_slots[0] = 0;
+  free_slots[1] = 1;
+  segments[0].size = 4;
+  segments[0].done = 1;
+  segments[1].size = 4;
+  segments[2].size = 2;
+  sw.context = &c;
+  sw.data = data;
+  sw.segment_container = "c_segments";
+  sw.prefix = "o/slo/10/4/";
+  sw.segname = segname;
+  sw.segment_size = 4;
+  sw.segments = segments;
+  sw.n_segments = 3;
+  sw.ops = ops;
+  sw.sources = dests;
+  sw.op_segments = op_segments;
+  sw.free_slots = free_slots;
+  sw.n_free = 2;
+  op = swift_segment_next(&sw);
+  fail_unless(op == &ops[1]);
+  fail_if(strcmp(op->objname, "o/slo/10/4/00000001"));
+  fail_unless(op->length == 4 && dests[1].pos == 4);
+  op = swift_segment_next(&sw);
+  fail_unless(op == &ops[0]);
+  fail_if(strcmp(op->objname, "o/slo/10/4/00000002"));
+  fail_unless(op->length == 2);
+
+  ops[1].retval = SWIFT_SUCCESS;
+  strcpy(ops[1].etag, "abc");
+  swift_segment_done(&ops[1], &sw);
+  fail_unless(segments[1].done == 1);
+  fail_if(strcmp(segments[1].etag, "abc"));
+  ops[0].retval = SWIFT_ERROR_UNKNOWN;
+  swift_segment_done(&ops[0], &sw);
+  fail_unless(segments[2].done == 0);
+  fail_unless(sw.s_err == SWIFT_ERROR_UNKNOWN);
+  fail_unless(swift_segment_next(&sw) == NULL);
+
+}
+END_TEST
+
+START_TEST (test_swift_retry) {
+
+  struct swift_context c;
+  struct swift_context *a;
+  struct swift_context *b;
+  long delay;
+
+  memset(&c, 0, sizeof(c));
+
+  /* Contexts that were never given a policy do not retry */
+  fail_unless(swift_retry_delay(&c, CURLE_OK, 503, 0) == -1);
+
+  swift_context_set_retry(&c, 3, SWIFT_RETRY_ALL, 100, 400);
+  fail_unless(swift_retry_delay(&c, CURLE_OK, 200, 0) == -1);
+  fail_unless(swift_retry_delay(&c, CURLE_OK, 404, 0) == -1);
+  fail_unless(swift_retry_delay(&c, CURLE_WRITE_ERROR, 200, 0) == -1);
+
+  /* Backoff doubles, with up to half of it left to chance */
+  delay = swift_retry_delay(&c, CURLE_OK, 503, 0);
+  fail_unless(delay >= 50 && delay <= 100);
+  delay = swift_retry_delay(&c, CURLE_OK, 429, 1);
+  fail_unless(delay >= 100 && delay <= 200);
+  delay = swift_retry_delay(&c, CURLE_COULDNT_CONNECT, 0, 1);
+  fail_unless(delay >= 100 && delay <= 200);
+  fail_unless(swift_retry_delay(&c, CURLE_OK, 503, 2) == -1);
+
+  /* Up to the cap */
+  c.retry_attempts = 10;
+  delay = swift_retry_delay(&c, CURLE_OK, 500, 8);
+  fail_unless(delay >= 200 && delay <= 400);
+
+  /* Only the failures asked for */
+  c.retry_on = SWIFT_RETRY_5XX;
+  fail_unless(swift_retry_delay(&c, CURLE_OK, 429, 0) == -1);
+  fail_unless(swift_retry_delay(&c, CURLE_RECV_ERROR, 0, 0) == -1);
+  fail_unless(swift_transport_failure(CURLE_RECV_ERROR) == 1);
+  fail_unless(swift_transport_failure(CURLE_OK) == 0);
+
+  swift_retry_count(&c);
+  swift_retry_count(&c);
+  fail_unless(swift_context_retries(&c) == 2);
+
+  /* Jitter is drawn from the context's own seed */
+  c.retry_on = SWIFT_RETRY_ALL;
+  c.retry_seed[0] = 1;
+  c.retry_seed[1] = 2;
+  c.retry_seed[2] = 3;
+  delay = swift_retry_delay(&c, CURLE_OK, 500, 8);
+  c.retry_seed[0] = 1;
+  c.retry_seed[1] = 2;
+  c.retry_seed[2] = 3;
+  fail_unless(swift_retry_delay(&c, CURLE_OK, 500, 8) == delay);
+
+  fail_if(swift_context_create(&a, "http://swiftbox", "user", "pass"));
+  fail_if(swift_context_create(&b, "http://swiftbox", "user", "pass"));
+  fail_if(memcmp(a->retry_seed, b->retry_seed, sizeof(a->retry_seed)) == 0);
+  swift_context_delete(&a);
+  swift_context_delete(&b);
+
+}
+END_TEST
+
+START_TEST (test_swift_deadline) {
+
+  struct swift_context c;
+  unsigned long long at;
+
+  memset(&c, 0, sizeof(c));
+
+  fail_unless(swift_deadline_at(&c, 0) == 0);
+  at = swift_deadline_at(&c, 500);
+  fail_unless(at > swift_now_ms() && at <= swift_now_ms() + 500);
+
+  swift_context_set_deadline(&c, 0, 2000);
+  at = swift_deadline_at(&c, 0);
+  fail_unless(at > swift_now_ms() + 1000 && at <= swift_now_ms() + 2000);
+  fail_unless(swift_deadline_at(&c, 100) <= swift_now_ms() + 100);
+
+  fail_unless(swift_set_timeouts(NULL, &c, 1) == SWIFT_ERROR_TIMEOUT);
+
+  /* Timeouts are told apart from other transport failures */
+  fail_unless(swift_failure(NULL, CURLE_COULDNT_CONNECT, 0) ==
+      SWIFT_ERROR_CONNECT);
+  fail_unless(swift_failure(NULL, CURLE_OPERATION_TIMEDOUT, 1) ==
+      SWIFT_ERROR_TIMEOUT);
+  fail_unless(swift_failure(NULL, CURLE_OPERATION_TIMEDOUT, 0) ==
+      SWIFT_ERROR_CONNECT);
+
+  fail_unless(strcmp(swift_errormsg(SWIFT_ERROR_TIMEOUT),
+        "Deadline passed") == 0);
+  fail_unless(strcmp(swift_errormsg(SWIFT_ERROR_STALLED),
+        "Transfer stalled") == 0);
+
+}
+END_TEST
+
+START_TEST (test_swift_hedge) {
+
+  struct swift_context c;
+  struct swift_request request;
+  struct swift_request copy;
+  struct swift_multi_op op;
+  struct swift_multi_op *t_op;
+  struct swift_multi_op *flight;
+  unsigned long samples[5] = {40, 10, 30, 50, 20};
+  unsigned long reads;
+  unsigned long hedges;
+  unsigned long wins;
+  char status[] = "HTTP/1.1 200 OK\r\n";
+  unsigned int i;
+
+  memset(&c, 0, sizeof(c));
+
+  fail_unless(swift_hedge_percentile(samples, 5, 0) == 10);
+  fail_unless(swift_hedge_percentile(samples, 5, 50) == 30);
+  fail_unless(swift_hedge_percentile(samples, 5, 99) == 40);
+  fail_unless(swift_hedge_percentile(samples, 5, 100) == 50);
+
+  fail_unless(swift_context_set_hedge(&c, 101, 5) == SWIFT_ERROR_INTERNAL);
+  fail_unless(swift_context_set_hedge(&c, 90, 10) == SWIFT_SUCCESS);
+
+  /* No delay until enough reads have been seen */
+  for (i = 0; i < SWIFT_HEDGE_SAMPLES / 8 - 1; ++i) {
+    fail_unless(swift_hedge_begin(&c) == -1);
+    swift_hedge_sample(&c, i, 0);
+  }
+  fail_unless(swift_hedge_begin(&c) == -1);
+  swift_hedge_sample(&c, 100, 1);
+  fail_unless(swift_hedge_begin(&c) == 13);
+
+  /* One hedge for every ten reads, counting only those sent */
+  fail_unless(swift_hedge_allow(&c) == 1);
+  fail_unless(swift_hedge_allow(&c) == 1);
+  swift_hedge_launched(&c);
+  fail_unless(swift_hedge_allow(&c) == 0);
+  for (i = 0; i < 10; ++i) {
+    swift_hedge_begin(&c);
+  }
+  fail_unless(swift_hedge_allow(&c) == 1);
+  swift_hedge_launched(&c);
+  fail_unless(swift_hedge_allow(&c) == 0);
+  swift_context_hedge_stats(&c, &hedges, &wins);
+  fail_unless(hedges == 2 && wins == 1);
+
+  /* The first of a read and its copy to answer keeps going */
+  memset(&request, 0, sizeof(request));
+  memset(&copy, 0, sizeof(copy));
+  request.hedge = &copy;
+  copy.hedge = &request;
+  fail_unless(swift_header_callback(status, 1, strlen(status), &copy) ==
+      strlen(status));
+  fail_unless(copy.first_byte && copy.response == 200);
+  fail_unless(swift_header_callback(status, 1, strlen(status), &request) == 0);
+  fail_unless(!request.first_byte && !request.response);
+
+  memset(&op, 0, sizeof(op));
+  op.context = &c;
+  op.hedge = (struct swift_multi_op *)malloc(sizeof(op));
+  memcpy(op.hedge, &op, sizeof(op));
+  op.hedge->hedge = &op;
+  op.hedge->hedge_copy = 1;
+  fail_unless(swift_multi_header_callback(status, 1, strlen(status), &op) ==
+      strlen(status));
+  fail_unless(swift_multi_header_callback(status, 1, strlen(status),
+        op.hedge) == 0);
+
+  /* A copy that lost is dropped while the op runs on */
+  op.curlhandle = (CURL *)&op;
+  t_op = op.hedge;
+  fail_unless(swift_hedge_resolve(NULL, &t_op) == 1);
+  fail_unless(op.hedge == NULL);
+
+  /* One that answered hands its outcome to the op */
+  op.curlhandle = NULL;
+  op.first_byte = 0;
+  op.hedge = (struct swift_multi_op *)malloc(sizeof(op));
+  memcpy(op.hedge, &op, sizeof(op));
+  op.hedge->hedge = &op;
+  op.hedge->hedge_copy = 1;
+  op.hedge->first_byte = 5;
+  op.hedge->response = 206;
+  strcpy(op.hedge->etag, "abc");
+  t_op = op.hedge;
+  fail_unless(swift_hedge_resolve(NULL, &t_op) == 0);
+  fail_unless(t_op == &op && op.hedge == NULL);
+  fail_unless(op.response == 206 && op.first_byte == 5);
+  fail_unless(strcmp(op.etag, "abc") == 0);
+
+  /* A read is counted once, not again for each retry */
+  memset(&op, 0, sizeof(op));
+  op.context = &c;
+  flight = NULL;
+  reads = c.hedge_reads;
+  swift_hedge_watch(&op, &flight);
+  fail_unless(c.hedge_reads == reads + 1 && flight == &op);
+  op.retries = 1;
+  flight = NULL;
+  swift_hedge_watch(&op, &flight);
+  fail_unless(c.hedge_reads == reads + 1 && flight == &op);
+
+}
+END_TEST
+
 Suite *swift_suite(void) {
   Suite *s = suite_create("libswift");
   TCase *tc_core = tcase_create("Internal functions");
@@ -824,9 +2394,25 @@ Suite *swift_suite(void) {
   tcase_add_test(tc_core, test_swift_chomp);
   tcase_add_test(tc_core, test_swift_set_headers);
   tcase_add_test(tc_core, test_swift_string_to_list);
+  tcase_add_test(tc_core, test_swift_json_escape);
+  tcase_add_test(tc_core, test_swift_slo_manifest);
+  tcase_add_test(tc_core, test_swift_checkpoint);
+  tcase_add_test(tc_core, test_swift_token_cache);
+  tcase_add_test(tc_core, test_swift_token_refresh);
+  tcase_add_test(tc_core, test_swift_engine);
+  tcase_add_test(tc_core, test_swift_async);
+  tcase_add_test(tc_core, test_swift_multi_window);
+  tcase_add_test(tc_core, test_swift_retry);
+  tcase_add_test(tc_core, test_swift_hedge);
+  tcase_add_test(tc_core, test_swift_deadline);
+  tcase_add_test(tc_core, test_swift_block_cache);
+  tcase_add_test(tc_core, test_swift_set_validators);
+  tcase_add_test(tc_core, test_swift_md5);
+  tcase_add_test(tc_core, test_swift_share);
 
   tcase_add_test(tc_api, test_swift_context_create);
   tcase_add_test(tc_api, test_swift_node_list_setup);
+  tcase_add_test(tc_api, test_swift_node_page_setup);
   tcase_add_test(tc_api, test_swift_node_list_free);
   tcase_add_test(tc_api, test_swift_container_create_setup);
   tcase_add_test(tc_api, test_swift_container_delete_setup);
@@ -835,20 +2421,37 @@ Suite *swift_suite(void) {
   tcase_add_test(tc_api, test_swift_free_transfer_handle);
   tcase_add_test(tc_api, test_swift_create_transfer_handle);
   tcase_add_test(tc_api, test_swift_sync_setup_read);
+  tcase_add_test(tc_api, test_swift_sync_setup_read_fd);
   tcase_add_test(tc_api, test_swift_sync_setup_write);
+  tcase_add_test(tc_api, test_swift_sync_setup_write_fd);
+  tcase_add_test(tc_api, test_swift_handle_pool);
   tcase_add_test(tc_api, test_swift_perform);
+  tcase_add_test(tc_api, test_swift_compressed_head);
   tcase_add_test(tc_api, test_swift_authenticate);
   tcase_add_test(tc_api, test_swift_read);
   tcase_add_test(tc_api, test_swift_write);
   tcase_add_test(tc_api, test_swift_seek);
   tcase_add_test(tc_api, test_swift_get_data);
+  tcase_add_test(tc_api, test_swift_stream_read);
+  tcase_add_test(tc_api, test_swift_stream_write);
+  tcase_add_test(tc_api, test_swift_range_read);
 
   tcase_add_test(tc_cb, test_swift_header_callback_authtoken);
   tcase_add_test(tc_cb, test_swift_header_callback_authurl);
   tcase_add_test(tc_cb, test_swift_header_callback_counts);
   tcase_add_test(tc_cb, test_swift_body_callback_objlist);
   tcase_add_test(tc_cb, test_swift_body_callback_objread);
+  tcase_add_test(tc_cb, test_swift_body_callback_objread_fd);
+  tcase_add_test(tc_cb, test_swift_body_callback_large);
   tcase_add_test(tc_cb, test_swift_upload_callback);
+  tcase_add_test(tc_cb, test_swift_upload_callback_fd);
+  tcase_add_test(tc_cb, test_swift_compress_callbacks);
+  tcase_add_test(tc_cb, test_swift_range_dest_callback);
+  tcase_add_test(tc_cb, test_swift_range_source_callback);
+  tcase_add_test(tc_cb, test_swift_multi_header_callback);
+  tcase_add_test(tc_cb, test_swift_load_op);
+  tcase_add_test(tc_cb, test_swift_stream_header_callback);
+  tcase_add_test(tc_cb, test_swift_stream_body_callback);
 
 
 